@@ -0,0 +1,194 @@
+package developpeur2000.luajitjava.bench;
+
+import java.lang.management.ManagementFactory;
+
+/**
+ * Fixture class of the luajitjava benchmarks.
+ *
+ * Methods come in one overload per arity, from 0 to 8 arguments, for each argument shape
+ * (ints, strings and objects), so that every shape of call resolves to a single method.
+ * Bodies do as little as possible, the benchmarks measuring the bridge and not java code.
+ */
+public class BenchFixture
+{
+	public int intField = 42;
+	public String stringField = "field";
+	public Object objectField = new Object();
+	public static int staticField = 7;
+
+	private static final com.sun.management.ThreadMXBean threads = threadBean();
+
+	public BenchFixture() {
+	}
+
+	public BenchFixture(int value) {
+		intField = value;
+	}
+
+	public BenchFixture(String value) {
+		stringField = value;
+	}
+
+	public BenchFixture(int value, String text) {
+		intField = value;
+		stringField = text;
+	}
+
+	/**
+	 * Bytes allocated on the java heap by the current thread so far, -1 when the JVM does not tell
+	 */
+	public static long allocatedBytes() {
+		if (threads == null) {
+			return -1;
+		}
+		return threads.getThreadAllocatedBytes(Thread.currentThread().getId());
+	}
+
+	private static com.sun.management.ThreadMXBean threadBean() {
+		try {
+			com.sun.management.ThreadMXBean bean = (com.sun.management.ThreadMXBean) ManagementFactory.getThreadMXBean();
+			if (!bean.isThreadAllocatedMemorySupported()) {
+				return null;
+			}
+			bean.setThreadAllocatedMemoryEnabled(true);
+			return bean;
+		} catch (ClassCastException | UnsupportedOperationException e) {
+			return null;
+		}
+	}
+
+	public static int staticAdd(int a, int b) {
+		return a + b;
+	}
+
+	/**
+	 * Boxed results, read back through the value getters
+	 */
+	public static Object boxedInt() {
+		return Integer.valueOf(1234);
+	}
+
+	public static Object boxedString() {
+		return "boxed";
+	}
+
+	public int getIntField() {
+		return intField;
+	}
+
+	/**
+	 * Primitive arguments
+	 */
+	public int ints0() {
+		return 0;
+	}
+
+	public int ints1(int a) {
+		return a;
+	}
+
+	public int ints2(int a, int b) {
+		return a + b;
+	}
+
+	public int ints3(int a, int b, int c) {
+		return a + b + c;
+	}
+
+	public int ints4(int a, int b, int c, int d) {
+		return a + b + c + d;
+	}
+
+	public int ints5(int a, int b, int c, int d, int e) {
+		return a + b + c + d + e;
+	}
+
+	public int ints6(int a, int b, int c, int d, int e, int f) {
+		return a + b + c + d + e + f;
+	}
+
+	public int ints7(int a, int b, int c, int d, int e, int f, int g) {
+		return a + b + c + d + e + f + g;
+	}
+
+	public int ints8(int a, int b, int c, int d, int e, int f, int g, int h) {
+		return a + b + c + d + e + f + g + h;
+	}
+
+	/**
+	 * String arguments, the length of the first one is returned so that no string crosses back
+	 */
+	public int strings1(String a) {
+		return a.length();
+	}
+
+	public int strings2(String a, String b) {
+		return a.length();
+	}
+
+	public int strings3(String a, String b, String c) {
+		return a.length();
+	}
+
+	public int strings4(String a, String b, String c, String d) {
+		return a.length();
+	}
+
+	public int strings5(String a, String b, String c, String d, String e) {
+		return a.length();
+	}
+
+	public int strings6(String a, String b, String c, String d, String e, String f) {
+		return a.length();
+	}
+
+	public int strings7(String a, String b, String c, String d, String e, String f, String g) {
+		return a.length();
+	}
+
+	public int strings8(String a, String b, String c, String d, String e, String f, String g, String h) {
+		return a.length();
+	}
+
+	/**
+	 * Object arguments
+	 */
+	public int objects1(Object a) {
+		return a == null ? 0 : 1;
+	}
+
+	public int objects2(Object a, Object b) {
+		return a == null ? 0 : 2;
+	}
+
+	public int objects3(Object a, Object b, Object c) {
+		return a == null ? 0 : 3;
+	}
+
+	public int objects4(Object a, Object b, Object c, Object d) {
+		return a == null ? 0 : 4;
+	}
+
+	public int objects5(Object a, Object b, Object c, Object d, Object e) {
+		return a == null ? 0 : 5;
+	}
+
+	public int objects6(Object a, Object b, Object c, Object d, Object e, Object f) {
+		return a == null ? 0 : 6;
+	}
+
+	public int objects7(Object a, Object b, Object c, Object d, Object e, Object f, Object g) {
+		return a == null ? 0 : 7;
+	}
+
+	public int objects8(Object a, Object b, Object c, Object d, Object e, Object f, Object g, Object h) {
+		return a == null ? 0 : 8;
+	}
+
+	/**
+	 * String result
+	 */
+	public String echo(String value) {
+		return value;
+	}
+}
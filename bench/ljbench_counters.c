@@ -0,0 +1,193 @@
+/******************************************************************************
+* ljbench_counters.c
+*
+*    counters of the luajitjava benchmarks : jni functions called and allocations made
+*    by the benchmark thread, shared by the C driver and the lua scripts
+*
+*    jni calls are counted by pointing the jni environment of the thread to a copy
+*    of its function table, every entry of which goes through a trampoline
+*    incrementing the counter before jumping to the original function.
+*    Allocations are counted by wrapping the malloc family, which only works
+*    when this library comes before the C library in the symbol lookup order
+*
+*****************************************************************************/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stddef.h>
+#include <string.h>
+
+#include <jni.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <dlfcn.h>
+#endif
+
+#include "ljbench_counters.h"
+
+/***************************************************************
+      JNI CALLS
+****************************************************************/
+
+//number of trampolines, more than the entries of any jni function table
+#define LJBENCH_JNI_SLOTS 256
+
+//counter and original functions, read by the trampolines
+__attribute__((visibility("hidden"))) long long ljbench_jni_calls = 0;
+__attribute__((visibility("hidden"))) void* ljbench_jni_original[LJBENCH_JNI_SLOTS];
+
+//trampolines, one every LJBENCH_JNI_STRIDE bytes from ljbench_jni_trampolines.
+// Only the thread the counter is installed on goes through them, so the counter is not atomic.
+// Scratch registers are used, so that arguments reach the original function untouched
+#if defined(__x86_64__) && !defined(_WIN32)
+#define LJBENCH_JNI_STRIDE 16
+__asm__(
+	".text\n"
+	".p2align 4\n"
+	".globl ljbench_jni_trampolines\n"
+	".hidden ljbench_jni_trampolines\n"
+	"ljbench_jni_trampolines:\n"
+	".set ljbench_jni_slot, 0\n"
+	".rept 256\n"
+	"	.p2align 4\n"
+	"	incq ljbench_jni_calls(%rip)\n"
+	"	jmp *ljbench_jni_original+8*ljbench_jni_slot(%rip)\n"
+	"	.set ljbench_jni_slot, ljbench_jni_slot+1\n"
+	".endr\n");
+#elif defined(__aarch64__) && !defined(_WIN32)
+#define LJBENCH_JNI_STRIDE 32
+__asm__(
+	".text\n"
+	".p2align 5\n"
+	".globl ljbench_jni_trampolines\n"
+	".hidden ljbench_jni_trampolines\n"
+	"ljbench_jni_trampolines:\n"
+	".set ljbench_jni_slot, 0\n"
+	".rept 256\n"
+	"	.p2align 5\n"
+	"	adrp x16, ljbench_jni_calls\n"
+	"	ldr x17, [x16, :lo12:ljbench_jni_calls]\n"
+	"	add x17, x17, #1\n"
+	"	str x17, [x16, :lo12:ljbench_jni_calls]\n"
+	"	adrp x16, ljbench_jni_original\n"
+	"	add x16, x16, :lo12:ljbench_jni_original\n"
+	"	ldr x16, [x16, #8*ljbench_jni_slot]\n"
+	"	br x16\n"
+	"	.set ljbench_jni_slot, ljbench_jni_slot+1\n"
+	".endr\n");
+#else
+#define LJBENCH_JNI_STRIDE 0
+#endif
+
+#if LJBENCH_JNI_STRIDE
+extern char ljbench_jni_trampolines[];
+#endif
+
+//function table of the counted thread
+static struct JNINativeInterface_ countingTable;
+
+int ljbenchInstallJniCounter(void)
+{
+#if LJBENCH_JNI_STRIDE
+	JavaVM* jvms[1];
+	jsize nJvms = 0;
+	JNIEnv* env;
+	size_t firstSlot = offsetof(struct JNINativeInterface_, GetVersion) / sizeof(void*);
+	size_t nSlots = sizeof(struct JNINativeInterface_) / sizeof(void*);
+	void** slots = (void**)&countingTable;
+
+	if (nSlots > LJBENCH_JNI_SLOTS) {
+		return 0;
+	}
+	if (JNI_GetCreatedJavaVMs(jvms, 1, &nJvms) != JNI_OK || nJvms < 1) {
+		return 0;
+	}
+	if ((*jvms[0])->GetEnv(jvms[0], (void**)&env, JNI_VERSION_1_8) != JNI_OK) {
+		return 0;
+	}
+	if (*env == &countingTable) {
+		return 1;
+	}
+	memcpy(ljbench_jni_original, *env, sizeof(struct JNINativeInterface_));
+	memcpy(slots, *env, sizeof(struct JNINativeInterface_));
+	//the reserved entries before GetVersion are not functions
+	for (size_t i = firstSlot; i < nSlots; i++) {
+		slots[i] = ljbench_jni_trampolines + i * LJBENCH_JNI_STRIDE;
+	}
+	*env = &countingTable;
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+long long ljbenchJniCalls(void)
+{
+	return ljbench_jni_calls;
+}
+
+/***************************************************************
+      ALLOCATIONS
+****************************************************************/
+
+#if defined(__GLIBC__)
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static volatile int countingAllocs = 0;
+static pthread_t countedThread;
+static long long allocs = 0;
+
+static void countAlloc(void)
+{
+	if (countingAllocs && pthread_equal(pthread_self(), countedThread)) {
+		allocs++;
+	}
+}
+
+LjBenchExport void* malloc(size_t size)
+{
+	countAlloc();
+	return __libc_malloc(size);
+}
+
+LjBenchExport void* calloc(size_t count, size_t size)
+{
+	countAlloc();
+	return __libc_calloc(count, size);
+}
+
+LjBenchExport void* realloc(void* ptr, size_t size)
+{
+	countAlloc();
+	return __libc_realloc(ptr, size);
+}
+
+int ljbenchStartAllocCounter(void)
+{
+	Dl_info found, self;
+
+	//allocations of other libraries only come here when this malloc is the one found first
+	if (!dladdr(dlsym(RTLD_DEFAULT, "malloc"), &found) || !dladdr((void*)ljbenchStartAllocCounter, &self)
+		|| found.dli_fbase != self.dli_fbase) {
+		return 0;
+	}
+	countedThread = pthread_self();
+	allocs = 0;
+	countingAllocs = 1;
+	return 1;
+}
+#else
+int ljbenchStartAllocCounter(void)
+{
+	return 0;
+}
+static long long allocs = 0;
+#endif
+
+long long ljbenchAllocs(void)
+{
+	return allocs;
+}
@@ -0,0 +1,29 @@
+#ifndef _Included_ljbench_counters
+#define _Included_ljbench_counters
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _WIN32
+#define LjBenchExport   __declspec( dllexport )
+#else
+#define LjBenchExport   __attribute__((visibility("default")))
+#endif
+
+//count the jni functions called from the current thread, which must be attached to the running JVM.
+// Returns 0 when the JVM cannot be found or counting is not supported on this architecture
+LjBenchExport int ljbenchInstallJniCounter(void);
+//number of jni functions called since the counter was installed, on the thread it was installed from
+LjBenchExport long long ljbenchJniCalls(void);
+
+//count the allocations of the current thread, through the malloc family of this library.
+// Returns 0 when allocations cannot be counted, the library then having to be linked
+// before the C library or preloaded
+LjBenchExport int ljbenchStartAllocCounter(void);
+//number of malloc, calloc and realloc calls of the counted thread
+LjBenchExport long long ljbenchAllocs(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
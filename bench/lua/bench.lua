@@ -0,0 +1,343 @@
+--microbenchmarks of the luajitjava lua module, run against the
+-- developpeur2000.luajitjava.bench.BenchFixture class
+--
+--  luajit bench.lua [--classpath <path>] [--iterations <n>] [--json <file>] [--filter <text>]
+--
+--the class path holding the fixture jar can also be given by LJBENCH_CLASSPATH.
+--jni calls are counted when the ljbench counters library can be loaded, from LJBENCH_COUNTERS
+-- or the library path, and C allocations when it is also preloaded before the C library.
+-- Counters that cannot be read are reported as null
+
+local ffi = require("ffi")
+
+--luajitjava.lua is found in the bin directory of the repository, after any LUA_PATH entry
+local this_file = debug.getinfo(1, 'S').source
+local bench_dir = this_file:match("^@(.-)[\\/][^\\/]*$") or "."
+package.path = string.format("%s;%s/../../bin/?.lua", package.path, bench_dir)
+local luajitjava = require("luajitjava")
+
+local FIXTURE = "developpeur2000.luajitjava.bench.BenchFixture"
+local J = {
+  INT = luajitjava.JTYPE_INT,
+  STRING = luajitjava.JTYPE_STRING,
+  OBJECT = luajitjava.JTYPE_OBJECT,
+}
+
+--options
+local class_path = os.getenv("LJBENCH_CLASSPATH") or "luajitjava_bench.jar"
+local iterations = 100000
+local json_path = nil
+local filter = nil
+do
+  local i = 1
+  while i <= #arg do
+    local option, value = arg[i], arg[i + 1]
+    if option == "--classpath" and value then
+      class_path = value
+    elseif option == "--iterations" and value then
+      iterations = tonumber(value)
+    elseif option == "--json" and value then
+      json_path = value
+    elseif option == "--filter" and value then
+      filter = value
+    else
+      io.stderr:write("usage: luajit bench.lua [--classpath <path>] [--iterations <n>] [--json <file>] [--filter <text>]\n")
+      os.exit(2)
+    end
+    i = i + 2
+  end
+end
+
+--monotonic clock, in nanoseconds
+local now_ns
+if ffi.os == "Windows" then
+  now_ns = function() return os.clock() * 1e9 end
+else
+  ffi.cdef[[
+  typedef struct ljbench_timespec { long tv_sec; long tv_nsec; } ljbench_timespec_t;
+  int clock_gettime(int clock, ljbench_timespec_t* now);
+  ]]
+  local CLOCK_MONOTONIC = ffi.os == "OSX" and 6 or 1
+  local now = ffi.new("ljbench_timespec_t")
+  now_ns = function()
+    ffi.C.clock_gettime(CLOCK_MONOTONIC, now)
+    return tonumber(now.tv_sec) * 1e9 + tonumber(now.tv_nsec)
+  end
+end
+
+--counters library
+ffi.cdef[[
+int ljbenchInstallJniCounter(void);
+long long ljbenchJniCalls(void);
+int ljbenchStartAllocCounter(void);
+long long ljbenchAllocs(void);
+]]
+local counters_loaded, counters = pcall(ffi.load, os.getenv("LJBENCH_COUNTERS") or "ljbench")
+if not counters_loaded then
+  counters = nil
+end
+
+luajitjava.java_init(class_path)
+if not luajitjava.java_env() then
+  io.stderr:write("Couldn't start the JVM\n")
+  os.exit(1)
+end
+local fixture_class = luajitjava.get_java_class(FIXTURE)
+if not fixture_class then
+  io.stderr:write("Couldn't bind " .. FIXTURE .. ", check the class path\n")
+  os.exit(1)
+end
+local fixture = luajitjava.new_java_object(fixture_class)
+local arg_object = luajitjava.new_java_object(fixture_class)
+
+local count_jni = counters ~= nil and counters.ljbenchInstallJniCounter() ~= 0
+local count_allocs = counters ~= nil and counters.ljbenchStartAllocCounter() ~= 0
+if not count_jni then
+  io.stderr:write("jni calls are not counted, the ljbench library could not be used\n")
+end
+if not count_allocs then
+  io.stderr:write("allocations are not counted, the ljbench library must be preloaded\n")
+end
+local function jni_calls()
+  return count_jni and tonumber(counters.ljbenchJniCalls()) or 0
+end
+local function allocs()
+  return count_allocs and tonumber(counters.ljbenchAllocs()) or 0
+end
+
+--bytes allocated on the java heap by this thread, nil when the JVM does not tell
+local function java_bytes()
+  local bytes = tonumber(fixture_class:allocatedBytes())
+  if bytes and bytes >= 0 then
+    return bytes
+  end
+end
+local count_java_bytes = java_bytes() ~= nil
+local java_bytes_overhead = 0
+if count_java_bytes then
+  local before = java_bytes()
+  java_bytes_overhead = java_bytes() - before
+end
+
+local results = {}
+
+--time a loop of n operations made by run(n), after a warmup letting both jits compile it.
+-- ops_per_call is the number of operations each loop iteration stands for
+local function bench(name, shape, run, n, ops_per_call)
+  if filter and not name:find(filter, 1, true) and not shape:find(filter, 1, true) then
+    return
+  end
+  n = n or iterations
+  ops_per_call = ops_per_call or 1
+  local ok, err = pcall(run, math.max(math.floor(n / 10), 1))
+  if not ok then
+    io.stderr:write(string.format("benchmark %s (%s) failed : %s\n", name, shape, tostring(err)))
+    return
+  end
+  collectgarbage()
+
+  local java_before = count_java_bytes and java_bytes() or 0
+  local jni_before = jni_calls()
+  local allocs_before = allocs()
+  local start = now_ns()
+  run(n)
+  local finish = now_ns()
+  local allocs_after = allocs()
+  local jni_after = jni_calls()
+  local java_after = count_java_bytes and java_bytes() or 0
+
+  local n_ops = n * ops_per_call
+  local result = {
+    name = name,
+    shape = shape,
+    iterations = n_ops,
+    ns_per_op = (finish - start) / n_ops,
+    jni_per_op = count_jni and (jni_after - jni_before) / n_ops or nil,
+    mallocs_per_op = count_allocs and (allocs_after - allocs_before) / n_ops or nil,
+    java_bytes_per_op = count_java_bytes and math.max(java_after - java_before - java_bytes_overhead, 0) / n_ops or nil,
+  }
+  table.insert(results, result)
+
+  local line = string.format("%-28s %-16s %10.1f ns/op", name, shape, result.ns_per_op)
+  if result.jni_per_op then
+    line = line .. string.format(" %8.2f jni/op", result.jni_per_op)
+  end
+  if result.mallocs_per_op then
+    line = line .. string.format(" %8.2f mallocs/op", result.mallocs_per_op)
+  end
+  if result.java_bytes_per_op then
+    line = line .. string.format(" %10.1f java B/op", result.java_bytes_per_op)
+  end
+  print(line)
+  io.stdout:flush()
+end
+
+--loop calling a method through the proxy path, compiled for the shape
+-- so that the call site is the one a script would write
+local function proxy_loop(method_name, arg_type, n_args)
+  local args = {}
+  for i = 1, n_args do
+    local value = arg_type == "INT" and tostring(i) or arg_type == "STRING" and '"bench"' or "arg_object"
+    table.insert(args, string.format("J.%s, %s", arg_type, value))
+  end
+  local source = string.format([[
+    local fixture, arg_object, J = ...
+    return function(n)
+      for i = 1, n do
+        fixture:%s(%s)
+      end
+    end]], method_name, table.concat(args, ", "))
+  return assert(loadstring(source, "=" .. method_name))(fixture, arg_object, J)
+end
+
+--class binding and objects creation
+bench("get_java_class", "bind+release", function(n)
+  for i = 1, n do
+    local java_class = luajitjava.get_java_class(FIXTURE)
+    java_class.__release()
+  end
+end)
+bench("new_java_object", "0 args", function(n)
+  for i = 1, n do
+    luajitjava.new_java_object(FIXTURE).__release()
+  end
+end)
+bench("new_java_object", "1 int", function(n)
+  for i = 1, n do
+    luajitjava.new_java_object(FIXTURE, J.INT, i).__release()
+  end
+end)
+bench("new_java_object", "1 string", function(n)
+  for i = 1, n do
+    luajitjava.new_java_object(FIXTURE, J.STRING, "bench").__release()
+  end
+end)
+bench("new_java_object", "int+string", function(n)
+  for i = 1, n do
+    luajitjava.new_java_object(FIXTURE, J.INT, i, J.STRING, "bench").__release()
+  end
+end)
+local many_values = {}
+for i = 1, 64 do
+  many_values[i] = i
+end
+bench("new_many", "64 x 1 int", function(n)
+  for i = 1, n do
+    luajitjava.new_many(FIXTURE, 64, J.INT, many_values)
+  end
+end, math.floor(iterations / 64) + 1, 64)
+
+--method calls through proxy_func, for every shape
+for n_args = 0, 8 do
+  bench("proxy method", n_args .. " ints", proxy_loop("ints" .. n_args, "INT", n_args))
+end
+for n_args = 1, 8 do
+  bench("proxy method", n_args .. " strings", proxy_loop("strings" .. n_args, "STRING", n_args))
+end
+for n_args = 1, 8 do
+  bench("proxy method", n_args .. " objects", proxy_loop("objects" .. n_args, "OBJECT", n_args))
+end
+bench("proxy method", "string result", proxy_loop("echo", "STRING", 1))
+bench("proxy class method", "2 ints", function(n)
+  for i = 1, n do
+    fixture_class:staticAdd(J.INT, i, J.INT, 1)
+  end
+end)
+
+--fields and values
+bench("object field", "int", function(n)
+  for i = 1, n do
+    local field = fixture.intField
+  end
+end)
+bench("object field", "string", function(n)
+  for i = 1, n do
+    local field = fixture.stringField
+  end
+end)
+bench("object field", "object", function(n)
+  for i = 1, n do
+    local field = fixture.objectField
+  end
+end)
+bench("class field", "int", function(n)
+  for i = 1, n do
+    local field = fixture_class.staticField
+  end
+end)
+--fields and method results are read as lua values, boxed handles come from methods bound as returning objects
+local boxed_int_method = luajitjava.bind_method(fixture_class, "boxedInt", "()Ljava/lang/Object;")
+local boxed_string_method = luajitjava.bind_method(fixture_class, "boxedString", "()Ljava/lang/Object;")
+local boxed_int = boxed_int_method()
+local boxed_string = boxed_string_method()
+bench("__value", "boxed int", function(n)
+  for i = 1, n do
+    local value = boxed_int.__value
+  end
+end)
+bench("__value", "string", function(n)
+  for i = 1, n do
+    local value = boxed_string.__value
+  end
+end)
+bench("string_value", "string", function(n)
+  for i = 1, n do
+    local value = luajitjava.string_value(boxed_string)
+  end
+end)
+
+--bound methods and batches
+local ints2 = luajitjava.bind_method(fixture_class, "ints2", "(II)I")
+local get_int_field = luajitjava.bind_method(fixture_class, "getIntField", "()I")
+bench("bound method", "2 ints", function(n)
+  for i = 1, n do
+    ints2(fixture, i, 1)
+  end
+end)
+bench("bound method", "0 args", function(n)
+  for i = 1, n do
+    get_int_field(fixture)
+  end
+end)
+local batch_calls = {}
+for i = 1, 16 do
+  batch_calls[i] = { fixture, "ints2", J.INT, i, J.INT, 1 }
+end
+bench("batch", "16 x 2 ints", function(n)
+  for i = 1, n do
+    luajitjava.batch(batch_calls)
+  end
+end, math.floor(iterations / 16) + 1, 16)
+
+ints2.__release()
+get_int_field.__release()
+boxed_int_method.__release()
+boxed_string_method.__release()
+boxed_int.__release()
+boxed_string.__release()
+arg_object.__release()
+fixture.__release()
+fixture_class.__release()
+luajitjava.java_end()
+
+--results
+if json_path then
+  local out = io.open(json_path, "w")
+  if not out then
+    io.stderr:write("Couldn't write benchmark results to " .. json_path .. "\n")
+    os.exit(1)
+  end
+  local function counter(value)
+    return value and string.format("%.3f", value) or "null"
+  end
+  out:write('{"suite": "lua", "results": [\n')
+  for i, result in ipairs(results) do
+    out:write(string.format('  {"name": "%s", "shape": "%s", "iterations": %d, "ns_per_op": %.3f, '
+      .. '"jni_per_op": %s, "mallocs_per_op": %s, "java_bytes_per_op": %s}%s\n',
+      result.name, result.shape, result.iterations, result.ns_per_op,
+      counter(result.jni_per_op), counter(result.mallocs_per_op), counter(result.java_bytes_per_op),
+      i < #results and "," or ""))
+  end
+  out:write("]}\n")
+  out:close()
+end
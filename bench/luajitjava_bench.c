@@ -0,0 +1,577 @@
+/******************************************************************************
+* luajitjava_bench.c
+*
+*    microbenchmarks of the exported luajitjava functions, run against the
+*    developpeur2000.luajitjava.bench.BenchFixture class
+*
+*    every benchmark reports the time, the jni functions called, the C allocations
+*    and the java heap bytes allocated per operation, by the calling thread only.
+*    Counters that cannot be read on the platform are reported as null
+*
+*    luajitjava_bench [--classpath <path>] [--iterations <n>] [--json <file>] [--filter <text>]
+*
+*****************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "luajitjava.h"
+#include "ljbench_counters.h"
+
+#define LJBENCH_FIXTURE "developpeur2000.luajitjava.bench.BenchFixture"
+#define LJBENCH_MAX_ARGS 8
+#define LJBENCH_MANY 64
+#define LJBENCH_BATCH 16
+#define LJBENCH_MAX_RESULTS 128
+#define LJBENCH_STRING "bench"
+
+//state shared by all benchmarks, the shape fields being set before each run
+typedef struct benchContext {
+	void* ljEnv;
+	ljJavaClass_t fixtureClass;
+	ljJavaObject_t fixture;
+	ljJavaObject_t argObject;
+	ljJavaObject_t boxedInt;
+	ljJavaObject_t boxedString;
+	ljJavaMethod_t ints2Method;
+	ljJavaMethod_t getIntFieldMethod;
+	//shape of the current benchmark
+	const char* name;
+	int nArgs;
+	javaArgType_t argTypes[LJBENCH_MAX_ARGS];
+	ljJavaValue_t args[LJBENCH_MAX_ARGS];
+	ljJavaObject_t many[LJBENCH_MANY];
+	ljJavaValue_t manyArgs[LJBENCH_MANY];
+	ljJavaBatchCall_t batch[LJBENCH_BATCH];
+	ljJavaResult_t result;
+	//counters available on this platform
+	int countJni;
+	int countAllocs;
+	int countJavaBytes;
+	long long javaBytesOverhead;
+} benchContext_t;
+
+//one operation of a benchmark, returns 0 on failure
+typedef int (*benchOp_t)(benchContext_t* ctx);
+
+typedef struct benchResult {
+	const char* api;
+	char shape[32];
+	long long iterations;
+	double nsPerOp;
+	double jniPerOp;
+	double mallocsPerOp;
+	double javaBytesPerOp;
+} benchResult_t;
+
+static benchResult_t results[LJBENCH_MAX_RESULTS];
+static int nResults = 0;
+
+/***************************************************************
+      COUNTERS
+****************************************************************/
+
+static long long nowNs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+//bytes allocated on the java heap by this thread, -1 when the JVM does not tell
+static long long javaAllocatedBytes(benchContext_t* ctx)
+{
+	ljJavaResult_t result;
+
+	if (!javaRunClassMethodR(&ctx->fixtureClass, "allocatedBytes", 0, NULL, NULL, &result) || result.type != JTYPE_LONG) {
+		return -1;
+	}
+	return result.value.j;
+}
+
+/***************************************************************
+      OPERATIONS
+****************************************************************/
+
+static int opBindClass(benchContext_t* ctx)
+{
+	ljJavaClass_t classInterface;
+
+	classInterface.ljEnv = ctx->ljEnv;
+	if (!javaBindClass(&classInterface, LJBENCH_FIXTURE)) {
+		return 0;
+	}
+	javaReleaseClass(&classInterface);
+	return 1;
+}
+
+static int opNew(benchContext_t* ctx)
+{
+	ljJavaObject_t object;
+
+	object.ljEnv = ctx->ljEnv;
+	if (!javaNewA(&object, &ctx->fixtureClass, ctx->nArgs, ctx->argTypes, ctx->args)) {
+		return 0;
+	}
+	javaReleaseObject(&object);
+	return 1;
+}
+
+static int opNewMany(benchContext_t* ctx)
+{
+	int nCreated = javaNewMany(ctx->many, &ctx->fixtureClass, LJBENCH_MANY, 1, ctx->argTypes, ctx->manyArgs);
+
+	for (int i = 0; i < LJBENCH_MANY; i++) {
+		javaReleaseObject(&ctx->many[i]);
+	}
+	return nCreated == LJBENCH_MANY;
+}
+
+static int opRunObjectMethodR(benchContext_t* ctx)
+{
+	return javaRunObjectMethodR(&ctx->fixture, ctx->name, ctx->nArgs, ctx->argTypes, ctx->args, &ctx->result);
+}
+
+static int opRunObjectMethodA(benchContext_t* ctx)
+{
+	ljJavaObject_t* result = javaRunObjectMethodA(&ctx->fixture, ctx->name, ctx->nArgs, ctx->argTypes, ctx->args);
+
+	if (result == NULL) {
+		return 0;
+	}
+	javaReleaseObject(result);
+	return 1;
+}
+
+static int opRunClassMethodR(benchContext_t* ctx)
+{
+	return javaRunClassMethodR(&ctx->fixtureClass, ctx->name, ctx->nArgs, ctx->argTypes, ctx->args, &ctx->result);
+}
+
+static int opCheckObjectField(benchContext_t* ctx)
+{
+	ljJavaObject_t* field = javaCheckObjectField(&ctx->fixture, ctx->name);
+
+	if (field == NULL) {
+		return 0;
+	}
+	javaReleaseObject(field);
+	return 1;
+}
+
+static int opCheckClassField(benchContext_t* ctx)
+{
+	ljJavaObject_t* field = javaCheckClassField(&ctx->fixtureClass, ctx->name);
+
+	if (field == NULL) {
+		return 0;
+	}
+	javaReleaseObject(field);
+	return 1;
+}
+
+static int opCheckObjectFieldR(benchContext_t* ctx)
+{
+	int isField = javaCheckObjectFieldR(&ctx->fixture, ctx->name, &ctx->result);
+
+	if (isField && ctx->result.type == JTYPE_OBJECT) {
+		javaReleaseObject(ctx->result.value.object);
+	}
+	return isField;
+}
+
+static int opCheckClassFieldR(benchContext_t* ctx)
+{
+	return javaCheckClassFieldR(&ctx->fixtureClass, ctx->name, &ctx->result);
+}
+
+static int opGetObjectType(benchContext_t* ctx)
+{
+	return javaGetObjectType(&ctx->boxedInt) == JTYPE_INT;
+}
+
+static int opGetObjectIntValue(benchContext_t* ctx)
+{
+	return javaGetObjectIntValue(&ctx->boxedInt) == 1234;
+}
+
+static int opGetObjectStringValue(benchContext_t* ctx)
+{
+	const char* value = javaGetObjectStringValue(&ctx->boxedString);
+
+	if (value == NULL) {
+		return 0;
+	}
+	javaReleaseStringValue(&ctx->boxedString, value);
+	return 1;
+}
+
+static int opGetObjectValueInt(benchContext_t* ctx)
+{
+	return javaGetObjectValue(&ctx->boxedInt, &ctx->result) && ctx->result.type == JTYPE_INT;
+}
+
+static int opGetObjectValueString(benchContext_t* ctx)
+{
+	return javaGetObjectValue(&ctx->boxedString, &ctx->result) && ctx->result.type == JTYPE_STRING;
+}
+
+static int opCallIntMethod(benchContext_t* ctx)
+{
+	return javaCallIntMethod(&ctx->ints2Method, &ctx->fixture, ctx->args) == 3;
+}
+
+static int opCallGetter(benchContext_t* ctx)
+{
+	return javaCallIntMethod(&ctx->getIntFieldMethod, &ctx->fixture, NULL) == 42;
+}
+
+static int opRunBatch(benchContext_t* ctx)
+{
+	return javaRunBatch(ctx->ljEnv, LJBENCH_BATCH, ctx->batch) == LJBENCH_BATCH;
+}
+
+/***************************************************************
+      RUNNER
+****************************************************************/
+
+//fill the shape arguments with nArgs values of a type
+static void setShape(benchContext_t* ctx, const char* name, javaArgType_t type, int nArgs)
+{
+	ctx->name = name;
+	ctx->nArgs = nArgs;
+	for (int i = 0; i < nArgs; i++) {
+		ctx->argTypes[i] = type;
+		switch (type) {
+		case JTYPE_INT:
+			ctx->args[i].i = i + 1;
+			break;
+		case JTYPE_STRING:
+			ctx->args[i].chars.data = LJBENCH_STRING;
+			ctx->args[i].chars.length = (int)strlen(LJBENCH_STRING);
+			ctx->args[i].chars.utf16 = 0;
+			break;
+		default:
+			ctx->args[i].object = &ctx->argObject;
+			break;
+		}
+	}
+}
+
+//time iterations calls of op, after a warmup letting the JVM compile the java side.
+// opsPerCall is the number of operations a call stands for, results being given per operation
+static void runBench(benchContext_t* ctx, const char* filter, const char* api, const char* shape,
+	benchOp_t op, long long iterations, int opsPerCall)
+{
+	benchResult_t* result;
+	long long javaBefore, javaAfter, jniBefore, jniAfter, allocsBefore, allocsAfter, start, end;
+	long long warmup = iterations / 10 > 0 ? iterations / 10 : 1;
+	double nOps;
+
+	if (filter != NULL && strstr(api, filter) == NULL && strstr(shape, filter) == NULL) {
+		return;
+	}
+	if (nResults >= LJBENCH_MAX_RESULTS) {
+		fprintf(stderr, "benchmark %s (%s) skipped : too many results\n", api, shape);
+		return;
+	}
+	for (long long i = 0; i < warmup; i++) {
+		if (!op(ctx)) {
+			fprintf(stderr, "benchmark %s (%s) failed\n", api, shape);
+			return;
+		}
+	}
+
+	javaBefore = ctx->countJavaBytes ? javaAllocatedBytes(ctx) : 0;
+	jniBefore = ljbenchJniCalls();
+	allocsBefore = ljbenchAllocs();
+	start = nowNs();
+	for (long long i = 0; i < iterations; i++) {
+		op(ctx);
+	}
+	end = nowNs();
+	allocsAfter = ljbenchAllocs();
+	jniAfter = ljbenchJniCalls();
+	javaAfter = ctx->countJavaBytes ? javaAllocatedBytes(ctx) : 0;
+
+	nOps = (double)iterations * opsPerCall;
+	result = &results[nResults++];
+	result->api = api;
+	snprintf(result->shape, sizeof(result->shape), "%s", shape);
+	result->iterations = iterations * opsPerCall;
+	result->nsPerOp = (double)(end - start) / nOps;
+	result->jniPerOp = ctx->countJni ? (double)(jniAfter - jniBefore) / nOps : -1;
+	result->mallocsPerOp = ctx->countAllocs ? (double)(allocsAfter - allocsBefore) / nOps : -1;
+	result->javaBytesPerOp = ctx->countJavaBytes ?
+		(double)(javaAfter - javaBefore - ctx->javaBytesOverhead) / nOps : -1;
+	if (result->javaBytesPerOp < 0 && ctx->countJavaBytes) {
+		result->javaBytesPerOp = 0;
+	}
+
+	printf("%-28s %-16s %10.1f ns/op", api, shape, result->nsPerOp);
+	if (ctx->countJni) {
+		printf(" %8.2f jni/op", result->jniPerOp);
+	}
+	if (ctx->countAllocs) {
+		printf(" %8.2f mallocs/op", result->mallocsPerOp);
+	}
+	if (ctx->countJavaBytes) {
+		printf(" %10.1f java B/op", result->javaBytesPerOp);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+//write a counter value, null when it is not counted
+static void writeCounter(FILE* out, const char* name, double value)
+{
+	if (value < 0) {
+		fprintf(out, ", \"%s\": null", name);
+	} else {
+		fprintf(out, ", \"%s\": %.3f", name, value);
+	}
+}
+
+static int writeJson(const char* path)
+{
+	FILE* out = fopen(path, "w");
+
+	if (out == NULL) {
+		fprintf(stderr, "Couldn't write benchmark results to %s\n", path);
+		return 0;
+	}
+	fprintf(out, "{\"suite\": \"c\", \"results\": [\n");
+	for (int i = 0; i < nResults; i++) {
+		fprintf(out, "  {\"name\": \"%s\", \"shape\": \"%s\", \"iterations\": %lld, \"ns_per_op\": %.3f",
+			results[i].api, results[i].shape, results[i].iterations, results[i].nsPerOp);
+		writeCounter(out, "jni_per_op", results[i].jniPerOp);
+		writeCounter(out, "mallocs_per_op", results[i].mallocsPerOp);
+		writeCounter(out, "java_bytes_per_op", results[i].javaBytesPerOp);
+		fprintf(out, "}%s\n", i + 1 < nResults ? "," : "");
+	}
+	fprintf(out, "]}\n");
+	fclose(out);
+	return 1;
+}
+
+/***************************************************************
+      SETUP
+****************************************************************/
+
+//get a handle on the object returned by a static method of the fixture
+static int fixtureObject(benchContext_t* ctx, const char* methodName, ljJavaObject_t* object)
+{
+	ljJavaObject_t* result = javaRunClassMethodA(&ctx->fixtureClass, methodName, 0, NULL, NULL);
+
+	if (result == NULL) {
+		return 0;
+	}
+	*object = *result;
+	//the handle slot goes back to the pool, its reference being kept by the copy
+	result->object = NULL;
+	javaReleaseObject(result);
+	return 1;
+}
+
+static int setupContext(benchContext_t* ctx)
+{
+	ctx->fixtureClass.ljEnv = ctx->ljEnv;
+	if (!javaBindClass(&ctx->fixtureClass, LJBENCH_FIXTURE)) {
+		fprintf(stderr, "Couldn't bind %s, check the class path\n", LJBENCH_FIXTURE);
+		return 0;
+	}
+	ctx->fixture.ljEnv = ctx->ljEnv;
+	ctx->argObject.ljEnv = ctx->ljEnv;
+	if (!javaNewA(&ctx->fixture, &ctx->fixtureClass, 0, NULL, NULL)
+		|| !javaNewA(&ctx->argObject, &ctx->fixtureClass, 0, NULL, NULL)) {
+		fprintf(stderr, "Couldn't create the fixture objects\n");
+		return 0;
+	}
+	if (!fixtureObject(ctx, "boxedInt", &ctx->boxedInt) || !fixtureObject(ctx, "boxedString", &ctx->boxedString)) {
+		fprintf(stderr, "Couldn't get the boxed fixture values\n");
+		return 0;
+	}
+	ctx->ints2Method.ljEnv = ctx->ljEnv;
+	ctx->getIntFieldMethod.ljEnv = ctx->ljEnv;
+	if (!javaBindMethod(&ctx->ints2Method, &ctx->fixtureClass, "ints2", "(II)I")
+		|| !javaBindMethod(&ctx->getIntFieldMethod, &ctx->fixtureClass, "getIntField", "()I")) {
+		fprintf(stderr, "Couldn't bind the fixture methods\n");
+		return 0;
+	}
+
+	ctx->countJavaBytes = javaAllocatedBytes(ctx) >= 0;
+	if (ctx->countJavaBytes) {
+		//bytes allocated by the two reads around a run, removed from the measures
+		long long before = javaAllocatedBytes(ctx);
+		long long after = javaAllocatedBytes(ctx);
+		ctx->javaBytesOverhead = after - before;
+	}
+	return 1;
+}
+
+static void releaseContext(benchContext_t* ctx)
+{
+	javaReleaseMethod(&ctx->getIntFieldMethod);
+	javaReleaseMethod(&ctx->ints2Method);
+	javaReleaseObject(&ctx->boxedString);
+	javaReleaseObject(&ctx->boxedInt);
+	javaReleaseObject(&ctx->argObject);
+	javaReleaseObject(&ctx->fixture);
+	javaReleaseClass(&ctx->fixtureClass);
+}
+
+static void runAll(benchContext_t* ctx, const char* filter, long long iterations)
+{
+	static const char* intMethods[] = { "ints0", "ints1", "ints2", "ints3", "ints4", "ints5", "ints6", "ints7", "ints8" };
+	static const char* stringMethods[] = { NULL, "strings1", "strings2", "strings3", "strings4", "strings5", "strings6", "strings7", "strings8" };
+	static const char* objectMethods[] = { NULL, "objects1", "objects2", "objects3", "objects4", "objects5", "objects6", "objects7", "objects8" };
+	char shape[32];
+
+	runBench(ctx, filter, "javaBindClass", "bind+release", opBindClass, iterations, 1);
+
+	setShape(ctx, NULL, JTYPE_NONE, 0);
+	runBench(ctx, filter, "javaNewA", "0 args", opNew, iterations, 1);
+	setShape(ctx, NULL, JTYPE_INT, 1);
+	runBench(ctx, filter, "javaNewA", "1 int", opNew, iterations, 1);
+	setShape(ctx, NULL, JTYPE_STRING, 1);
+	runBench(ctx, filter, "javaNewA", "1 string", opNew, iterations, 1);
+	setShape(ctx, NULL, JTYPE_INT, 2);
+	ctx->argTypes[1] = JTYPE_STRING;
+	ctx->args[1].chars.data = LJBENCH_STRING;
+	ctx->args[1].chars.length = (int)strlen(LJBENCH_STRING);
+	ctx->args[1].chars.utf16 = 0;
+	runBench(ctx, filter, "javaNewA", "int+string", opNew, iterations, 1);
+
+	setShape(ctx, NULL, JTYPE_INT, 1);
+	for (int i = 0; i < LJBENCH_MANY; i++) {
+		ctx->manyArgs[i].i = i;
+	}
+	runBench(ctx, filter, "javaNewMany", "64 x 1 int", opNewMany, iterations / LJBENCH_MANY + 1, LJBENCH_MANY);
+
+	for (int n = 0; n <= LJBENCH_MAX_ARGS; n++) {
+		snprintf(shape, sizeof(shape), "%d ints", n);
+		setShape(ctx, intMethods[n], JTYPE_INT, n);
+		runBench(ctx, filter, "javaRunObjectMethodR", shape, opRunObjectMethodR, iterations, 1);
+	}
+	for (int n = 1; n <= LJBENCH_MAX_ARGS; n++) {
+		snprintf(shape, sizeof(shape), "%d strings", n);
+		setShape(ctx, stringMethods[n], JTYPE_STRING, n);
+		runBench(ctx, filter, "javaRunObjectMethodR", shape, opRunObjectMethodR, iterations, 1);
+	}
+	for (int n = 1; n <= LJBENCH_MAX_ARGS; n++) {
+		snprintf(shape, sizeof(shape), "%d objects", n);
+		setShape(ctx, objectMethods[n], JTYPE_OBJECT, n);
+		runBench(ctx, filter, "javaRunObjectMethodR", shape, opRunObjectMethodR, iterations, 1);
+	}
+	setShape(ctx, "ints0", JTYPE_INT, 0);
+	runBench(ctx, filter, "javaRunObjectMethodA", "0 args", opRunObjectMethodA, iterations, 1);
+	setShape(ctx, "ints8", JTYPE_INT, 8);
+	runBench(ctx, filter, "javaRunObjectMethodA", "8 ints", opRunObjectMethodA, iterations, 1);
+	setShape(ctx, "echo", JTYPE_STRING, 1);
+	runBench(ctx, filter, "javaRunObjectMethodR", "string result", opRunObjectMethodR, iterations, 1);
+	setShape(ctx, "staticAdd", JTYPE_INT, 2);
+	runBench(ctx, filter, "javaRunClassMethodR", "2 ints", opRunClassMethodR, iterations, 1);
+
+	setShape(ctx, "intField", JTYPE_NONE, 0);
+	runBench(ctx, filter, "javaCheckObjectField", "int", opCheckObjectField, iterations, 1);
+	setShape(ctx, "stringField", JTYPE_NONE, 0);
+	runBench(ctx, filter, "javaCheckObjectField", "string", opCheckObjectField, iterations, 1);
+	setShape(ctx, "objectField", JTYPE_NONE, 0);
+	runBench(ctx, filter, "javaCheckObjectField", "object", opCheckObjectField, iterations, 1);
+	setShape(ctx, "staticField", JTYPE_NONE, 0);
+	runBench(ctx, filter, "javaCheckClassField", "int", opCheckClassField, iterations, 1);
+	setShape(ctx, "intField", JTYPE_NONE, 0);
+	runBench(ctx, filter, "javaCheckObjectFieldR", "int", opCheckObjectFieldR, iterations, 1);
+	setShape(ctx, "stringField", JTYPE_NONE, 0);
+	runBench(ctx, filter, "javaCheckObjectFieldR", "string", opCheckObjectFieldR, iterations, 1);
+	setShape(ctx, "objectField", JTYPE_NONE, 0);
+	runBench(ctx, filter, "javaCheckObjectFieldR", "object", opCheckObjectFieldR, iterations, 1);
+	setShape(ctx, "staticField", JTYPE_NONE, 0);
+	runBench(ctx, filter, "javaCheckClassFieldR", "int", opCheckClassFieldR, iterations, 1);
+
+	runBench(ctx, filter, "javaGetObjectType", "boxed int", opGetObjectType, iterations, 1);
+	runBench(ctx, filter, "javaGetObjectIntValue", "boxed int", opGetObjectIntValue, iterations, 1);
+	runBench(ctx, filter, "javaGetObjectStringValue", "string", opGetObjectStringValue, iterations, 1);
+	runBench(ctx, filter, "javaGetObjectValue", "boxed int", opGetObjectValueInt, iterations, 1);
+	runBench(ctx, filter, "javaGetObjectValue", "string", opGetObjectValueString, iterations, 1);
+
+	setShape(ctx, NULL, JTYPE_INT, 2);
+	runBench(ctx, filter, "javaCallIntMethod", "2 ints", opCallIntMethod, iterations, 1);
+	runBench(ctx, filter, "javaCallIntMethod", "0 args", opCallGetter, iterations, 1);
+
+	setShape(ctx, NULL, JTYPE_INT, 2);
+	memset(ctx->batch, 0, sizeof(ctx->batch));
+	for (int i = 0; i < LJBENCH_BATCH; i++) {
+		ctx->batch[i].receiver = &ctx->fixture;
+		ctx->batch[i].name = "ints2";
+		ctx->batch[i].nArgs = 2;
+		ctx->batch[i].argTypes = ctx->argTypes;
+		ctx->batch[i].args = ctx->args;
+	}
+	runBench(ctx, filter, "javaRunBatch", "16 x 2 ints", opRunBatch, iterations / LJBENCH_BATCH + 1, LJBENCH_BATCH);
+}
+
+static void usage(const char* program)
+{
+	fprintf(stderr, "usage: %s [--classpath <path>] [--iterations <n>] [--json <file>] [--filter <text>]\n", program);
+}
+
+int main(int argc, char** argv)
+{
+	const char* classPath = "luajitjava.jar:luajitjava_bench.jar";
+	const char* jsonPath = NULL;
+	const char* filter = NULL;
+	long long iterations = 100000;
+	benchContext_t* ctx;
+	int ok;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--classpath") == 0 && i + 1 < argc) {
+			classPath = argv[++i];
+		} else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+			iterations = atoll(argv[++i]);
+		} else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+			jsonPath = argv[++i];
+		} else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+			filter = argv[++i];
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (iterations <= 0) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	ctx = calloc(1, sizeof(benchContext_t));
+	ctx->ljEnv = javaStart(classPath);
+	if (ctx->ljEnv == NULL) {
+		fprintf(stderr, "Couldn't start the JVM\n");
+		free(ctx);
+		return 1;
+	}
+	ok = setupContext(ctx);
+	if (ok) {
+		ctx->countJni = ljbenchInstallJniCounter();
+		ctx->countAllocs = ljbenchStartAllocCounter();
+		if (!ctx->countJni) {
+			fprintf(stderr, "jni calls are not counted on this platform\n");
+		}
+		if (!ctx->countAllocs) {
+			fprintf(stderr, "allocations are not counted, the counters library must come before the C library\n");
+		}
+		runAll(ctx, filter, iterations);
+		releaseContext(ctx);
+	}
+	javaEnd(ctx->ljEnv);
+	free(ctx);
+
+	if (ok && jsonPath != NULL) {
+		ok = writeJson(jsonPath);
+	}
+	return ok ? 0 : 1;
+}
@@ -1,14 +1,18 @@
 local luajitjava = {}
 
-local LUAJITJAVA_DLL = "luajitjava.dll"
+--ffi is the luajit library loader package
+local ffi = require("ffi")
+
+local LUAJITJAVA_LIB = ffi.os == "Windows" and "luajitjava.dll"
+  or ffi.os == "OSX" and "libluajitjava.dylib"
+  or "libluajitjava.so"
+--separator of class path entries
+local CLASS_PATH_SEPARATOR = ffi.os == "Windows" and ";" or ":"
 local LUAJITJAVA_JAR = "luajitjava.jar"
 
 --get current dir
 local this_file = debug.getinfo(1,'S').source;
-local current_dir = string.format("%s%s", this_file:match("^@(.-)([\\])luajitjava%.lua$"))
-
---ffi is the luajit library loader package
-local ffi = require("ffi")
+local current_dir = string.format("%s%s", this_file:match("^@(.-)([\\/])luajitjava%.lua$"))
 
 --first we have to define all methods we are going to use
 ffi.cdef[[
@@ -20,6 +24,7 @@ typedef struct ljJavaClass {
 typedef struct ljJavaObject {
   void* ljEnv;
   void* object;
+  void* pool;
 } ljJavaObject_t;
 
 typedef enum javaArgType {
@@ -37,29 +42,195 @@ typedef enum javaArgType {
 } javaArgType_t;
 typedef struct javaArgTypes { javaArgType_t types; } javaArgTypes;
 
+typedef struct ljJavaChars {
+  const void* data;
+  int length;
+  int utf16;
+} ljJavaChars_t;
+
+typedef union ljJavaValue {
+  char b;
+  short s;
+  int i;
+  long long j;
+  float f;
+  double d;
+  char z;
+  unsigned short c;
+  const char* string;
+  ljJavaChars_t chars;
+  ljJavaObject_t* object;
+} ljJavaValue_t;
+
+typedef struct ljJavaResult {
+  javaArgType_t type;
+  int length;
+  ljJavaValue_t value;
+} ljJavaResult_t;
+
+typedef struct ljJavaMethod {
+  void* ljEnv;
+  void* clazz;
+  void* methodID;
+  int isStatic;
+  javaArgType_t returnType;
+  int nArgs;
+  javaArgType_t* argTypes;
+  void** argClasses;
+} ljJavaMethod_t;
+
+typedef enum javaStatsOp {
+  JSTATS_BIND_CLASS,
+  JSTATS_NEW,
+  JSTATS_NEW_MANY,
+  JSTATS_FIELD,
+  JSTATS_METHOD,
+  JSTATS_BOUND_METHOD,
+  JSTATS_VALUE,
+  JSTATS_BATCH,
+  JSTATS_ASYNC,
+  JSTATS_ARRAY,
+  JSTATS_OP_COUNT
+} javaStatsOp_t;
+
+typedef struct ljJavaLatency {
+  long long calls;
+  long long errors;
+  long long totalNs;
+  long long maxNs;
+  long long buckets[128];
+} ljJavaLatency_t;
+
+typedef struct ljJavaStats {
+  int handlesInUse;
+  int handlesFree;
+  int handleSlabs;
+  int pendingReleases;
+  int objectRefs;
+  int registeredClasses;
+  int classHandles;
+  int cachedMethods;
+  int cachedFields;
+  int enabled;
+  int methodsEnabled;
+  ljJavaLatency_t ops[JSTATS_OP_COUNT];
+} ljJavaStats_t;
+
+typedef struct ljJavaMethodStats {
+  char className[128];
+  char name[128];
+  int nArgs;
+  int direct;
+  ljJavaLatency_t latency;
+} ljJavaMethodStats_t;
+
+typedef struct ljJavaBatchCall {
+  void* receiver;
+  int classReceiver;
+  int isField;
+  const char* name;
+  int nArgs;
+  const javaArgType_t* argTypes;
+  const ljJavaValue_t* args;
+  int ok;
+  ljJavaResult_t result;
+} ljJavaBatchCall_t;
+
+typedef struct ljJavaArray {
+  void* ljEnv;
+  void* array;
+  javaArgType_t elementType;
+  int length;
+  void* elements;
+  int critical;
+  int isCopy;
+} ljJavaArray_t;
+
+typedef enum javaFutureState {
+  JFUTURE_PENDING,
+  JFUTURE_DONE,
+  JFUTURE_FAILED
+} javaFutureState_t;
+
+typedef struct ljJavaFuture {
+  void* ljEnv;
+  void* state;
+} ljJavaFuture_t;
+
 void* javaStart(const char* classPath);
+void* javaStartDispatcher(const char* classPath);
+void* javaStartEx(const char* classPath, int nOptions, const char** options, const char* sharedArchive, int useDispatcher);
 void javaEnd(void* ljEnv);
 int javaBindClass(ljJavaClass_t* classInterface, const char* className);
 void javaReleaseClass(ljJavaClass_t* classInterface);
 ljJavaObject_t* javaCheckClassField(ljJavaClass_t* classInterface, const char * key);
+int javaCheckClassFieldR(ljJavaClass_t* classInterface, const char * key, ljJavaResult_t* result);
 ljJavaObject_t* javaRunClassMethod(ljJavaClass_t* classInterface, const char * methodName, int nArgs, ...);
+ljJavaObject_t* javaRunClassMethodA(ljJavaClass_t* classInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args);
+int javaRunClassMethodR(ljJavaClass_t* classInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args, ljJavaResult_t* result);
 int javaNew(ljJavaObject_t* objectInterface, ljJavaClass_t* classInterface, int nArgs, ...);
+int javaNewA(ljJavaObject_t* objectInterface, ljJavaClass_t* classInterface, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args);
+int javaNewMany(ljJavaObject_t* objects, ljJavaClass_t* classInterface, int nObjects, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args);
 void javaReleaseObject(ljJavaObject_t* objectInterface);
 ljJavaObject_t* javaCheckObjectField(ljJavaObject_t* objectInterface, const char * key);
+int javaCheckObjectFieldR(ljJavaObject_t* objectInterface, const char * key, ljJavaResult_t* result);
 ljJavaObject_t* javaRunObjectMethod(ljJavaObject_t* objectInterface, const char * methodName, int nArgs, ...);
+ljJavaObject_t* javaRunObjectMethodA(ljJavaObject_t* objectInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args);
+int javaRunObjectMethodR(ljJavaObject_t* objectInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args, ljJavaResult_t* result);
 int javaGetObjectType(ljJavaObject_t* objectInterface);
 int javaGetObjectIntValue(ljJavaObject_t* objectInterface);
 long javaGetObjectLongValue(ljJavaObject_t* objectInterface);
 float javaGetObjectFloatValue(ljJavaObject_t* objectInterface);
 double javaGetObjectDoubleValue(ljJavaObject_t* objectInterface);
 const char* javaGetObjectStringValue(ljJavaObject_t* objectInterface);
+int javaGetObjectValue(ljJavaObject_t* objectInterface, ljJavaResult_t* result);
 void javaReleaseStringValue(ljJavaObject_t* objectInterface, const char* stringValue);
+int javaGetStringValue(ljJavaObject_t* objectInterface, void* buffer, int capacity, int utf16);
+void javaSetConstantFolding(void* ljEnv, int enabled);
+int javaBindMethod(ljJavaMethod_t* methodInterface, ljJavaClass_t* classInterface, const char* methodName, const char* signature);
+void javaReleaseMethod(ljJavaMethod_t* methodInterface);
+void javaCallVoidMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args);
+int javaCallIntMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args);
+long long javaCallLongMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args);
+double javaCallDoubleMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args);
+ljJavaObject_t* javaCallObjectMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args);
+int javaCallMethodR(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args, ljJavaResult_t* result);
+int javaPushScope(void* ljEnv, int capacity);
+void javaPopScope(void* ljEnv);
+void javaEscapeObject(ljJavaObject_t* objectInterface);
+void javaGetStats(void* ljEnv, ljJavaStats_t* stats);
+int javaGetMethodStats(void* ljEnv, ljJavaMethodStats_t* stats, int capacity);
+void javaSetStatsEnabled(void* ljEnv, int enabled);
+void javaSetMethodStatsEnabled(void* ljEnv, int enabled);
+void javaDeferReleaseObject(ljJavaObject_t* objectInterface);
+void javaDeferReleaseClass(ljJavaClass_t* classInterface);
+void javaFlushReleases(void* ljEnv);
+void javaSetReleaseThreshold(void* ljEnv, int threshold);
+int javaRunClassMethodAsync(ljJavaFuture_t* future, ljJavaClass_t* classInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args);
+int javaRunObjectMethodAsync(ljJavaFuture_t* future, ljJavaObject_t* objectInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args);
+int javaPollFuture(ljJavaFuture_t* future);
+int javaWaitFuture(ljJavaFuture_t* future, int timeoutMs);
+long long javaCurrentTimeMs(void);
+int javaGetFutureFd(ljJavaFuture_t* future);
+int javaGetFutureResult(ljJavaFuture_t* future, ljJavaResult_t* result);
+void javaReleaseFuture(ljJavaFuture_t* future);
+int javaRunBatch(void* ljEnv, int nCalls, ljJavaBatchCall_t* calls);
+int javaNewArray(ljJavaObject_t* objectInterface, int elementType, int length);
+int javaGetArrayType(ljJavaObject_t* objectInterface);
+int javaGetArrayLength(ljJavaObject_t* objectInterface);
+int javaPinArray(ljJavaArray_t* arrayInterface, ljJavaObject_t* objectInterface, int critical);
+void javaUnpinArray(ljJavaArray_t* arrayInterface, int commit);
+int javaGetArrayRegion(ljJavaObject_t* objectInterface, int start, int length, void* buffer);
+int javaSetArrayRegion(ljJavaObject_t* objectInterface, int start, int length, const void* buffer);
+int javaNewDirectBuffer(ljJavaObject_t* objectInterface, void* address, long long capacity);
+void* javaGetDirectBufferAddress(ljJavaObject_t* objectInterface);
+long long javaGetDirectBufferCapacity(ljJavaObject_t* objectInterface);
 
 int isNull(void* ptr);
 ]]
 
 --load the luajitjava bindings C library
-local luajitjava_bindings = ffi.load(current_dir .. LUAJITJAVA_DLL)
+local luajitjava_bindings = ffi.load(current_dir .. LUAJITJAVA_LIB)
 
 --give access to arg types
 luajitjava.JTYPE_NONE = luajitjava_bindings.JTYPE_NONE
@@ -76,13 +247,43 @@ luajitjava.JTYPE_OBJECT = luajitjava_bindings.JTYPE_OBJECT
 
 
 --this method start the java virtual machine and load the luajitjava bindings java proxy library
--- and store the java environment in a global variable
+-- and store the java environment in a global variable.
+-- With use_dispatcher, the JVM runs in its own thread and every call is queued to it,
+-- for hosts whose threads cannot be attached to the JVM. Scopes are then not available.
+-- options is an optional table of JVM options, such as { "-Xmx512m", "-XX:TieredStopAtLevel=1" },
+-- its shared_archive field naming an AppCDS archive file: the first run creates it when the JVM ends,
+-- later runs map the classes it holds instead of loading them, which shortens startup
+-- A JVM already running in the process, such as the one of a java application that loaded the library,
+-- is reused instead: class path and options are then ignored. Every module or lua state calling java_init
+-- shares the same java environment, which is only released by the last java_end
 local lj_env = nil
-function luajitjava.java_init(class_path)
+local dispatching = false
+--classes bound from their name by new_java_object, new_many and bind_method, kept until java_end
+local bound_classes = {}
+function luajitjava.java_init(class_path, use_dispatcher, options)
   if lj_env then
     return
   end
-  lj_env = luajitjava_bindings.javaStart(string.format("%s;%s%s", class_path, current_dir, LUAJITJAVA_JAR))
+  local full_class_path = string.format("%s%s%s%s", class_path, CLASS_PATH_SEPARATOR, current_dir, LUAJITJAVA_JAR)
+  if options then
+    local n_options = #options
+    local jvm_options = ffi.new("const char*[?]", math.max(n_options, 1))
+    for i = 1, n_options do
+      jvm_options[i - 1] = options[i]
+    end
+    lj_env = luajitjava_bindings.javaStartEx(full_class_path, n_options, jvm_options,
+      options.shared_archive, use_dispatcher and 1 or 0)
+  elseif use_dispatcher then
+    lj_env = luajitjava_bindings.javaStartDispatcher(full_class_path)
+  else
+    lj_env = luajitjava_bindings.javaStart(full_class_path)
+  end
+  dispatching = use_dispatcher and lj_env ~= nil or false
+end
+
+--java environment of this module, nil until java_init
+function luajitjava.java_env()
+  return lj_env
 end
 
 function luajitjava.java_end()
@@ -91,69 +292,315 @@ function luajitjava.java_end()
   end
   luajitjava_bindings.javaEnd(lj_env)
   lj_env = nil
+  dispatching = false
+  bound_classes = {}
+end
+
+--static final primitive and string fields are cached after their first read,
+-- this can be turned off for classes whose constants are changed through reflection
+function luajitjava.set_constant_folding(enabled)
+  if not lj_env then
+    return
+  end
+  luajitjava_bindings.javaSetConstantFolding(lj_env, enabled and 1 or 0)
+end
+
+--fields and method results are given as lua values, primitives as numbers or booleans and strings as lua strings.
+-- Scripts written for object handles, reading values through __value, can have handles back for every
+-- field and method result with set_boxed_results(true), at the cost of a java object per value
+local boxed_results = false
+function luajitjava.set_boxed_results(enabled)
+  boxed_results = enabled and true or false
+end
+
+--arg types as locals, so that traces compare them to constants
+local JTYPE_BYTE = luajitjava_bindings.JTYPE_BYTE
+local JTYPE_SHORT = luajitjava_bindings.JTYPE_SHORT
+local JTYPE_INT = luajitjava_bindings.JTYPE_INT
+local JTYPE_LONG = luajitjava_bindings.JTYPE_LONG
+local JTYPE_FLOAT = luajitjava_bindings.JTYPE_FLOAT
+local JTYPE_DOUBLE = luajitjava_bindings.JTYPE_DOUBLE
+local JTYPE_BOOLEAN = luajitjava_bindings.JTYPE_BOOLEAN
+local JTYPE_CHAR = luajitjava_bindings.JTYPE_CHAR
+local JTYPE_STRING = luajitjava_bindings.JTYPE_STRING
+local JTYPE_OBJECT = luajitjava_bindings.JTYPE_OBJECT
+
+--preallocated buffers for call arguments and results, reused by every call
+-- so that calling a java method does not allocate anything on the lua side
+local MAX_ARGS = 32
+local arg_types = ffi.new("javaArgType_t[?]", MAX_ARGS)
+local arg_values = ffi.new("ljJavaValue_t[?]", MAX_ARGS)
+local call_result = ffi.new("ljJavaResult_t")
+local field_result = ffi.new("ljJavaResult_t")
+
+--utility func to store one [type, value] param at index i of argument buffers
+local function set_value(types, values, i, arg_type, value)
+  types[i] = arg_type
+  if arg_type == JTYPE_INT then
+    values[i].i = value
+  elseif arg_type == JTYPE_DOUBLE then
+    values[i].d = value
+  elseif arg_type == JTYPE_STRING then
+    --lua strings are given with their length so that they can hold NUL characters,
+    -- other values are NUL terminated C strings
+    local chars = values[i].chars
+    chars.data = value
+    chars.length = type(value) == "string" and #value or -1
+    chars.utf16 = 0
+  elseif arg_type == JTYPE_OBJECT then
+    values[i].object = value
+  elseif arg_type == JTYPE_LONG then
+    values[i].j = value
+  elseif arg_type == JTYPE_FLOAT then
+    values[i].f = value
+  elseif arg_type == JTYPE_BOOLEAN then
+    values[i].z = (value and value ~= 0) and 1 or 0
+  elseif arg_type == JTYPE_BYTE then
+    values[i].b = value
+  elseif arg_type == JTYPE_SHORT then
+    values[i].s = value
+  elseif arg_type == JTYPE_CHAR then
+    values[i].c = type(value) == "string" and value:byte() or value
+  else
+    return false
+  end
+  return true
 end
 
---utility func to prepare params from varargs
-local function prepare_params(arg_table)
-  if #arg_table % 2 ~= 0 then
+--utility func to store one [type, value] param in the argument buffers
+local function set_arg(i, arg_type, value)
+  return set_value(arg_types, arg_values, i, arg_type, value)
+end
+
+--utility func to fill the argument buffers from [type, value] varargs
+-- the first eight params are handled with fixed arity so that calls stay compiled,
+-- longer lists take a slower path through a table
+local function fill_args(n, t1, v1, t2, v2, t3, v3, t4, v4, t5, v5, t6, v6, t7, v7, t8, v8, ...)
+  if n % 2 ~= 0 then
     print("java params error : should be pairs [type, value], got an odd number of params")
+    return nil
+  end
+  n = n / 2
+  if n > MAX_ARGS then
+    print("java params error : too many params")
+    return nil
+  end
+  local ok = true
+  if n >= 1 then ok = set_arg(0, t1, v1) and ok end
+  if n >= 2 then ok = set_arg(1, t2, v2) and ok end
+  if n >= 3 then ok = set_arg(2, t3, v3) and ok end
+  if n >= 4 then ok = set_arg(3, t4, v4) and ok end
+  if n >= 5 then ok = set_arg(4, t5, v5) and ok end
+  if n >= 6 then ok = set_arg(5, t6, v6) and ok end
+  if n >= 7 then ok = set_arg(6, t7, v7) and ok end
+  if n >= 8 then ok = set_arg(7, t8, v8) and ok end
+  if n > 8 then
+    local rest = {...}
+    for i = 9, n do
+      ok = set_arg(i - 1, rest[2 * i - 17], rest[2 * i - 16]) and ok
+    end
+  end
+  if not ok then
+    print("java params: use of an unknown java type")
+    return nil
+  end
+  return n
+end
+
+--number of critical array pins held, no java call may be made until the last one is released,
+-- so that finalizers which cannot be queued by the C library are held back until then
+local critical_pins = 0
+local held_finalizers = {}
+local function hold_finalizer(finalizer, self)
+  if critical_pins == 0 then
+    return false
+  end
+  held_finalizers[#held_finalizers + 1] = finalizer
+  held_finalizers[#held_finalizers + 1] = self
+  return true
+end
+local function run_held_finalizers()
+  local held = held_finalizers
+  held_finalizers = {}
+  for i = 1, #held, 2 do
+    held[i](held[i + 1])
+  end
+end
+
+--finalizers of java handles, they only queue the java references to release
+-- so that collected handles are released in batches by the C library
+local function object_finalizer(self)
+  if lj_env then
+    luajitjava_bindings.javaDeferReleaseObject(self)
+  end
+end
+local function class_finalizer(self)
+  if lj_env then
+    luajitjava_bindings.javaDeferReleaseClass(self)
+  end
+end
+local function method_finalizer(self)
+  if lj_env and not hold_finalizer(method_finalizer, self) then
+    luajitjava_bindings.javaReleaseMethod(self)
+  end
+end
+
+--depth of luajitjava.scope calls, objects created in a scope are freed with it and get no finalizer
+local scope_depth = 0
+
+--utility func to have an object handle given by the C library released once collected
+local function managed_object(java_object)
+  if scope_depth == 0 then
+    return ffi.gc(java_object, object_finalizer)
+  end
+  return java_object
+end
+
+--utility func to get the lua value of a typed call result
+-- primitives and strings are returned as lua values, other objects as object handles
+local function result_value(result)
+  local result_type = result.type
+  if result_type == JTYPE_INT then
+    return result.value.i
+  elseif result_type == JTYPE_DOUBLE then
+    return result.value.d
+  elseif result_type == JTYPE_STRING then
+    return ffi.string(result.value.string, result.length)
+  elseif result_type == JTYPE_OBJECT then
+    return managed_object(result.value.object)
+  elseif result_type == JTYPE_BOOLEAN then
+    return result.value.z ~= 0
+  elseif result_type == JTYPE_LONG then
+    --kept as a 64bits cdata number, lua numbers cannot hold all java longs
+    return result.value.j
+  elseif result_type == JTYPE_FLOAT then
+    return result.value.f
+  elseif result_type == JTYPE_BYTE then
+    return result.value.b
+  elseif result_type == JTYPE_SHORT then
+    return result.value.s
+  elseif result_type == JTYPE_CHAR then
+    return result.value.c
+  end
+  return nil
+end
+
+--run a method on a java class or object, with [type, value] params
+local function run_method(self, method_name, ...)
+  local n = fill_args(select('#', ...), ...)
+  if not n then
+    print("java_object : invalid method params")
     return
   end
-  local result = {}
-  local cur_type = luajitjava_bindings.JTYPE_NONE
-  for i,v in ipairs(arg_table) do
-    if cur_type == luajitjava_bindings.JTYPE_NONE then
-      cur_type = v
-      table.insert(result, ffi.new("int", cur_type))
-    else
-      local value
-      if cur_type == luajitjava_bindings.JTYPE_BYTE then
-        value = ffi.new("char", v)
-      elseif cur_type == luajitjava_bindings.JTYPE_SHORT then
-        value = ffi.new("short", v)
-      elseif cur_type == luajitjava_bindings.JTYPE_INT then
-        value = ffi.new("int", v)
-      elseif cur_type == luajitjava_bindings.JTYPE_LONG then
-        value = ffi.new("long", v)
-      elseif cur_type == luajitjava_bindings.JTYPE_FLOAT then
-        value = ffi.new("float", v)
-      elseif cur_type == luajitjava_bindings.JTYPE_DOUBLE then
-        value = ffi.new("double", v)
-      elseif cur_type == luajitjava_bindings.JTYPE_BOOLEAN then
-        value = ffi.new("char", v)
-      elseif cur_type == luajitjava_bindings.JTYPE_CHAR then
-        value = ffi.new("char", v)
-      elseif cur_type == luajitjava_bindings.JTYPE_STRING then
-        value = v
-      elseif cur_type == luajitjava_bindings.JTYPE_OBJECT then
-        value = v
-      else
-        print("java params: use of an unknown java type")
-      end
-      table.insert(result, value)
-      cur_type = luajitjava_bindings.JTYPE_NONE
+  if boxed_results then
+    local result_object
+    if ffi.istype(JavaObjectType, self) then
+      result_object = luajitjava_bindings.javaRunObjectMethodA(self, method_name, n, arg_types, arg_values)
+    elseif ffi.istype(JavaClassType, self) then
+      result_object = luajitjava_bindings.javaRunClassMethodA(self, method_name, n, arg_types, arg_values)
+    end
+    if result_object and luajitjava_bindings.isNull(result_object) == 0 then
+      return managed_object(result_object)
     end
+    return
+  end
+  local ok
+  if ffi.istype(JavaObjectType, self) then
+    ok = luajitjava_bindings.javaRunObjectMethodR(self, method_name, n, arg_types, arg_values, call_result)
+  elseif ffi.istype(JavaClassType, self) then
+    ok = luajitjava_bindings.javaRunClassMethodR(self, method_name, n, arg_types, arg_values, call_result)
+  end
+  if ok ~= 0 then
+    return result_value(call_result)
   end
-  return result
 end
 
---utility func to pack params from varargs, using previous func as first step
-local function pack_lib_args(other_args ,lua_arg_table)
-  local params = prepare_params(lua_arg_table)
-  if not params then
-    return nil
+--callable proxies returned for method names, one per name and shared by all classes and objects
+-- the receiver is the first param, as given by the obj:method(...) syntax
+local method_proxies = {}
+local method_proxy_mt = {
+  __call = function(proxy, self, ...)
+    return run_method(self, proxy.name, ...)
+  end,
+}
+local function get_method_proxy(key)
+  local proxy = method_proxies[key]
+  if not proxy then
+    proxy = setmetatable({ name = key }, method_proxy_mt)
+    method_proxies[key] = proxy
+  end
+  return proxy
+end
+
+--utility func to fill the argument buffer of a bound method, types being given by its signature
+local function fill_bound_args(method, n, v1, v2, v3, v4, v5, v6, v7, v8, ...)
+  if n ~= method.nArgs then
+    print("java bound method error : expected " .. method.nArgs .. " params, got " .. n)
+    return false
+  end
+  local bound_types = method.argTypes
+  if n >= 1 then set_arg(0, bound_types[0], v1) end
+  if n >= 2 then set_arg(1, bound_types[1], v2) end
+  if n >= 3 then set_arg(2, bound_types[2], v3) end
+  if n >= 4 then set_arg(3, bound_types[3], v4) end
+  if n >= 5 then set_arg(4, bound_types[4], v5) end
+  if n >= 6 then set_arg(5, bound_types[5], v6) end
+  if n >= 7 then set_arg(6, bound_types[6], v7) end
+  if n >= 8 then set_arg(7, bound_types[7], v8) end
+  if n > 8 then
+    local rest = {...}
+    for i = 9, n do
+      set_arg(i - 1, bound_types[i - 1], rest[i - 8])
+    end
   end
-  local lib_args = {}
-  for i, param in ipairs(other_args) do
-    table.insert(lib_args, param)
+  return true
+end
+
+--call a bound method, going straight to the C entry point matching its return type
+local function call_bound_method(method, object, ...)
+  if not fill_bound_args(method, select('#', ...), ...) then
+    return
+  end
+  local return_type = method.returnType
+  if return_type == JTYPE_DOUBLE or return_type == JTYPE_FLOAT then
+    return luajitjava_bindings.javaCallDoubleMethod(method, object, arg_values)
+  elseif return_type == JTYPE_INT or return_type == JTYPE_SHORT or return_type == JTYPE_BYTE or return_type == JTYPE_CHAR then
+    return luajitjava_bindings.javaCallIntMethod(method, object, arg_values)
+  elseif return_type == JTYPE_BOOLEAN then
+    return luajitjava_bindings.javaCallIntMethod(method, object, arg_values) ~= 0
+  elseif return_type == JTYPE_LONG then
+    return luajitjava_bindings.javaCallLongMethod(method, object, arg_values)
+  elseif return_type == JTYPE_NONE then
+    luajitjava_bindings.javaCallVoidMethod(method, object, arg_values)
+    return
+  elseif return_type == JTYPE_STRING then
+    if luajitjava_bindings.javaCallMethodR(method, object, arg_values, call_result) ~= 0 then
+      return result_value(call_result)
+    end
+    return
   end
-  table.insert(lib_args, #params)
-  for i, param in ipairs(params) do
-    table.insert(lib_args, param)
+  local result_object = luajitjava_bindings.javaCallObjectMethod(method, object, arg_values)
+  if luajitjava_bindings.isNull(result_object) == 0 then
+    return managed_object(result_object)
   end
-  return lib_args
 end
 
+--bound methods are called directly, instance methods taking their object as first param
+JavaMethodType = ffi.metatype("ljJavaMethod_t", {
+  __call = function(method, ...)
+    if method.isStatic ~= 0 then
+      return call_bound_method(method, nil, ...)
+    end
+    return call_bound_method(method, ...)
+  end,
+  __index = {
+    __release = function(method)
+      ffi.gc(method, nil)
+      luajitjava_bindings.javaReleaseMethod(method)
+    end,
+  },
+})
+
 --predeclarations of functions
 local javaIndex
 local javaValue
@@ -161,6 +608,7 @@ local javaValue
 --garbage collector function, to release java object or class
 local function javaRelease(self)
 --  print("releasing", self)
+  ffi.gc(self, nil)
   if ffi.istype(JavaObjectType, self) then
     luajitjava_bindings.javaReleaseObject(self)
   elseif ffi.istype(JavaClassType, self) then
@@ -168,6 +616,12 @@ local function javaRelease(self)
   end
 end
 
+--release function given by __release, built apart so that the index callback
+-- does not capture anything and stays compiled
+local function release_function(self)
+  return function() javaRelease(self) end
+end
+
 --get lua types to instanciate c objects and add metatable for direct calls to parameters or methods
 local metatable = {
   __index = function(self, key)
@@ -189,46 +643,45 @@ javaIndex = function(self, key)
   end
   --redirect call to __release
   if key == "__release" then
-    return function() javaRelease(self) end
+    return release_function(self)
+  end
+  --redirect call to __bind_method, for classes only
+  if key == "__bind_method" and ffi.istype(JavaClassType, self) then
+    return luajitjava.bind_method
   end
   
-  local field
+  if boxed_results then
+    local field
+    if ffi.istype(JavaObjectType, self) then
+      field = luajitjava_bindings.javaCheckObjectField(self, key)
+    elseif ffi.istype(JavaClassType, self) then
+      field = luajitjava_bindings.javaCheckClassField(self, key)
+    end
+    if field and luajitjava_bindings.isNull(field) == 0 then
+      return managed_object(field)
+    end
+    return get_method_proxy(key)
+  end
+
+  --fields are read as lua values, as method results are
+  local is_field = 0
   if ffi.istype(JavaObjectType, self) then
-    field = luajitjava_bindings.javaCheckObjectField(self, key)
+    is_field = luajitjava_bindings.javaCheckObjectFieldR(self, key, field_result)
   elseif ffi.istype(JavaClassType, self) then
-    field = luajitjava_bindings.javaCheckClassField(self, key)
+    is_field = luajitjava_bindings.javaCheckClassFieldR(self, key, field_result)
   end
-  if field and luajitjava_bindings.isNull(field) == 0 then
---    print("created class/object field", field)
-    return field
-  else
-    --not a field, consider it is a method
-    local proxy_func = function(foo, ...)
-      local lib_args = pack_lib_args({self, key}, {...})
-      if not lib_args then
-        print("java_object : invalid method params")
-        return
-      end
-      local result_object
-      if ffi.istype(JavaObjectType, self) then
-        result_object = luajitjava_bindings.javaRunObjectMethod(unpack(lib_args))
-      elseif ffi.istype(JavaClassType, self) then
-        result_object = luajitjava_bindings.javaRunClassMethod(unpack(lib_args))
-      end
-      if luajitjava_bindings.isNull(result_object) == 0 then
---        print("created class method result", result_object)
-        return result_object
-      end
-    end
-    --end of method
-    return proxy_func
+  if is_field ~= 0 then
+    return result_value(field_result)
   end
+  --not a field, consider it is a method
+  return get_method_proxy(key)
 end
 
 
 --get value of a java object as a lua value, only works on type objects
+-- the object is classified and unboxed in a single call
+local object_value = ffi.new("ljJavaResult_t")
 javaValue = function(self)
-  local return_value = nil
   if not lj_env then
     return
   end
@@ -236,82 +689,678 @@ javaValue = function(self)
     print("java value: java element doesn't seem to be an object")
     return
   end
-  local type = luajitjava_bindings.javaGetObjectType(self)
-  if type == luajitjava_bindings.JTYPE_BYTE then
-    return_value = luajitjava_bindings.javaGetObjectIntValue(self)
-  elseif type == luajitjava_bindings.JTYPE_SHORT then
-    return_value = luajitjava_bindings.javaGetObjectIntValue(self)
-  elseif type == luajitjava_bindings.JTYPE_INT then
-    return_value = luajitjava_bindings.javaGetObjectIntValue(self)
-  elseif type == luajitjava_bindings.JTYPE_LONG then
+  if luajitjava_bindings.javaGetObjectValue(self, object_value) == 0 then
+    return nil
+  end
+  local type = object_value.type
+  if type == JTYPE_INT then
+    return object_value.value.i
+  elseif type == JTYPE_DOUBLE then
+    return object_value.value.d
+  elseif type == JTYPE_STRING then
+    return ffi.string(object_value.value.string, object_value.length)
+  elseif type == JTYPE_BOOLEAN then
+    return object_value.value.z
+  elseif type == JTYPE_FLOAT then
+    return object_value.value.f
+  elseif type == JTYPE_BYTE then
+    return object_value.value.b
+  elseif type == JTYPE_SHORT then
+    return object_value.value.s
+  elseif type == JTYPE_CHAR then
+    return object_value.value.c
+  elseif type == JTYPE_LONG then
     --lua cannot handle 64bits data, this would return a cdata object
-    --return luajitjava_bindings.javaGetObjectLongValue(self)
     return nil
-  elseif type == luajitjava_bindings.JTYPE_FLOAT then
-    return_value = luajitjava_bindings.javaGetObjectFloatValue(self)
-  elseif type == luajitjava_bindings.JTYPE_DOUBLE then
-    return_value = luajitjava_bindings.javaGetObjectDoubleValue(self)
-  elseif type == luajitjava_bindings.JTYPE_BOOLEAN then
-    return_value = luajitjava_bindings.javaGetObjectIntValue(self)
-  elseif type == luajitjava_bindings.JTYPE_CHAR then
-    return_value = luajitjava_bindings.javaGetObjectIntValue(self)
-  elseif type == luajitjava_bindings.JTYPE_STRING then
-    local jstring_value = luajitjava_bindings.javaGetObjectStringValue(self)
-    return_value = ffi.string(jstring_value)
-    luajitjava_bindings.javaReleaseStringValue(self, jstring_value)
-  elseif type == luajitjava_bindings.JTYPE_OBJECT then
+  elseif type == JTYPE_OBJECT then
     --the object is not a type object
     print("java value: trying to get the value of an object that is not a type value")
-    return nil
-  else
-    print("java value: use of an unknown java type")
-    return nil
   end
---  print("created object value", return_value)
-  return return_value
+  return nil
 end
 
 
+--buffer java strings are copied to before becoming lua strings, grown as needed
+local string_buffer_size = 256
+local string_buffer = ffi.new("char[?]", string_buffer_size)
+
+--get the value of a java string handle as a lua string, with a single copy out of java
+function luajitjava.string_value(java_string)
+  if not lj_env then
+    return
+  end
+  local length = luajitjava_bindings.javaGetStringValue(java_string, string_buffer, string_buffer_size, 0)
+  if length >= string_buffer_size then
+    string_buffer_size = length + 1
+    string_buffer = ffi.new("char[?]", string_buffer_size)
+    length = luajitjava_bindings.javaGetStringValue(java_string, string_buffer, string_buffer_size, 0)
+  end
+  if length >= 0 then
+    return ffi.string(string_buffer, length)
+  end
+end
+
+--get the utf-16 units of a java string handle as a new uint16_t array and its length,
+-- for large texts that do not need to become lua strings
+function luajitjava.string_chars(java_string)
+  if not lj_env then
+    return
+  end
+  local length = luajitjava_bindings.javaGetStringValue(java_string, nil, 0, 1)
+  if length < 0 then
+    return
+  end
+  local units = ffi.new("uint16_t[?]", math.max(length, 1))
+  luajitjava_bindings.javaGetStringValue(java_string, units, length, 1)
+  return units, length
+end
+
+--bind a class by name, classes are looked up by the C library the first time only
+-- and every handle of a same class shares its reference and its cached methods and fields
 function luajitjava.get_java_class(class_name)
   if not lj_env then
     return
   end
   local new_class = JavaClassType(lj_env)
   if (luajitjava_bindings.javaBindClass(new_class, class_name) ~= 0) then
-    return new_class
+    return ffi.gc(new_class, class_finalizer)
   else
     return nil
   end
 end
 
 
+--class handle of a class given by name, bound once and then shared
+local function named_class(java_class)
+  if type(java_class) == "string" then
+    local class_name = java_class
+    java_class = bound_classes[class_name]
+    if not java_class then
+      java_class = luajitjava.get_java_class(class_name)
+      bound_classes[class_name] = java_class
+    end
+    return java_class
+  elseif type(java_class) == "cdata" then
+    return java_class
+  end
+  -- not a class binding struct
+end
+
 function luajitjava.new_java_object(java_class, ...)
   if not lj_env then
     return
   end
-  local release_class = false
-  if type(java_class) == "string" then
-    java_class = luajitjava.get_java_class(java_class)
-    release_class = true
-  elseif type(java_class) ~= "cdata" then
-    -- not a class binding struct
+  java_class = named_class(java_class)
+  if not java_class then
     return
   end
   local new_object = JavaObjectType(lj_env)
-  local lib_args = pack_lib_args({new_object, java_class}, {...})
-  if not lib_args then
+  local n = fill_args(select('#', ...), ...)
+  if not n then
     print("new_java_object : invalid constructor params")
-    if release_class then
-      javaRelease(java_class)
+    return
+  end
+  if luajitjava_bindings.javaNewA(new_object, java_class, n, arg_types, arg_values) ~= 0 then
+    return ffi.gc(new_object, object_finalizer)
+  end
+end
+
+local function objects_finalizer(count)
+  return function(objects)
+    if lj_env then
+      for i = 0, count - 1 do
+        if objects[i].object ~= nil then
+          luajitjava_bindings.javaDeferReleaseObject(objects[i])
+        end
+      end
     end
+  end
+end
+
+--create n objects of a class in a single call, from columns of constructor arguments:
+-- new_many(class, n, type1, values1, type2, values2, ...) where values are lua tables indexed from 1 to n.
+-- Returns an array of n object handles, indexed from 0 and valid as long as the array is referenced,
+-- with a nil object for those that failed,
+-- and the number of objects created
+function luajitjava.new_many(java_class, n, ...)
+  if not lj_env then
     return
   end
-  if (luajitjava_bindings.javaNew(unpack(lib_args)) ~= 0) then
-    if release_class then
-      javaRelease(java_class)
+  java_class = named_class(java_class)
+  if not java_class or n <= 0 then
+    return
+  end
+  local n_args = math.floor(select('#', ...) / 2)
+  if n_args > MAX_ARGS then
+    print("new_many : too many constructor params")
+    return
+  end
+  local types = ffi.new("javaArgType_t[?]", math.max(n * n_args, 1))
+  local values = ffi.new("ljJavaValue_t[?]", math.max(n * n_args, 1))
+  for a = 1, n_args do
+    local arg_type, column = select(2 * a - 1, ...)
+    for i = 0, n - 1 do
+      if not set_value(types, values, i * n_args + a - 1, arg_type, column[i + 1]) then
+        print("new_many : invalid constructor params")
+        return
+      end
     end
-    return new_object
   end
+  local objects = ffi.new("ljJavaObject_t[?]", n)
+  local created = luajitjava_bindings.javaNewMany(objects, java_class, n, n_args, types, values)
+  return ffi.gc(objects, objects_finalizer(n)), created
+end
+
+--bind a method of a class from its name and jni signature, such as "(IJD)D"
+-- the returned method is called as method(object, ...) or method(...) for static methods
+-- and dispatches directly to the jni call matching its return type, without overload resolution
+function luajitjava.bind_method(java_class, method_name, signature)
+  if not lj_env then
+    return
+  end
+  java_class = named_class(java_class)
+  if not java_class then
+    return
+  end
+  local new_method = JavaMethodType(lj_env)
+  if luajitjava_bindings.javaBindMethod(new_method, java_class, method_name, signature) ~= 0 then
+    return ffi.gc(new_method, method_finalizer)
+  end
+end
+
+--close the scope opened by luajitjava.scope, then give back the results of its function.
+-- Scopes are stacked per thread by the C library, so that the body cannot yield
+-- and let other coroutines create objects into a scope they do not belong to
+local function close_scope(body, ok, ...)
+  scope_depth = scope_depth - 1
+  luajitjava_bindings.javaPopScope(lj_env)
+  if not ok then
+    error((...), 0)
+  end
+  if coroutine.status(body) ~= "dead" then
+    error("java scope : cannot yield inside a scope", 0)
+  end
+  return ...
+end
+
+--run fn in a scope: java objects returned by calls and field reads inside it are local references,
+-- all freed at once when fn returns. Objects needed after the scope must go through luajitjava.escape,
+-- the others are no longer valid once the scope is closed. fn runs in a coroutine of its own
+-- so that a yield closes the scope with an error, instead of suspending it
+function luajitjava.scope(fn, ...)
+  if not lj_env then
+    return
+  end
+  if dispatching then
+    --objects are global references anyway, run fn as is
+    return fn(...)
+  end
+  if luajitjava_bindings.javaPushScope(lj_env, 0) == 0 then
+    return
+  end
+  scope_depth = scope_depth + 1
+  local body = coroutine.create(fn)
+  return close_scope(body, coroutine.resume(body, ...))
+end
+
+--keep an object created in a scope valid after the scope is closed
+-- it is then released once collected, like any other object
+function luajitjava.escape(java_object)
+  if lj_env and ffi.istype(JavaObjectType, java_object) then
+    luajitjava_bindings.javaEscapeObject(java_object)
+    ffi.gc(java_object, object_finalizer)
+  end
+  return java_object
+end
+
+--release now the java references of all collected handles,
+-- they are otherwise released in batches once enough of them are queued
+function luajitjava.flush_releases()
+  if lj_env then
+    luajitjava_bindings.javaFlushReleases(lj_env)
+  end
+end
+
+--set how many collected handles are queued before their java references are released
+function luajitjava.set_release_threshold(threshold)
+  if lj_env then
+    luajitjava_bindings.javaSetReleaseThreshold(lj_env, threshold)
+  end
+end
+
+--names of the operations timed by the statistics, in javaStatsOp_t order
+local STATS_OPS = { "bind_class", "new", "new_many", "field", "method", "bound_method", "value", "batch", "async", "array" }
+
+--upper bound in nanoseconds of a latency histogram bucket: under 8ns each bucket holds a single value,
+-- then every power of two is split into 4 buckets
+local function bucket_upper_ns(bucket)
+  if bucket < 8 then
+    return bucket
+  end
+  local magnitude = math.floor(bucket / 4) + 1
+  return (5 + bucket % 4) * 2 ^ (magnitude - 2) - 1
+end
+
+--latency percentile from a histogram, as the upper bound of the bucket holding it
+local function latency_percentile(latency, calls, percent)
+  local rank = math.ceil(calls * percent / 100)
+  local seen = 0
+  for bucket = 0, 127 do
+    seen = seen + tonumber(latency.buckets[bucket])
+    if seen >= rank then
+      return math.min(bucket_upper_ns(bucket), tonumber(latency.maxNs))
+    end
+  end
+  return tonumber(latency.maxNs)
+end
+
+--call counts and latencies as a table, the histogram listing the non empty buckets
+local function latency_table(latency)
+  local calls = tonumber(latency.calls)
+  local result = {
+    calls = calls,
+    errors = tonumber(latency.errors),
+    total_ns = tonumber(latency.totalNs),
+    max_ns = tonumber(latency.maxNs),
+    histogram = {},
+  }
+  if calls > 0 then
+    result.mean_ns = result.total_ns / calls
+    result.p50_ns = latency_percentile(latency, calls, 50)
+    result.p90_ns = latency_percentile(latency, calls, 90)
+    result.p99_ns = latency_percentile(latency, calls, 99)
+  end
+  for bucket = 0, 127 do
+    local count = tonumber(latency.buckets[bucket])
+    if count > 0 then
+      table.insert(result.histogram, { upper_ns = bucket_upper_ns(bucket), count = count })
+    end
+  end
+  return result
+end
+
+--get usage statistics of the java environment, as a table.
+-- ops holds the call counts and latencies of each operation, methods those of each resolved method
+-- which are only counted once set_method_stats_enabled(true)
+function luajitjava.stats()
+  if not lj_env then
+    return
+  end
+  local stats = ffi.new("ljJavaStats_t")
+  luajitjava_bindings.javaGetStats(lj_env, stats)
+  local result = {
+    handles_in_use = stats.handlesInUse,
+    handles_free = stats.handlesFree,
+    handle_slabs = stats.handleSlabs,
+    pending_releases = stats.pendingReleases,
+    object_refs = stats.objectRefs,
+    registered_classes = stats.registeredClasses,
+    class_handles = stats.classHandles,
+    cached_methods = stats.cachedMethods,
+    cached_fields = stats.cachedFields,
+    enabled = stats.enabled ~= 0,
+    methods_enabled = stats.methodsEnabled ~= 0,
+    ops = {},
+    methods = {},
+  }
+  for op, name in ipairs(STATS_OPS) do
+    result.ops[name] = latency_table(stats.ops[op - 1])
+  end
+
+  --methods may be resolved between both calls, only those fitting are listed
+  local n_methods = luajitjava_bindings.javaGetMethodStats(lj_env, nil, 0)
+  if n_methods > 0 then
+    local methods = ffi.new("ljJavaMethodStats_t[?]", n_methods)
+    n_methods = math.min(luajitjava_bindings.javaGetMethodStats(lj_env, methods, n_methods), n_methods)
+    for i = 0, n_methods - 1 do
+      local method = latency_table(methods[i].latency)
+      method.class = ffi.string(methods[i].className)
+      method.name = ffi.string(methods[i].name)
+      method.n_args = methods[i].nArgs
+      method.direct = methods[i].direct ~= 0
+      table.insert(result.methods, method)
+    end
+  end
+  return result
+end
+
+--turn the call counts and latencies of the statistics on or off, gauges are always kept
+function luajitjava.set_stats_enabled(enabled)
+  if lj_env then
+    luajitjava_bindings.javaSetStatsEnabled(lj_env, enabled and 1 or 0)
+  end
+end
+
+--turn the latencies of each resolved method on or off, off by default as they are shared by all threads
+-- calling a method; they are only kept while statistics are on
+function luajitjava.set_method_stats_enabled(enabled)
+  if lj_env then
+    luajitjava_bindings.javaSetMethodStatsEnabled(lj_env, enabled and 1 or 0)
+  end
+end
+
+--futures of asynchronous calls, released once collected
+local JFUTURE_PENDING = luajitjava_bindings.JFUTURE_PENDING
+local future_result = ffi.new("ljJavaResult_t")
+local function future_finalizer(self)
+  if lj_env and not hold_finalizer(future_finalizer, self) then
+    luajitjava_bindings.javaReleaseFuture(self)
+  end
+end
+JavaFutureType = ffi.metatype("ljJavaFuture_t", {
+  __index = {
+    --true once the call is over, without blocking
+    poll = function(future)
+      return luajitjava_bindings.javaPollFuture(future) ~= JFUTURE_PENDING
+    end,
+    --block until the call is over or timeout_ms have passed, true if it is over
+    wait = function(future, timeout_ms)
+      return luajitjava_bindings.javaWaitFuture(future, timeout_ms or -1) ~= JFUTURE_PENDING
+    end,
+    --fd that becomes readable once the call is over, nil where eventfd is not available
+    fd = function(future)
+      local fd = luajitjava_bindings.javaGetFutureFd(future)
+      if fd >= 0 then
+        return fd
+      end
+    end,
+    --result of the call once over, nil if it failed
+    result = function(future)
+      if luajitjava_bindings.javaGetFutureResult(future, future_result) ~= 0 then
+        return result_value(future_result)
+      end
+    end,
+    __release = function(future)
+      ffi.gc(future, nil)
+      luajitjava_bindings.javaReleaseFuture(future)
+    end,
+  },
+})
+
+--run a method of a java class or object on the java executor, with [type, value] params,
+-- and return a future right away instead of waiting for its result
+function luajitjava.async(java_target, method_name, ...)
+  if not lj_env then
+    return
+  end
+  local n = fill_args(select('#', ...), ...)
+  if not n then
+    print("java async : invalid method params")
+    return
+  end
+  local future = JavaFutureType(lj_env)
+  local ok = 0
+  if ffi.istype(JavaObjectType, java_target) then
+    ok = luajitjava_bindings.javaRunObjectMethodAsync(future, java_target, method_name, n, arg_types, arg_values)
+  elseif ffi.istype(JavaClassType, java_target) then
+    ok = luajitjava_bindings.javaRunClassMethodAsync(future, java_target, method_name, n, arg_types, arg_values)
+  end
+  if ok ~= 0 then
+    return ffi.gc(future, future_finalizer)
+  end
+end
+
+--get the result of a future once its call is over, nil once timeout_ms have passed.
+-- In a coroutine, the coroutine yields the future until the call is over, so that an event loop
+-- can resume it when future:fd() is readable or future:poll() is true, and keep many calls in flight;
+-- the timeout is then checked each time it is resumed.
+-- Elsewhere, or within a scope which cannot yield, it blocks for at most timeout_ms,
+-- or until the call is over without a timeout
+function luajitjava.await(future, timeout_ms)
+  local co, is_main = coroutine.running()
+  if co and not is_main and scope_depth == 0 then
+    local deadline = timeout_ms and timeout_ms >= 0 and luajitjava_bindings.javaCurrentTimeMs() + timeout_ms
+    while not future:poll() do
+      if deadline and luajitjava_bindings.javaCurrentTimeMs() >= deadline then
+        return nil
+      end
+      coroutine.yield(future)
+    end
+  elseif not future:wait(timeout_ms) then
+    return nil
+  end
+  return future:result()
+end
+
+--run several method calls and field reads with a single crossing into java.
+-- calls is a list of {target, method_name, [type, value]...} for method calls
+-- and of {target, field = field_name} for field reads, targets being java classes or objects.
+-- Returns the list of results, nil for failed calls, and the number of successful calls
+function luajitjava.batch(calls)
+  if not lj_env then
+    return
+  end
+  local n_calls = #calls
+  local n_values = 0
+  for i = 1, n_calls do
+    if not calls[i].field then
+      n_values = n_values + math.floor((#calls[i] - 2) / 2)
+    end
+  end
+  local batch = ffi.new("ljJavaBatchCall_t[?]", math.max(n_calls, 1))
+  local types = ffi.new("javaArgType_t[?]", math.max(n_values, 1))
+  local values = ffi.new("ljJavaValue_t[?]", math.max(n_values, 1))
+  local offset = 0
+  for i = 1, n_calls do
+    local call = calls[i]
+    local slot = batch[i - 1]
+    local target = call[1]
+    if ffi.istype(JavaClassType, target) then
+      slot.classReceiver = 1
+    elseif not ffi.istype(JavaObjectType, target) then
+      print("java batch : call " .. i .. " is not made on a java class or object")
+      return
+    end
+    slot.receiver = target
+    if call.field then
+      slot.isField = 1
+      slot.name = call.field
+    else
+      local n = (#call - 2) / 2
+      if n < 0 or n % 1 ~= 0 then
+        print("java batch : params of call " .. i .. " should be pairs [type, value]")
+        return
+      end
+      slot.name = call[2]
+      slot.nArgs = n
+      slot.argTypes = types + offset
+      slot.args = values + offset
+      for j = 0, n - 1 do
+        if not set_value(types, values, offset + j, call[3 + 2 * j], call[4 + 2 * j]) then
+          print("java batch : use of an unknown java type in call " .. i)
+          return
+        end
+      end
+      offset = offset + n
+    end
+  end
+  local n_done = luajitjava_bindings.javaRunBatch(lj_env, n_calls, batch)
+  local results = {}
+  for i = 1, n_calls do
+    if batch[i - 1].ok ~= 0 then
+      results[i] = result_value(batch[i - 1].result)
+    end
+  end
+  return results, n_done
+end
+
+--c types of the elements of primitive java arrays, by element type
+local array_element_types = {
+  [JTYPE_BYTE] = "int8_t",
+  [JTYPE_SHORT] = "int16_t",
+  [JTYPE_INT] = "int32_t",
+  [JTYPE_LONG] = "int64_t",
+  [JTYPE_FLOAT] = "float",
+  [JTYPE_DOUBLE] = "double",
+  [JTYPE_BOOLEAN] = "uint8_t",
+  [JTYPE_CHAR] = "uint16_t",
+}
+local array_pointer_types = {}
+local array_buffer_types = {}
+for element_type, c_type in pairs(array_element_types) do
+  array_pointer_types[element_type] = ffi.typeof(c_type .. "*")
+  array_buffer_types[element_type] = ffi.typeof(c_type .. "[?]")
+end
+
+--pins of primitive java arrays, unpinned with their changes once collected
+--unpin array elements, running the finalizers held back once the last critical pin is released
+local function release_pin(pinned, commit)
+  local critical = pinned.critical ~= 0 and pinned.elements ~= nil
+  luajitjava_bindings.javaUnpinArray(pinned, commit)
+  if critical then
+    critical_pins = critical_pins - 1
+    if critical_pins == 0 and #held_finalizers > 0 then
+      run_held_finalizers()
+    end
+  end
+end
+--critical pins may be released within other ones, other pins are held back meanwhile
+local function array_finalizer(self)
+  if lj_env and (self.critical ~= 0 or not hold_finalizer(array_finalizer, self)) then
+    release_pin(self, 1)
+  end
+end
+JavaArrayType = ffi.metatype("ljJavaArray_t", {
+  __len = function(pinned)
+    return pinned.length
+  end,
+  __index = {
+    --typed pointer to the pinned elements, indexed from 0
+    ptr = function(pinned)
+      return ffi.cast(array_pointer_types[tonumber(pinned.elementType)], pinned.elements)
+    end,
+    --unpin the elements, changes are dropped when commit is false
+    unpin = function(pinned, commit)
+      ffi.gc(pinned, nil)
+      release_pin(pinned, commit == false and 0 or 1)
+    end,
+  },
+})
+
+--create a primitive java array of length zeroed elements of the given JTYPE
+function luajitjava.new_array(element_type, length)
+  if not lj_env then
+    return
+  end
+  local new_array = JavaObjectType(lj_env)
+  if luajitjava_bindings.javaNewArray(new_array, element_type, length) ~= 0 then
+    return ffi.gc(new_array, object_finalizer)
+  end
+end
+
+--JTYPE of the elements of a primitive java array and its length, nil for other objects
+function luajitjava.array_info(java_array)
+  if not lj_env then
+    return
+  end
+  local element_type = luajitjava_bindings.javaGetArrayType(java_array)
+  if element_type ~= luajitjava_bindings.JTYPE_NONE then
+    return element_type, luajitjava_bindings.javaGetArrayLength(java_array)
+  end
+end
+
+--pin the elements of a primitive java array and return the pin and a typed pointer to them.
+-- With critical, the JVM gives its own memory whenever it can but the garbage collector is blocked
+-- and no other java call may be made until pin:unpin(), releases of collected handles waiting until then;
+-- other pins may work on a copy.
+-- Writes through the pointer reach the array once unpinned, at the latest when the pin is collected
+function luajitjava.pin_array(java_array, critical)
+  if not lj_env then
+    return
+  end
+  local pinned = JavaArrayType()
+  if luajitjava_bindings.javaPinArray(pinned, java_array, critical and 1 or 0) == 0 then
+    return
+  end
+  if critical then
+    critical_pins = critical_pins + 1
+  end
+  pinned = ffi.gc(pinned, array_finalizer)
+  return pinned, pinned:ptr()
+end
+
+--copy length elements of a primitive java array from start, counted from 0, into buffer
+-- a new buffer of the array element type is created when none is given. Returns the buffer
+function luajitjava.get_array_region(java_array, start, length, buffer)
+  if not lj_env then
+    return
+  end
+  if not buffer then
+    local buffer_type = array_buffer_types[luajitjava_bindings.javaGetArrayType(java_array)]
+    if not buffer_type then
+      print("java array region : object is not a primitive array")
+      return
+    end
+    buffer = buffer_type(length)
+  end
+  if luajitjava_bindings.javaGetArrayRegion(java_array, start, length, buffer) ~= 0 then
+    return buffer
+  end
+end
+
+--copy length elements of buffer into a primitive java array from start, counted from 0
+-- buffer holds values of the array element type. Returns true on success
+function luajitjava.set_array_region(java_array, start, length, buffer)
+  if not lj_env then
+    return
+  end
+  return luajitjava_bindings.javaSetArrayRegion(java_array, start, length, buffer) ~= 0
+end
+
+--lua memory wrapped by direct buffers, kept alive as long as their handle
+local buffer_memory = setmetatable({}, { __mode = "k" })
+
+--wrap size bytes of lua owned memory, such as an ffi.new("uint8_t[?]", n) array or malloc'd memory,
+-- into a java.nio.ByteBuffer without any copy, to be passed as a JTYPE_OBJECT param.
+-- The memory is kept alive with the returned handle, java must not keep using the buffer beyond it.
+-- Java reads the buffer as big endian unless its order is changed
+function luajitjava.new_direct_buffer(memory, size)
+  if not lj_env then
+    return
+  end
+  local new_buffer = JavaObjectType(lj_env)
+  if luajitjava_bindings.javaNewDirectBuffer(new_buffer, memory, size) ~= 0 then
+    buffer_memory[new_buffer] = memory
+    return ffi.gc(new_buffer, object_finalizer)
+  end
+end
+
+--memory of a java direct ByteBuffer as an uint8_t pointer and its capacity in bytes, nil for other objects
+-- the pointer is only valid as long as the buffer is referenced by java or by a handle
+function luajitjava.buffer_address(java_buffer)
+  if not lj_env then
+    return
+  end
+  local address = luajitjava_bindings.javaGetDirectBufferAddress(java_buffer)
+  if address ~= nil then
+    return ffi.cast("uint8_t*", address), tonumber(luajitjava_bindings.javaGetDirectBufferCapacity(java_buffer))
+  end
+end
+
+--run fn the given number of times and report the traces that were aborted meanwhile,
+-- to check that a loop calling java stays compiled. This gives the aborts that
+-- luajit -jv would print, restricted to the run of fn
+function luajitjava.check_trace(fn, iterations)
+  --abort messages come with luajit's jit library, codes are given without it
+  local jutil = require("jit.util")
+  local has_vmdef, vmdef = pcall(require, "jit.vmdef")
+  local aborts = {}
+  local function on_trace(what, tr, func, pc, otr, oex)
+    if what == "abort" then
+      local info = jutil.funcinfo(func, pc)
+      local reason = has_vmdef and vmdef.traceerr[otr] or ("error " .. tostring(otr))
+      if oex and reason:find("%%") then
+        reason = string.format(reason, type(oex) == "number" and oex or tostring(oex))
+      end
+      table.insert(aborts, string.format("trace %d aborted at %s: %s", tr, info.loc or "?", reason))
+    end
+  end
+  jit.attach(on_trace, "trace")
+  for i = 1, iterations or 1000 do
+    fn(i)
+  end
+  jit.attach(on_trace)
+  return #aborts == 0, aborts
 end
 
 return luajitjava
\ No newline at end of file
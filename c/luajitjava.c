@@ -41,18 +41,272 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+#include <time.h>
 
 #include <jni.h>
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <pthread.h>
+#endif
+#ifdef __linux__
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#endif
 
 #include "luajitjava.h"
 
-//opaque struct returned after started environment
+//thread local storage, locks and atomic pointers used to share an environment between threads
+#ifdef _WIN32
+#define LJ_THREAD_LOCAL __declspec(thread)
+typedef SRWLOCK ljMutex_t;
+#define LJ_MUTEX_INIT(m) InitializeSRWLock(m)
+#define LJ_MUTEX_INITIALIZER SRWLOCK_INIT
+#define LJ_MUTEX_DESTROY(m)
+#define LJ_MUTEX_LOCK(m) AcquireSRWLockExclusive(m)
+#define LJ_MUTEX_UNLOCK(m) ReleaseSRWLockExclusive(m)
+#define LJ_ATOMIC_LOAD_PTR(p) InterlockedCompareExchangePointer((PVOID volatile*)(p), NULL, NULL)
+#define LJ_ATOMIC_STORE_PTR(p, v) InterlockedExchangePointer((PVOID volatile*)(p), (v))
+#define LJ_ATOMIC_EXCHANGE_PTR(p, v) InterlockedExchangePointer((PVOID volatile*)(p), (v))
+#define LJ_ATOMIC_LOAD_INT(p) InterlockedCompareExchange((LONG volatile*)(p), 0, 0)
+#define LJ_ATOMIC_ACQUIRE_INT(p) ReadAcquire((LONG const volatile*)(p))
+#define LJ_ATOMIC_STORE_INT(p, v) InterlockedExchange((LONG volatile*)(p), (v))
+#define LJ_ATOMIC_INCREMENT_INT(p) InterlockedIncrement((LONG volatile*)(p))
+#define LJ_ATOMIC_DECREMENT_INT(p) InterlockedDecrement((LONG volatile*)(p))
+#define LJ_ATOMIC_ADD_INT(p, v) InterlockedExchangeAdd((LONG volatile*)(p), (v))
+#define LJ_ATOMIC_LOAD_LONG(p) InterlockedCompareExchange64((LONG64 volatile*)(p), 0, 0)
+#define LJ_ATOMIC_ADD_LONG(p, v) InterlockedExchangeAdd64((LONG64 volatile*)(p), (v))
+#define LJ_ATOMIC_CAS_LONG(p, expected, desired) \
+	(InterlockedCompareExchange64((LONG64 volatile*)(p), (desired), (expected)) == (expected))
+#define LJ_ATOMIC_BUMP_LONG(p, v) WriteNoFence64((LONG64 volatile*)(p), ReadNoFence64((LONG64 volatile*)(p)) + (v))
+#define LJ_ATOMIC_STORE_LONG(p, v) WriteNoFence64((LONG64 volatile*)(p), (v))
+#else
+#define LJ_THREAD_LOCAL __thread
+typedef pthread_mutex_t ljMutex_t;
+#define LJ_MUTEX_INIT(m) pthread_mutex_init((m), NULL)
+#define LJ_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define LJ_MUTEX_DESTROY(m) pthread_mutex_destroy(m)
+#define LJ_MUTEX_LOCK(m) pthread_mutex_lock(m)
+#define LJ_MUTEX_UNLOCK(m) pthread_mutex_unlock(m)
+#define LJ_ATOMIC_LOAD_PTR(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define LJ_ATOMIC_STORE_PTR(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define LJ_ATOMIC_EXCHANGE_PTR(p, v) __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define LJ_ATOMIC_LOAD_INT(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define LJ_ATOMIC_ACQUIRE_INT(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define LJ_ATOMIC_STORE_INT(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define LJ_ATOMIC_INCREMENT_INT(p) __atomic_add_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define LJ_ATOMIC_DECREMENT_INT(p) __atomic_sub_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define LJ_ATOMIC_ADD_INT(p, v) __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+//statistics counters are only summed, they need no ordering
+#define LJ_ATOMIC_LOAD_LONG(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define LJ_ATOMIC_ADD_LONG(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define LJ_ATOMIC_CAS_LONG(p, expected, desired) __sync_bool_compare_and_swap((p), (expected), (desired))
+//counters written by a single thread are bumped without a locked read-modify-write
+#define LJ_ATOMIC_BUMP_LONG(p, v) __atomic_store_n((p), __atomic_load_n((p), __ATOMIC_RELAXED) + (v), __ATOMIC_RELAXED)
+#define LJ_ATOMIC_STORE_LONG(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#endif
+
+//maximum number of arguments a java method or constructor can be called with
+#define LJ_MAX_ARGS 32
+//number of buckets of the resolved method cache
+#define LJ_METHOD_CACHE_SIZE 256
+//name constructors are cached under in the resolved method cache, no method can be named so
+#define LJ_CONSTRUCTOR_NAME "<init>"
+//flags set by LuaJitJavaAPI.methodInfo on static methods and on object return types
+// that can hold strings or boxed primitives, the low bits holding the return type
+#define LJ_METHOD_STATIC 0x100
+#define LJ_METHOD_VALUE 0x200
+#define LJ_METHOD_TYPE_MASK 0xFF
+//default number of local references a scope is created for, the frame grows if needed
+#define LJ_SCOPE_CAPACITY 64
+//number of slots of the first and largest slabs of the object handle pool
+#define LJ_HANDLE_SLAB_MIN 64
+#define LJ_HANDLE_SLAB_MAX 4096
+//number of free handles a thread takes from or gives back to the pool at once
+#define LJ_HANDLE_CACHE_BATCH 32
+//default number of deferred releases queued before they are flushed
+#define LJ_RELEASE_THRESHOLD 256
+//number of times the dispatcher and its callers poll before going to sleep
+#define LJ_DISPATCH_SPIN 1024
+//number of buckets of the resolved field cache
+#define LJ_FIELD_CACHE_SIZE 256
+//flags set by LuaJitJavaAPI.fieldInfo, the low bits holding the field type
+#define LJ_FIELD_STATIC 0x100
+#define LJ_FIELD_FINAL 0x200
+//number of buckets of the symbol table
+#define LJ_SYMBOL_TABLE_SIZE 256
+//number of buckets of the class registry, by name, by reference and by identity hash
+#define LJ_CLASS_REGISTRY_SIZE 256
+//number of utf-16 units of string arguments converted on the stack, longer ones are allocated
+#define LJ_STRING_STACK_SIZE 256
+
+//resolved method, keyed by receiver class, method name and argument type tags,
+// clazz being the registry reference of the receiver class
+// methodID is NULL when the call cannot be bound unambiguously
+// and has to go through the LuaJitJavaAPI.runMethod proxy,
+// valueReturn is cleared for object return types no string or boxed primitive can be returned as
+typedef struct ljMethodCacheEntry {
+	struct ljMethodCacheEntry* next;
+	unsigned int hash;
+	jclass clazz;
+	int classReceiver;
+	char* name;
+	int nArgs;
+	javaArgType_t* argTypes;
+	jclass* argClasses;
+	jmethodID methodID;
+	jclass declaringClass;
+	int isStatic;
+	javaArgType_t returnType;
+	int valueReturn;
+	ljJavaLatency_t latency;
+} ljMethodCacheEntry_t;
+
+//resolved field, keyed by receiver class and field name, clazz being the registry reference of the receiver class
+// fieldID is NULL when the name is not a public field of the class,
+// constant holds the value of static final primitive and string fields once read,
+// constantValue the unboxed value of primitive ones once hasConstantValue is set
+typedef struct ljFieldCacheEntry {
+	struct ljFieldCacheEntry* next;
+	unsigned int hash;
+	jclass clazz;
+	int classReceiver;
+	char* name;
+	jfieldID fieldID;
+	jclass declaringClass;
+	int isStatic;
+	int isFinal;
+	javaArgType_t type;
+	jobject constant;
+	jvalue constantValue;
+	int hasConstantValue;
+} ljFieldCacheEntry_t;
+
+//interned java string of a method name or field key
+typedef struct ljSymbolEntry {
+	struct ljSymbolEntry* next;
+	unsigned int hash;
+	jstring symbol;
+	char* name;
+} ljSymbolEntry_t;
+
+//class known to the environment, either bound by name and shared by every class handle of that name,
+// or met as the class of a receiver. Its reference is the one identity of the class for the caches.
+// refCount counts the handles bound to it, bound is set once the entry is listed by name,
+// isClass for java.lang.Class itself, whose instances are looked into as classes
+typedef struct ljClassEntry {
+	struct ljClassEntry* next;
+	struct ljClassEntry* nextByRef;
+	struct ljClassEntry* nextById;
+	unsigned int hash;
+	jint identityHash;
+	jclass clazz;
+	int refCount;
+	int bound;
+	int isClass;
+	char* name;
+} ljClassEntry_t;
+
+//object handle slot of the handle pool, the handle comes first so that both pointers are the same
+typedef struct ljHandleSlot {
+	ljJavaObject_t handle;
+	struct ljHandleSlot* nextFree;
+} ljHandleSlot_t;
+
+//block of handle slots, slabs double in size up to LJ_HANDLE_SLAB_MAX slots
+typedef struct ljHandleSlab {
+	struct ljHandleSlab* next;
+	int size;
+	ljHandleSlot_t slots[];
+} ljHandleSlab_t;
+
+//opaque struct returned after started environment, shared by all threads calling java
+// caches are read without locking and only written under cacheLock,
+// the symbol table likewise under symbolLock, the handle pool is guarded by handleLock
+// and the list of thread states by threadLock
 typedef struct ljJavaEnvironment {
-	JNIEnv* javaEnv;
 	JavaVM* jvm;
+	ljMethodCacheEntry_t* methodCache[LJ_METHOD_CACHE_SIZE];
+	ljFieldCacheEntry_t* fieldCache[LJ_FIELD_CACHE_SIZE];
+	ljSymbolEntry_t* symbols[LJ_SYMBOL_TABLE_SIZE];
+	ljClassEntry_t* classes[LJ_CLASS_REGISTRY_SIZE];
+	ljClassEntry_t* classRefs[LJ_CLASS_REGISTRY_SIZE];
+	ljClassEntry_t* classIds[LJ_CLASS_REGISTRY_SIZE];
+	ljMutex_t cacheLock;
+	ljMutex_t symbolLock;
+	ljMutex_t classLock;
+	int foldConstants;
+	ljMutex_t handleLock;
+	ljHandleSlab_t* handleSlabs;
+	ljHandleSlot_t* freeHandles;
+	int handleSlabCount;
+	int handleCapacity;
+	int freeHandleCount;
+	ljMutex_t threadLock;
+	struct ljThreadState* threadStates;
+	int releaseThreshold;
+	int refCount;
+	int ownsJvm;
+	int statsEnabled;
+	int methodStatsEnabled;
+	int objectRefs;
+	int registeredClasses;
+	//operation counters of exited threads, merged under threadLock
+	ljJavaLatency_t ops[JSTATS_OP_COUNT];
 } ljJavaEnvironment_t;
 
+//state of a thread calling java, as jni environments and local references belong to one thread
+// attached is set for threads attached by luajitjava, which are detached when they exit,
+// free object handles are cached in front of the pool and states are listed by their environment,
+// which sums the operation counters of its threads for statistics.
+// criticalPins counts the critical array pins held by the thread, during which releases make no jni call.
+// orphanFrames counts the local frames of scopes left open by an ended environment whose JVM still runs
+typedef struct ljThreadState {
+	ljJavaEnvironment_t* ljEnv;
+	JNIEnv* javaEnv;
+	int attached;
+	char* stringBuffer;
+	int stringBufferSize;
+	int scopeDepth;
+	int scopeCapacity;
+	int* scopeMarks;
+	ljJavaObject_t** scopeHandles;
+	int scopeHandleCount;
+	int scopeHandleCapacity;
+	int orphanFrames;
+	jobject* releaseQueue;
+	int releaseQueueCount;
+	int releaseQueueCapacity;
+	int criticalPins;
+	ljHandleSlot_t* handleCache;
+	int handleCacheCount;
+	struct ljThreadState* nextState;
+	struct ljThreadState* previousState;
+	ljJavaLatency_t ops[JSTATS_OP_COUNT];
+} ljThreadState_t;
+
+//state of the current thread, and the running JVM to detach threads from
+static LJ_THREAD_LOCAL ljThreadState_t* currentThreadState = NULL;
+static JavaVM* runningJvm = NULL;
+
+//environment shared by every start until as many ends, and the lock guarding starts and ends
+static ljJavaEnvironment_t* sharedEnvironment = NULL;
+static ljMutex_t startLock = LJ_MUTEX_INITIALIZER;
+
+//JVM the library was loaded by through System.loadLibrary, and the bindings class as seen from its class loader
+static JavaVM* loadedJvm = NULL;
+static jclass loadedBindingClass = NULL;
+#ifdef _WIN32
+static DWORD threadExitIndex = FLS_OUT_OF_INDEXES;
+#else
+static pthread_key_t threadExitKey;
+static pthread_once_t threadExitKeyOnce = PTHREAD_ONCE_INIT;
+#endif
+
 
 
 //set of useful java classes we bind with at init for convenience
@@ -60,13 +314,30 @@ typedef struct ljJavaEnvironment {
 static jclass    luajitjava_binding_class = NULL;
 static jmethodID luajitjava_run_method = NULL;
 static jmethodID luajitjava_java_new = NULL;
-static jmethodID luajitjava_check_field = NULL;
+static jmethodID luajitjava_resolve_field = NULL;
+static jmethodID luajitjava_field_info = NULL;
+static jmethodID luajitjava_resolve_method = NULL;
+static jmethodID luajitjava_method_info = NULL;
+static jmethodID luajitjava_resolve_constructor = NULL;
+static jmethodID luajitjava_java_new_many = NULL;
+static jmethodID luajitjava_run_method_async = NULL;
+static jmethodID luajitjava_run_batch = NULL;
 static jclass    throwable_class = NULL;
 static jmethodID throwable_tostring = NULL;
 static jmethodID throwable_get_message = NULL;
 static jclass    java_lang_class = NULL;
 static jmethodID java_lang_class_forname = NULL;
+static jmethodID java_lang_class_get_name = NULL;
 static jclass    java_lang_object = NULL;
+static jclass    java_lang_system = NULL;
+static jmethodID java_lang_system_identity_hash = NULL;
+static jclass    java_method_class = NULL;
+static jmethodID java_method_get_parameter_types = NULL;
+static jmethodID java_method_get_declaring_class = NULL;
+static jclass    java_constructor_class = NULL;
+static jmethodID java_constructor_get_parameter_types = NULL;
+static jclass    java_field_class = NULL;
+static jmethodID java_field_get_declaring_class = NULL;
 
 //keep track of the java class loader at init in jni context
 // to be provided to java.lang.Class calls,
@@ -95,7 +366,21 @@ static jmethodID java_double_value = NULL;
 static jobject	 java_boolean_class = NULL;
 static jmethodID java_new_boolean = NULL;
 static jmethodID java_boolean_value = NULL;
+static jobject	 java_char_class = NULL;
+static jmethodID java_new_char = NULL;
+static jmethodID java_char_value = NULL;
 static jobject	 java_string_class = NULL;
+static jclass    java_object_array_class = NULL;
+
+//primitive array classes, indexed by the javaArgType_t of their elements
+static const char* java_primitive_array_names[JTYPE_CHAR + 1] = { NULL, "[B", "[S", "[I", "[J", "[F", "[D", "[Z", "[C" };
+static jclass    java_primitive_array_classes[JTYPE_CHAR + 1] = { NULL };
+//classes of strings and boxed primitives, with the type tag of their objects
+#define LJ_BOXED_TYPE_COUNT 9
+static struct {
+	jclass clazz;
+	javaArgType_t type;
+} java_boxed_types[LJ_BOXED_TYPE_COUNT];
 
 
 //utility function to check for exception after jni calls
@@ -121,86 +406,205 @@ jobject checkException(JNIEnv* javaEnv) {
 	return NULL;
 }
 
+//format a JVM option from a pattern holding a single %s
+static char* formatJvmOption(const char* pattern, const char* value)
+{
+	size_t size = strlen(pattern) - 2 + strlen(value) + 1;
+	char* option = malloc(size);
+	snprintf(option, size, pattern, value);
+	return option;
+}
+
 //function to start the VM
-JNIEnv* create_vm(JavaVM** jvm, const char* classPath) {
-	JNIEnv *env;
+// options are given to the JVM after the class path, such as "-Xmx512m" or "-XX:TieredStopAtLevel=1".
+// With a sharedArchive path, the application classes loaded during the run are dumped
+// to that AppCDS archive when the JVM ends, and later runs map the archive instead of loading them again.
+// A stale archive is rejected by the JVM, which then loads classes as usual
+JNIEnv* create_vm(JavaVM** jvm, const char* classPath, int nOptions, const char** options, const char* sharedArchive) {
+	JNIEnv *env = NULL;
 	JavaVMInitArgs vm_args;
-	const char* classpathPattern = "-Djava.class.path=%s";
+	JavaVMOption* vmOptions = calloc(nOptions + 2, sizeof(JavaVMOption));
+	int nArchiveOptions = 0;
+	jint created;
+
 	vm_args.version = JNI_VERSION_1_8; //JDK version. This indicates     version 1.8
 	JNI_GetDefaultJavaVMInitArgs(&vm_args);
-	JavaVMOption options;
-	options.optionString = malloc((_mbstrlen(classpathPattern) - 1 + _mbstrlen(classPath)) * sizeof(char));
-	sprintf(options.optionString, classpathPattern, classPath);
-	vm_args.nOptions = 1;
-	vm_args.options = &options;
+	vmOptions[0].optionString = formatJvmOption("-Djava.class.path=%s", classPath);
+	for (int i = 0; i < nOptions; i++) {
+		vmOptions[i + 1].optionString = (char*)options[i];
+	}
+	if (sharedArchive != NULL && sharedArchive[0] != '\0') {
+		FILE* archive = fopen(sharedArchive, "rb");
+		if (archive != NULL) {
+			fclose(archive);
+			vmOptions[nOptions + 1].optionString = formatJvmOption("-XX:SharedArchiveFile=%s", sharedArchive);
+		} else {
+			vmOptions[nOptions + 1].optionString = formatJvmOption("-XX:ArchiveClassesAtExit=%s", sharedArchive);
+		}
+		nArchiveOptions = 1;
+	}
+	vm_args.nOptions = nOptions + 1 + nArchiveOptions;
+	vm_args.options = vmOptions;
 	vm_args.ignoreUnrecognized = 0;
-	JNI_CreateJavaVM(jvm, (void**)&env, &vm_args);
+	created = JNI_CreateJavaVM(jvm, (void**)&env, &vm_args);
+	if (created != JNI_OK && nArchiveOptions) {
+		//JVMs older than 13 have no dynamic archives, start without it
+		fprintf(stderr, "Couldn't use the shared archive %s, starting without it\n", sharedArchive);
+		vm_args.nOptions = nOptions + 1;
+		created = JNI_CreateJavaVM(jvm, (void**)&env, &vm_args);
+	}
+	if (created != JNI_OK) {
+		env = NULL;
+	}
+
+	free(vmOptions[0].optionString);
+	if (nArchiveOptions) {
+		free(vmOptions[nOptions + 1].optionString);
+	}
+	free(vmOptions);
 	return env;
 }
 
+//create a global reference to a class, to be shared by all threads
+static jclass findGlobalClass(JNIEnv* env, const char* className)
+{
+	jclass localClass = (*env)->FindClass(env, className);
+	jclass globalClass;
+
+	if (localClass == NULL) {
+		return NULL;
+	}
+	globalClass = (*env)->NewGlobalRef(env, localClass);
+	(*env)->DeleteLocalRef(env, localClass);
+	return globalClass;
+}
+
+//native methods called back by LuaJitJavaAPI
+static void JNICALL completeFuture(JNIEnv* env, jclass clazz, jlong future, jobject result, jthrowable error);
+static JNINativeMethod luajitjava_natives[] = {
+	{ "completeFuture", "(JLjava/lang/Object;Ljava/lang/Throwable;)V", (void*)completeFuture },
+};
+
 //bind with all utility java objects
 int bindJavaBaseLinks(JNIEnv* env)
 {
-	jclass tmpClass;
-
-	tmpClass = (*env)->FindClass(env, "developpeur2000/luajitjava/LuaJitJavaAPI");
-	if (tmpClass == NULL)
+	if (loadedBindingClass != NULL) {
+		luajitjava_binding_class = (*env)->NewGlobalRef(env, loadedBindingClass);
+	} else {
+		luajitjava_binding_class = findGlobalClass(env, "developpeur2000/luajitjava/LuaJitJavaAPI");
+	}
+	if (luajitjava_binding_class == NULL)
 	{
 		fprintf(stderr, "Could not find LuaJitJavaAPI class\n");
 		return 0;
 	}
-	luajitjava_binding_class = (*env)->NewGlobalRef(env, tmpClass);
-	(*env)->DeleteLocalRef(env, tmpClass);
 
 	luajitjava_run_method = (*env)->GetStaticMethodID(env, luajitjava_binding_class, "runMethod",
 		"(Ljava/lang/Object;Ljava/lang/String;[Ljava/lang/Object;)Ljava/lang/Object;");
 	luajitjava_java_new = (*env)->GetStaticMethodID(env, luajitjava_binding_class, "javaNew",
 		"(Ljava/lang/Class;[Ljava/lang/Object;)Ljava/lang/Object;");
-	luajitjava_check_field = (*env)->GetStaticMethodID(env, luajitjava_binding_class, "checkField",
-		"(Ljava/lang/Object;Ljava/lang/String;)Ljava/lang/Object;");
+	luajitjava_resolve_field = (*env)->GetStaticMethodID(env, luajitjava_binding_class, "resolveField",
+		"(Ljava/lang/Class;Ljava/lang/String;Z)Ljava/lang/reflect/Field;");
+	luajitjava_field_info = (*env)->GetStaticMethodID(env, luajitjava_binding_class, "fieldInfo",
+		"(Ljava/lang/reflect/Field;)I");
+	luajitjava_resolve_method = (*env)->GetStaticMethodID(env, luajitjava_binding_class, "resolveMethod",
+		"(Ljava/lang/Class;Ljava/lang/String;[IZ)Ljava/lang/reflect/Method;");
+	luajitjava_method_info = (*env)->GetStaticMethodID(env, luajitjava_binding_class, "methodInfo",
+		"(Ljava/lang/reflect/Method;)I");
+	luajitjava_resolve_constructor = (*env)->GetStaticMethodID(env, luajitjava_binding_class, "resolveConstructor",
+		"(Ljava/lang/Class;[I)Ljava/lang/reflect/Constructor;");
+	luajitjava_java_new_many = (*env)->GetStaticMethodID(env, luajitjava_binding_class, "javaNewMany",
+		"(Ljava/lang/Class;[[Ljava/lang/Object;)[Ljava/lang/Object;");
+	luajitjava_run_method_async = (*env)->GetStaticMethodID(env, luajitjava_binding_class, "runMethodAsync",
+		"(Ljava/lang/Object;Ljava/lang/String;[Ljava/lang/Object;J)V");
+	luajitjava_run_batch = (*env)->GetStaticMethodID(env, luajitjava_binding_class, "runBatch",
+		"([Ljava/lang/Object;[Ljava/lang/String;[[Ljava/lang/Object;[Ljava/lang/Object;)[Ljava/lang/Throwable;");
+	if ((*env)->RegisterNatives(env, luajitjava_binding_class, luajitjava_natives,
+		sizeof(luajitjava_natives) / sizeof(luajitjava_natives[0])) != 0)
+	{
+		fprintf(stderr, "Could not register LuaJitJavaAPI native methods\n");
+		return 0;
+	}
 
 
-	throwable_class = (*env)->FindClass(env, "java/lang/Throwable");
+	throwable_class = findGlobalClass(env, "java/lang/Throwable");
 	throwable_get_message = (*env)->GetMethodID(env, throwable_class, "getMessage",
 		"()Ljava/lang/String;");
 	throwable_tostring = (*env)->GetMethodID(env, throwable_class, "toString",
 		"()Ljava/lang/String;");
 
-	java_lang_class = (*env)->FindClass(env, "java/lang/Class");
+	java_lang_class = findGlobalClass(env, "java/lang/Class");
 	java_lang_class_forname = (*env)->GetStaticMethodID(env, java_lang_class, "forName",
 		"(Ljava/lang/String;ZLjava/lang/ClassLoader;)Ljava/lang/Class;");
+	java_lang_class_get_name = (*env)->GetMethodID(env, java_lang_class, "getName", "()Ljava/lang/String;");
+
+	java_lang_object = findGlobalClass(env, "java/lang/Object");
+
+	java_lang_system = findGlobalClass(env, "java/lang/System");
+	java_lang_system_identity_hash = (*env)->GetStaticMethodID(env, java_lang_system, "identityHashCode",
+		"(Ljava/lang/Object;)I");
+
+	java_method_class = findGlobalClass(env, "java/lang/reflect/Method");
+	java_method_get_parameter_types = (*env)->GetMethodID(env, java_method_class, "getParameterTypes",
+		"()[Ljava/lang/Class;");
+	java_method_get_declaring_class = (*env)->GetMethodID(env, java_method_class, "getDeclaringClass",
+		"()Ljava/lang/Class;");
 
-	java_lang_object = (*env)->FindClass(env, "java/lang/Object");
+	java_constructor_class = findGlobalClass(env, "java/lang/reflect/Constructor");
+	java_constructor_get_parameter_types = (*env)->GetMethodID(env, java_constructor_class, "getParameterTypes",
+		"()[Ljava/lang/Class;");
 
-	java_byte_class = (*env)->FindClass(env, "java/lang/Byte");
+	java_field_class = findGlobalClass(env, "java/lang/reflect/Field");
+	java_field_get_declaring_class = (*env)->GetMethodID(env, java_field_class, "getDeclaringClass",
+		"()Ljava/lang/Class;");
+
+	java_byte_class = findGlobalClass(env, "java/lang/Byte");
 	java_new_byte = (*env)->GetMethodID(env, java_byte_class, "<init>", "(B)V");
 	java_byte_value = (*env)->GetMethodID(env, java_byte_class, "intValue", "()I");
 
-	java_short_class = (*env)->FindClass(env, "java/lang/Short");
+	java_short_class = findGlobalClass(env, "java/lang/Short");
 	java_new_short = (*env)->GetMethodID(env, java_short_class, "<init>", "(S)V");
 	java_short_value = (*env)->GetMethodID(env, java_short_class, "intValue", "()I");
 
-	java_int_class = (*env)->FindClass(env, "java/lang/Integer");
+	java_int_class = findGlobalClass(env, "java/lang/Integer");
 	java_new_int = (*env)->GetMethodID(env, java_int_class, "<init>", "(I)V");
 	java_int_value = (*env)->GetMethodID(env, java_int_class, "intValue", "()I");
 
-	java_long_class = (*env)->FindClass(env, "java/lang/Long");
+	java_long_class = findGlobalClass(env, "java/lang/Long");
 	java_new_long = (*env)->GetMethodID(env, java_long_class, "<init>", "(J)V");
 	java_long_value = (*env)->GetMethodID(env, java_long_class, "longValue", "()J");
 
-	java_float_class = (*env)->FindClass(env, "java/lang/Float");
+	java_float_class = findGlobalClass(env, "java/lang/Float");
 	java_new_float = (*env)->GetMethodID(env, java_float_class, "<init>", "(F)V");
 	java_float_value = (*env)->GetMethodID(env, java_float_class, "floatValue", "()F");
 
-	java_double_class = (*env)->FindClass(env, "java/lang/Double");
+	java_double_class = findGlobalClass(env, "java/lang/Double");
 	java_new_double = (*env)->GetMethodID(env, java_double_class, "<init>", "(D)V");
 	java_double_value = (*env)->GetMethodID(env, java_double_class, "doubleValue", "()D");
 
-	java_boolean_class = (*env)->FindClass(env, "java/lang/Boolean");
+	java_boolean_class = findGlobalClass(env, "java/lang/Boolean");
 	java_new_boolean = (*env)->GetMethodID(env, java_boolean_class, "<init>", "(Z)V");
 	java_boolean_value = (*env)->GetMethodID(env, java_boolean_class, "booleanValue", "()Z");
 
-	java_string_class = (*env)->FindClass(env, "java/lang/String");
+	java_char_class = findGlobalClass(env, "java/lang/Character");
+	java_new_char = (*env)->GetMethodID(env, java_char_class, "<init>", "(C)V");
+	java_char_value = (*env)->GetMethodID(env, java_char_class, "charValue", "()C");
+
+	java_string_class = findGlobalClass(env, "java/lang/String");
+	{
+		jclass boxedClasses[LJ_BOXED_TYPE_COUNT] = { java_string_class, java_int_class, java_double_class,
+			java_long_class, java_boolean_class, java_float_class, java_char_class, java_short_class, java_byte_class };
+		javaArgType_t boxedTypes[LJ_BOXED_TYPE_COUNT] = { JTYPE_STRING, JTYPE_INT, JTYPE_DOUBLE,
+			JTYPE_LONG, JTYPE_BOOLEAN, JTYPE_FLOAT, JTYPE_CHAR, JTYPE_SHORT, JTYPE_BYTE };
+		for (int i = 0; i < LJ_BOXED_TYPE_COUNT; i++) {
+			java_boxed_types[i].clazz = boxedClasses[i];
+			java_boxed_types[i].type = boxedTypes[i];
+		}
+	}
+	java_object_array_class = findGlobalClass(env, "[Ljava/lang/Object;");
+	for (int type = JTYPE_BYTE; type <= JTYPE_CHAR; type++) {
+		java_primitive_array_classes[type] = findGlobalClass(env, java_primitive_array_names[type]);
+	}
 
 	return 1;
 }
@@ -208,329 +612,3124 @@ int bindJavaBaseLinks(JNIEnv* env)
 //release the utility java bindings
 void unbindJavaBaseLinks(JNIEnv* env)
 {
-	(*env)->DeleteLocalRef(env, luajitjava_binding_class);
-	(*env)->DeleteLocalRef(env, throwable_class);
-	(*env)->DeleteLocalRef(env, java_lang_class);
+	(*env)->DeleteGlobalRef(env, luajitjava_binding_class);
+	(*env)->DeleteGlobalRef(env, throwable_class);
+	(*env)->DeleteGlobalRef(env, java_lang_class);
+
+	(*env)->DeleteGlobalRef(env, java_lang_object);
+	(*env)->DeleteGlobalRef(env, java_lang_system);
+	(*env)->DeleteGlobalRef(env, java_method_class);
+	(*env)->DeleteGlobalRef(env, java_constructor_class);
+	(*env)->DeleteGlobalRef(env, java_field_class);
+
+	(*env)->DeleteGlobalRef(env, java_byte_class);
+	(*env)->DeleteGlobalRef(env, java_short_class);
+	(*env)->DeleteGlobalRef(env, java_int_class);
+	(*env)->DeleteGlobalRef(env, java_long_class);
+	(*env)->DeleteGlobalRef(env, java_float_class);
+	(*env)->DeleteGlobalRef(env, java_double_class);
+	(*env)->DeleteGlobalRef(env, java_boolean_class);
+	(*env)->DeleteGlobalRef(env, java_char_class);
+	(*env)->DeleteGlobalRef(env, java_string_class);
+	(*env)->DeleteGlobalRef(env, java_object_array_class);
+	for (int type = JTYPE_BYTE; type <= JTYPE_CHAR; type++) {
+		(*env)->DeleteGlobalRef(env, java_primitive_array_classes[type]);
+		java_primitive_array_classes[type] = NULL;
+	}
+}
 
-	(*env)->DeleteLocalRef(env, java_lang_object);
+/***************************************************************
+      WAIT AND WAKE
+****************************************************************/
 
-	(*env)->DeleteLocalRef(env, java_byte_class);
-	(*env)->DeleteLocalRef(env, java_short_class);
-	(*env)->DeleteLocalRef(env, java_int_class);
-	(*env)->DeleteLocalRef(env, java_long_class);
-	(*env)->DeleteLocalRef(env, java_float_class);
-	(*env)->DeleteLocalRef(env, java_double_class);
-	(*env)->DeleteLocalRef(env, java_boolean_class);
-	(*env)->DeleteLocalRef(env, java_string_class);
+//milliseconds of a monotonic clock
+static long long currentTimeMs(void)
+{
+#ifdef _WIN32
+	return (long long)GetTickCount64();
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+#endif
 }
 
-// init the bindings and get the java environment
-void* internal_javaStart(const char* classPath)
+//block while a word holds the given value, at most timeoutMs when it is not negative
+// wakeups may be spurious, the word is to be checked again by the caller
+#if defined(_WIN32)
+static void waitWord(int* word, int value, int timeoutMs)
 {
-	JNIEnv *env;
-	JavaVM *jvm;
-	ljJavaEnvironment_t* returnStruct;
-	jclass tempClass = NULL;
+	WaitOnAddress((volatile VOID*)word, &value, sizeof(int), timeoutMs < 0 ? INFINITE : (DWORD)timeoutMs);
+}
+static void wakeWord(int* word)
+{
+	WakeByAddressAll((PVOID)word);
+}
+#elif defined(__linux__)
+static void waitWord(int* word, int value, int timeoutMs)
+{
+	struct timespec timeout;
 
-	env = create_vm(&jvm, classPath);
-	if (env == NULL)
-	{
-		fprintf(stderr, "\n Unable to create java VM");
-		return NULL;
+	if (timeoutMs < 0) {
+		syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+		return;
 	}
-
-	//store class loader
-	jclass threadClass = (*env)->FindClass(env, "java/lang/Thread");
-	jmethodID currentThreadMethod = (*env)->GetStaticMethodID(env, threadClass, "currentThread",
-		"()Ljava/lang/Thread;");
-	jobject currentThread = (*env)->CallStaticObjectMethod(env, threadClass, currentThreadMethod);
-	jmethodID getContextClassLoaderMethod = (*env)->GetMethodID(env, threadClass, "getContextClassLoader",
-		"()Ljava/lang/ClassLoader;");
-	java_class_loader = (*env)->CallObjectMethod(env, currentThread, getContextClassLoaderMethod);
-	//cleanup
-	(*env)->DeleteLocalRef(env, threadClass);
-	(*env)->DeleteLocalRef(env, currentThread);
-
-	if (bindJavaBaseLinks(env) == 0) {
-		fprintf(stderr, "\n Unable to bind with java\n");
-		return NULL;
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_nsec = (long)(timeoutMs % 1000) * 1000000;
+	syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, &timeout, NULL, 0);
+}
+static void wakeWord(int* word)
+{
+	syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+#else
+static pthread_mutex_t wordLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wordChanged = PTHREAD_COND_INITIALIZER;
+static void waitWord(int* word, int value, int timeoutMs)
+{
+	struct timespec deadline;
+
+	if (timeoutMs >= 0) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += timeoutMs / 1000;
+		deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
 	}
-
-	returnStruct = malloc(sizeof(ljJavaEnvironment_t));
-	returnStruct->javaEnv = env;
-	returnStruct->jvm = jvm;
-	return (void*)returnStruct;
+	pthread_mutex_lock(&wordLock);
+	while (LJ_ATOMIC_LOAD_INT(word) == value) {
+		if (timeoutMs < 0) {
+			pthread_cond_wait(&wordChanged, &wordLock);
+		} else if (pthread_cond_timedwait(&wordChanged, &wordLock, &deadline) != 0) {
+			break;
+		}
+	}
+	pthread_mutex_unlock(&wordLock);
 }
-
-// release the bindings and destroy the JVM
-void internal_javaEnd(void* ljEnv)
+static void wakeWord(int* word)
 {
-	ljJavaEnvironment_t* infoStruct = (ljJavaEnvironment_t*)ljEnv;
-	JNIEnv * javaEnv = (JNIEnv *) infoStruct->javaEnv;
-	JavaVM * jvm = (JavaVM *) infoStruct->jvm;
-
-	free(infoStruct);
+	pthread_mutex_lock(&wordLock);
+	pthread_cond_broadcast(&wordChanged);
+	pthread_mutex_unlock(&wordLock);
+}
+#endif
 
-	(*javaEnv)->DeleteGlobalRef(javaEnv, java_class_loader);
+/***************************************************************
+      STATISTICS
+****************************************************************/
 
-	unbindJavaBaseLinks(javaEnv);
+//nanoseconds of a monotonic clock
+static long long currentTimeNs(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER now;
+	if (frequency.QuadPart == 0) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	QueryPerformanceCounter(&now);
+	return (long long)((double)now.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+#endif
+}
 
-	(*jvm)->DestroyJavaVM(jvm);
+//histogram bucket of a latency, see LJ_STATS_BUCKETS
+static int latencyBucket(long long ns)
+{
+	int magnitude;
+	int bucket;
 
-	fprintf(stdout, "destroyed jvm\n");
+	if (ns < 8) {
+		return ns < 0 ? 0 : (int)ns;
+	}
+#ifdef _WIN32
+	{
+		unsigned long index;
+		_BitScanReverse64(&index, (unsigned long long)ns);
+		magnitude = (int)index;
+	}
+#else
+	magnitude = 63 - __builtin_clzll((unsigned long long)ns);
+#endif
+	//the two bits after the leading one select the bucket within the power of two
+	bucket = 4 * (magnitude - 1) + (int)((ns >> (magnitude - 2)) & 3);
+	return bucket < LJ_STATS_BUCKETS ? bucket : LJ_STATS_BUCKETS - 1;
 }
 
-// get a java class handle
-int internal_javaBindClass(ljJavaClass_t* classInterface, const char* className)
+//start time of an operation, 0 when statistics are off
+static long long statsStart(ljJavaEnvironment_t* ljEnv)
 {
-	jstring javaClassName;
-	jobject classInstance;
-	JNIEnv * javaEnv;
+	return ljEnv->statsEnabled ? currentTimeNs() : 0;
+}
 
-	javaEnv = ((ljJavaEnvironment_t*)classInterface->ljEnv)->javaEnv;
-	(*javaEnv)->ExceptionClear(javaEnv);
+//time elapsed since the start of an operation, negative when statistics were off at its start
+static long long statsElapsed(long long start)
+{
+	return start != 0 ? currentTimeNs() - start : -1;
+}
 
+//count a call of a resolved method that took elapsed nanoseconds, its record being shared by all threads.
+// Updates are atomic but not ordered, readers may see a call before its latency.
+// As they contend between threads calling a same method, they are only made once method statistics are on
+static void recordLatency(ljJavaEnvironment_t* ljEnv, ljJavaLatency_t* latency, long long elapsed, int ok)
+{
+	long long max;
 
-	javaClassName = (*javaEnv)->NewStringUTF(javaEnv, className);
+	if (elapsed < 0 || !ljEnv->methodStatsEnabled) {
+		return;
+	}
+	LJ_ATOMIC_ADD_LONG(&latency->calls, 1);
+	if (!ok) {
+		LJ_ATOMIC_ADD_LONG(&latency->errors, 1);
+	}
+	LJ_ATOMIC_ADD_LONG(&latency->totalNs, elapsed);
+	LJ_ATOMIC_ADD_LONG(&latency->buckets[latencyBucket(elapsed)], 1);
+	max = LJ_ATOMIC_LOAD_LONG(&latency->maxNs);
+	while (elapsed > max && !LJ_ATOMIC_CAS_LONG(&latency->maxNs, max, elapsed)) {
+		max = LJ_ATOMIC_LOAD_LONG(&latency->maxNs);
+	}
+}
 
-	classInstance = (*javaEnv)->CallStaticObjectMethod(javaEnv, java_lang_class,
-		java_lang_class_forname, javaClassName, JNI_TRUE, java_class_loader);
+//count an operation that took elapsed nanoseconds, in counters of the calling thread
+// that no other thread updates, so that no atomic read-modify-write is needed
+static void recordThreadLatency(ljJavaLatency_t* latency, long long elapsed, int ok)
+{
+	if (elapsed < 0) {
+		return;
+	}
+	LJ_ATOMIC_BUMP_LONG(&latency->calls, 1);
+	if (!ok) {
+		LJ_ATOMIC_BUMP_LONG(&latency->errors, 1);
+	}
+	LJ_ATOMIC_BUMP_LONG(&latency->totalNs, elapsed);
+	LJ_ATOMIC_BUMP_LONG(&latency->buckets[latencyBucket(elapsed)], 1);
+	if (elapsed > latency->maxNs) {
+		LJ_ATOMIC_STORE_LONG(&latency->maxNs, elapsed);
+	}
+}
 
-	(*javaEnv)->DeleteLocalRef(javaEnv, javaClassName);
+static ljThreadState_t* getThreadState(ljJavaEnvironment_t* ljEnv);
 
-	jobject jstr = checkException(javaEnv);
-	if (jstr) {
-		const char * cStr;
-		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
-		fprintf(stderr, "Error. Couldn't bind java class %s : %s\n", className, cStr);
-		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
-		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
-		return 0;
+//count an exported operation that took elapsed nanoseconds, in the counters of the calling thread
+static void recordOp(ljJavaEnvironment_t* ljEnv, javaStatsOp_t op, long long elapsed, int ok)
+{
+	if (elapsed >= 0) {
+		recordThreadLatency(&getThreadState(ljEnv)->ops[op], elapsed, ok);
 	}
+}
 
-	if (classInstance == NULL) {
-		fprintf(stderr, "Error. Couldn't bind java class %s : unknown error\n", className);
+//copy a latency record, field by field as it may be updated meanwhile
+static void copyLatency(ljJavaLatency_t* copy, ljJavaLatency_t* latency)
+{
+	copy->calls = LJ_ATOMIC_LOAD_LONG(&latency->calls);
+	copy->errors = LJ_ATOMIC_LOAD_LONG(&latency->errors);
+	copy->totalNs = LJ_ATOMIC_LOAD_LONG(&latency->totalNs);
+	copy->maxNs = LJ_ATOMIC_LOAD_LONG(&latency->maxNs);
+	for (int i = 0; i < LJ_STATS_BUCKETS; i++) {
+		copy->buckets[i] = LJ_ATOMIC_LOAD_LONG(&latency->buckets[i]);
 	}
+}
 
-	classInterface->classObject = (*javaEnv)->NewGlobalRef(javaEnv, classInstance);
-	(*javaEnv)->DeleteLocalRef(javaEnv, classInstance);
+//add a latency record to a sum, field by field as it may be updated meanwhile
+static void addLatency(ljJavaLatency_t* sum, ljJavaLatency_t* latency)
+{
+	long long max = LJ_ATOMIC_LOAD_LONG(&latency->maxNs);
 
-	return 1;
+	sum->calls += LJ_ATOMIC_LOAD_LONG(&latency->calls);
+	sum->errors += LJ_ATOMIC_LOAD_LONG(&latency->errors);
+	sum->totalNs += LJ_ATOMIC_LOAD_LONG(&latency->totalNs);
+	if (max > sum->maxNs) {
+		sum->maxNs = max;
+	}
+	for (int i = 0; i < LJ_STATS_BUCKETS; i++) {
+		sum->buckets[i] += LJ_ATOMIC_LOAD_LONG(&latency->buckets[i]);
+	}
 }
 
-// release a java class handle
-void internal_javaReleaseClass(ljJavaClass_t* classInterface) {
-	JNIEnv * javaEnv = ((ljJavaEnvironment_t*)classInterface->ljEnv)->javaEnv;
-	(*javaEnv)->DeleteGlobalRef(javaEnv, classInterface->classObject);
-}
+/***************************************************************
+      THREAD STATES
+****************************************************************/
 
-// utility function to transform vararg list into an array of java objects
-//  that can be fed to a java method or constructor
-jobjectArray getjavaArgs(JNIEnv * javaEnv, int nArgs, va_list valist) {
-	char param_char;
-	short param_short;
-	int param_int;
-	long param_long;
-	double param_double;
-	const char* param_string;
-	ljJavaObject_t* param_object;
+//release what a thread state holds, popping its scopes and flushing its releases
+// when the JVM is still running
+static void releaseThreadState(ljThreadState_t* state, int jvmRunning);
 
-	jobject paramJObject;
+//list a thread state in its environment, for statistics to go through every thread
+static void registerThreadState(ljThreadState_t* state)
+{
+	ljJavaEnvironment_t* ljEnv = state->ljEnv;
+
+	//counters left from a previous environment are dropped
+	memset(state->ops, 0, sizeof(state->ops));
+	LJ_MUTEX_LOCK(&ljEnv->threadLock);
+	state->previousState = NULL;
+	state->nextState = ljEnv->threadStates;
+	if (ljEnv->threadStates != NULL) {
+		ljEnv->threadStates->previousState = state;
+	}
+	ljEnv->threadStates = state;
+	LJ_MUTEX_UNLOCK(&ljEnv->threadLock);
+}
 
-	jobjectArray javaArgArray;
-	javaArgType_t curType = JTYPE_NONE;
+//remove a thread state from the list of its environment, which keeps its operation counters
+static void unregisterThreadState(ljThreadState_t* state)
+{
+	ljJavaEnvironment_t* ljEnv = state->ljEnv;
 
-	javaArgArray = (*javaEnv)->NewObjectArray(javaEnv, nArgs/2, java_lang_object, NULL);
+	LJ_MUTEX_LOCK(&ljEnv->threadLock);
+	for (int op = 0; op < JSTATS_OP_COUNT; op++) {
+		addLatency(&ljEnv->ops[op], &state->ops[op]);
+	}
+	if (state->previousState != NULL) {
+		state->previousState->nextState = state->nextState;
+	} else {
+		ljEnv->threadStates = state->nextState;
+	}
+	if (state->nextState != NULL) {
+		state->nextState->previousState = state->previousState;
+	}
+	state->previousState = NULL;
+	state->nextState = NULL;
+	LJ_MUTEX_UNLOCK(&ljEnv->threadLock);
+}
 
-	for (int i = 0; i < nArgs; i++) {
-		if (curType == JTYPE_NONE) {
-			curType = va_arg(valist, javaArgType_t);
-		}
-		else {
-			switch (curType) {
-			case JTYPE_BYTE:
-				param_char = va_arg(valist, char);
-				paramJObject = (*javaEnv)->NewObject(javaEnv, java_byte_class, java_new_byte, param_char);
-				break;
-			case JTYPE_SHORT:
-				param_short = va_arg(valist, short);
-				paramJObject = (*javaEnv)->NewObject(javaEnv, java_short_class, java_new_short, param_short);
-				break;
-			case JTYPE_INT:
-				param_int = va_arg(valist, int);
-				paramJObject = (*javaEnv)->NewObject(javaEnv, java_int_class, java_new_int, param_int);
-				break;
-			case JTYPE_LONG:
-				param_long = va_arg(valist, long);
-				paramJObject = (*javaEnv)->NewObject(javaEnv, java_long_class, java_new_long, param_long);
-				break;
-			case JTYPE_FLOAT:
-				param_double = va_arg(valist, double);
-				paramJObject = (*javaEnv)->NewObject(javaEnv, java_float_class, java_new_float, (float) param_double);
-				break;
-			case JTYPE_DOUBLE:
-				param_double = va_arg(valist, double);
-				paramJObject = (*javaEnv)->NewObject(javaEnv, java_double_class, java_new_double, param_double);
-				break;
-			case JTYPE_BOOLEAN:
-				param_char = va_arg(valist, char);
-				paramJObject = (*javaEnv)->NewObject(javaEnv, java_boolean_class, java_new_boolean, param_char);
-				break;
-			case JTYPE_CHAR:
-				param_char = va_arg(valist, char);
-				paramJObject = (*javaEnv)->NewObject(javaEnv, java_byte_class, java_new_byte, param_char);
-				break;
-			case JTYPE_STRING:
-				param_string = va_arg(valist, const char*);
-				paramJObject = (jobject)(*javaEnv)->NewStringUTF(javaEnv, param_string);
-				break;
-			case JTYPE_OBJECT:
-				param_object = va_arg(valist, ljJavaObject_t*);
-				paramJObject = param_object->object;
-				break;
-			default:
-				fprintf(stderr, "java new => unrecognized parameter type\n");
-				va_end(valist);
-				return NULL;
+//detach every thread state from an ending environment, so that they are rebound on their next call.
+// When the JVM keeps running, the global references queued by other threads are deleted now,
+// as any thread may delete them, and their open local frames are left to their own thread,
+// which pops them on its next call, or at its exit by being detached.
+// Other threads must have no call in flight once the environment ends
+static void forgetThreadStates(ljJavaEnvironment_t* ljEnv, JNIEnv * javaEnv, int jvmRunning)
+{
+	ljThreadState_t* state;
+	ljThreadState_t* next;
+
+	LJ_MUTEX_LOCK(&ljEnv->threadLock);
+	for (state = ljEnv->threadStates; state != NULL; state = next) {
+		next = state->nextState;
+		if (jvmRunning) {
+			for (int i = 0; i < state->releaseQueueCount; i++) {
+				(*javaEnv)->DeleteGlobalRef(javaEnv, state->releaseQueue[i]);
 			}
-			(*javaEnv)->SetObjectArrayElement(javaEnv, javaArgArray,
-				i / 2, paramJObject);
-			//TODO: remove ref depending if local or global ref cf GetObjectRefType
-			//(*javaEnv)->DeleteLocalRef(javaEnv, paramJObject);
-			curType = JTYPE_NONE;
+			state->releaseQueueCount = 0;
+			state->orphanFrames = state->scopeDepth;
 		}
+		state->ljEnv = NULL;
+		state->previousState = NULL;
+		state->nextState = NULL;
 	}
-	va_end(valist);
-
-	return javaArgArray;
+	ljEnv->threadStates = NULL;
+	LJ_MUTEX_UNLOCK(&ljEnv->threadLock);
 }
 
-// utility function to release the array of java arguments created in the previous method
-void releasejavaArgs(JNIEnv * javaEnv, jobjectArray javaArgArray) {
-	jobject curJObject;
+//detach a thread attached by luajitjava when it exits
+static void threadExit(void* data)
+{
+	ljThreadState_t* state = (ljThreadState_t*)data;
+	JavaVM* jvm = runningJvm;
+	int running;
 
-	for (int i = 0; i < (*javaEnv)->GetArrayLength(javaEnv, javaArgArray); i++) {
-		curJObject = (*javaEnv)->GetObjectArrayElement(javaEnv, javaArgArray, i);
-		(*javaEnv)->DeleteLocalRef(javaEnv, curJObject);
+	if (state == NULL) {
+		return;
 	}
-	(*javaEnv)->DeleteLocalRef(javaEnv, javaArgArray);
+	running = jvm != NULL && state->ljEnv != NULL && state->ljEnv == sharedEnvironment;
+	releaseThreadState(state, running);
+	if (running) {
+		unregisterThreadState(state);
+	}
+	if (jvm != NULL && state->attached) {
+		(*jvm)->DetachCurrentThread(jvm);
+	}
+	free(state);
 }
 
-// lua called method to instantiate an object from a specified class,
-//  using provided constructor arguments
-int internal_javaNew(ljJavaObject_t* objectInterface, ljJavaClass_t* classInterface, int nArgs, va_list valist)
+#ifdef _WIN32
+static VOID WINAPI threadExitCallback(PVOID data)
 {
-	jobject newObject;
-	jobject classInstance;
-	JNIEnv * javaEnv;
+	threadExit(data);
+}
+#else
+static void createThreadExitKey(void)
+{
+	pthread_key_create(&threadExitKey, threadExit);
+}
+#endif
 
-	javaEnv = ((ljJavaEnvironment_t*)classInterface->ljEnv)->javaEnv;
-	(*javaEnv)->ExceptionClear(javaEnv);
+//make sure threads attached by luajitjava will be detached at exit
+static void initThreadExit(void)
+{
+#ifdef _WIN32
+	if (threadExitIndex == FLS_OUT_OF_INDEXES) {
+		threadExitIndex = FlsAlloc(threadExitCallback);
+	}
+#else
+	pthread_once(&threadExitKeyOnce, createThreadExitKey);
+#endif
+}
 
-	//get java params from args
-	jobjectArray javaArgArray = getjavaArgs(javaEnv, nArgs, valist);
+//create the state of the current thread, for a jni environment given or looked for
+static ljThreadState_t* newThreadState(ljJavaEnvironment_t* ljEnv, JNIEnv* javaEnv)
+{
+	ljThreadState_t* state;
+	int attached = 0;
+
+	if (javaEnv == NULL) {
+		jint status = (*ljEnv->jvm)->GetEnv(ljEnv->jvm, (void**)&javaEnv, JNI_VERSION_1_8);
+		if (status == JNI_EDETACHED) {
+			//daemon threads do not keep the JVM from being destroyed
+			status = (*ljEnv->jvm)->AttachCurrentThreadAsDaemon(ljEnv->jvm, (void**)&javaEnv, NULL);
+			attached = 1;
+		}
+		if (status != JNI_OK) {
+			fprintf(stderr, "Error. Couldn't attach thread to the java VM : %d\n", (int)status);
+			return NULL;
+		}
+	}
 
-	//check given class interface
-	classInstance = (jobject) classInterface->classObject;
-	if ((*javaEnv)->IsInstanceOf(javaEnv, classInstance, java_lang_class) == JNI_FALSE)
-	{
-		fprintf(stderr, "Class interface does not seem to contain a class instance\n");
-		return 0;
+	state = calloc(1, sizeof(ljThreadState_t));
+	state->ljEnv = ljEnv;
+	state->javaEnv = javaEnv;
+	state->attached = attached;
+	registerThreadState(state);
+	currentThreadState = state;
+	if (attached) {
+#ifdef _WIN32
+		FlsSetValue(threadExitIndex, state);
+#else
+		pthread_setspecific(threadExitKey, state);
+#endif
 	}
+	return state;
+}
 
-	//create new object through our binding java class
-	newObject = (*javaEnv)->CallStaticObjectMethod(javaEnv, luajitjava_binding_class, luajitjava_java_new, classInstance, javaArgArray);
-	releasejavaArgs(javaEnv, javaArgArray);
+//get the state of the current thread, attaching it to the JVM on its first call
+static ljThreadState_t* getThreadState(ljJavaEnvironment_t* ljEnv)
+{
+	ljThreadState_t* state = currentThreadState;
 
-	/* Handles exception */
-	jobject jstr = checkException(javaEnv);
-	if (jstr) {
-		const char * cStr;
-		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
-		fprintf(stderr, "Error. Couldn't create object : %s\n", cStr);
-		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
-		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
-		return 0;
+	if (state != NULL && state->ljEnv == ljEnv) {
+		return state;
 	}
-
-	if (newObject == NULL)
-	{
-		fprintf(stderr, "Error. Couldn't create object : unknown reason\n");
+	if (state != NULL) {
+		//left over from an environment that has ended, its queued releases already deleted
+		while (state->orphanFrames > 0) {
+			(*state->javaEnv)->PopLocalFrame(state->javaEnv, NULL);
+			state->orphanFrames--;
+		}
+		releaseThreadState(state, 0);
+		state->ljEnv = ljEnv;
+		registerThreadState(state);
+		return state;
 	}
-
-	objectInterface->object = (*javaEnv)->NewGlobalRef(javaEnv, newObject);
-	(*javaEnv)->DeleteLocalRef(javaEnv, newObject);
-	return 1;
+	return newThreadState(ljEnv, NULL);
 }
 
-// lua called method to release a java object handle
-void internal_javaReleaseObject(ljJavaObject_t* objectInterface) {
-	JNIEnv * javaEnv = ((ljJavaEnvironment_t*)objectInterface->ljEnv)->javaEnv;
-	(*javaEnv)->DeleteGlobalRef(javaEnv, objectInterface->object);
+//get the jni environment of the current thread
+static JNIEnv* getJavaEnv(ljJavaEnvironment_t* ljEnv)
+{
+	ljThreadState_t* state = getThreadState(ljEnv);
+	return state != NULL ? state->javaEnv : NULL;
 }
 
-// method to look for a static field in a class
-ljJavaObject_t* internal_javaCheckClassField(ljJavaClass_t* classInterface, const char * key)
-{
-	JNIEnv * javaEnv;
-	jclass containerClass;
-	jstring str;
-	jobject eventualField;
-	ljJavaObject_t* returnObject;
+/***************************************************************
+      SYMBOL TABLE
+****************************************************************/
 
-	javaEnv = ((ljJavaEnvironment_t*)classInterface->ljEnv)->javaEnv;
-	(*javaEnv)->ExceptionClear(javaEnv);
-	containerClass = (jobject)classInterface->classObject;
+//hash of a symbol name
+static unsigned int hashSymbol(const char* name) {
+	unsigned int hash = 2166136261u;
 
-	str = (*javaEnv)->NewStringUTF(javaEnv, key);
-	eventualField = (*javaEnv)->CallStaticObjectMethod(javaEnv, luajitjava_binding_class, luajitjava_check_field, containerClass, str);
-	(*javaEnv)->DeleteLocalRef(javaEnv, str);
-	/* Handles exception */
-	jobject jstr = checkException(javaEnv);
-	if (jstr) {
-		const char * cStr;
-		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
-		fprintf(stderr, "Error. excpetion while getting index of object : %s\n", cStr);
-		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
-		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
-		return 0;
+	for (const char* c = name; *c != '\0'; c++) {
+		hash = (hash ^ (unsigned char)*c) * 16777619u;
 	}
+	return hash;
+}
 
-	if (eventualField != NULL) {
-		returnObject = malloc(sizeof(ljJavaObject_t));
-		returnObject->ljEnv = classInterface->ljEnv;
-		returnObject->object = (*javaEnv)->NewGlobalRef(javaEnv, eventualField);
-		(*javaEnv)->DeleteLocalRef(javaEnv, eventualField);
-		return returnObject;
+//look for an already interned symbol
+static ljSymbolEntry_t* lookupSymbol(ljJavaEnvironment_t* ljEnv, const char* name, unsigned int hash)
+{
+	ljSymbolEntry_t* entry;
+
+	for (entry = LJ_ATOMIC_LOAD_PTR(&ljEnv->symbols[hash % LJ_SYMBOL_TABLE_SIZE]); entry != NULL; entry = entry->next) {
+		if (entry->hash == hash && strcmp(entry->name, name) == 0) {
+			return entry;
+		}
 	}
 	return NULL;
 }
 
-// lua called method to look for a static method in a class corresponding to provided args
-//  then run it and return the object result
-ljJavaObject_t* internal_javaRunClassMethod(ljJavaClass_t* classInterface, const char * methodName, int nArgs, ...)
+//java string of a method name or field key, created on first use and kept for the environment lifetime
+// so that calls going through the LuaJitJavaAPI proxies do not create it each time.
+// The reference belongs to the symbol table and must not be deleted
+static jstring internSymbol(ljJavaEnvironment_t* ljEnv, JNIEnv * javaEnv, const char* name)
 {
-	JNIEnv * javaEnv;
-	jclass containerClass;
+	unsigned int hash = hashSymbol(name);
+	ljSymbolEntry_t* entry = lookupSymbol(ljEnv, name, hash);
+	size_t nameLength;
 	jstring str;
-	jobject resultObj;
-	ljJavaObject_t* returnObject;
 
-	javaEnv = ((ljJavaEnvironment_t*)classInterface->ljEnv)->javaEnv;
-	(*javaEnv)->ExceptionClear(javaEnv);
-	containerClass = (jobject)classInterface->classObject;
+	if (entry != NULL) {
+		return entry->symbol;
+	}
+	LJ_MUTEX_LOCK(&ljEnv->symbolLock);
+	entry = lookupSymbol(ljEnv, name, hash);
+	if (entry == NULL) {
+		str = (*javaEnv)->NewStringUTF(javaEnv, name);
+		if (str == NULL) {
+			LJ_MUTEX_UNLOCK(&ljEnv->symbolLock);
+			return NULL;
+		}
+		nameLength = strlen(name) + 1;
+		entry = calloc(1, sizeof(ljSymbolEntry_t) + nameLength);
+		entry->name = (char*)(entry + 1);
+		memcpy(entry->name, name, nameLength);
+		entry->hash = hash;
+		entry->symbol = (*javaEnv)->NewGlobalRef(javaEnv, str);
+		(*javaEnv)->DeleteLocalRef(javaEnv, str);
+		//publish the entry only once complete, readers walk the bucket without locking
+		entry->next = ljEnv->symbols[hash % LJ_SYMBOL_TABLE_SIZE];
+		LJ_ATOMIC_STORE_PTR(&ljEnv->symbols[hash % LJ_SYMBOL_TABLE_SIZE], entry);
+	}
+	LJ_MUTEX_UNLOCK(&ljEnv->symbolLock);
+	return entry->symbol;
+}
 
-	//get java params from args
-	va_list valist;
-	va_start(valist, nArgs);
-	jobjectArray javaArgArray = getjavaArgs(javaEnv, nArgs, valist);
+//release all interned symbols of an environment
+static void releaseSymbols(ljJavaEnvironment_t* ljEnv)
+{
+	JNIEnv * javaEnv = getJavaEnv(ljEnv);
+	ljSymbolEntry_t* entry;
+	ljSymbolEntry_t* next;
+
+	for (int bucket = 0; bucket < LJ_SYMBOL_TABLE_SIZE; bucket++) {
+		for (entry = ljEnv->symbols[bucket]; entry != NULL; entry = next) {
+			next = entry->next;
+			(*javaEnv)->DeleteGlobalRef(javaEnv, entry->symbol);
+			free(entry);
+		}
+		ljEnv->symbols[bucket] = NULL;
+	}
+}
+
+/***************************************************************
+      CLASS REGISTRY
+****************************************************************/
+
+//hash of a class reference, for the lookup of registered classes from their handles
+static unsigned int hashClassRef(jclass clazz) {
+	return (unsigned int)(((size_t)clazz >> 3) * 2654435761u);
+}
+
+//look for a class already registered under a name
+static ljClassEntry_t* lookupClass(ljJavaEnvironment_t* ljEnv, const char* name, unsigned int hash)
+{
+	ljClassEntry_t* entry;
+
+	for (entry = LJ_ATOMIC_LOAD_PTR(&ljEnv->classes[hash % LJ_CLASS_REGISTRY_SIZE]); entry != NULL; entry = entry->next) {
+		if (entry->hash == hash && strcmp(entry->name, name) == 0) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+//registry entry owning a class reference, NULL for references that do not come from the registry.
+// References are compared as pointers, without any jni call
+static ljClassEntry_t* findRegisteredClass(ljJavaEnvironment_t* ljEnv, jclass clazz)
+{
+	ljClassEntry_t* entry;
+
+	for (entry = LJ_ATOMIC_LOAD_PTR(&ljEnv->classRefs[hashClassRef(clazz) % LJ_CLASS_REGISTRY_SIZE]); entry != NULL; entry = entry->nextByRef) {
+		if (entry->clazz == clazz) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+//identity hash of a class, the same whatever the reference to it
+static jint classIdentityHash(JNIEnv * javaEnv, jclass clazz)
+{
+	return (*javaEnv)->CallStaticIntMethod(javaEnv, java_lang_system, java_lang_system_identity_hash, clazz);
+}
+
+//look for the entry of a class by identity hash, references being compared only for a same hash
+static ljClassEntry_t* lookupClassIdentity(ljJavaEnvironment_t* ljEnv, JNIEnv * javaEnv, jclass clazz, jint identityHash)
+{
+	ljClassEntry_t* entry;
+
+	for (entry = LJ_ATOMIC_LOAD_PTR(&ljEnv->classIds[(unsigned int)identityHash % LJ_CLASS_REGISTRY_SIZE]); entry != NULL; entry = entry->nextById) {
+		if (entry->identityHash == identityHash && (*javaEnv)->IsSameObject(javaEnv, entry->clazz, clazz)) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+//add the entry of a class met for the first time, listed by reference and by identity hash.
+// Called under classLock, the entry is listed by name only once bound
+static ljClassEntry_t* addClassEntry(ljJavaEnvironment_t* ljEnv, JNIEnv * javaEnv, jclass clazz, jint identityHash, const char* name)
+{
+	size_t nameLength = strlen(name) + 1;
+	ljClassEntry_t* entry = calloc(1, sizeof(ljClassEntry_t) + nameLength);
+	unsigned int idBucket = (unsigned int)identityHash % LJ_CLASS_REGISTRY_SIZE;
+	unsigned int refBucket;
+
+	entry->name = (char*)(entry + 1);
+	memcpy(entry->name, name, nameLength);
+	entry->hash = hashSymbol(name);
+	entry->identityHash = identityHash;
+	entry->clazz = (*javaEnv)->NewGlobalRef(javaEnv, clazz);
+	entry->isClass = (*javaEnv)->IsSameObject(javaEnv, clazz, java_lang_class);
+	//publish the entry only once complete, readers walk the buckets without locking
+	refBucket = hashClassRef(entry->clazz) % LJ_CLASS_REGISTRY_SIZE;
+	entry->nextByRef = ljEnv->classRefs[refBucket];
+	LJ_ATOMIC_STORE_PTR(&ljEnv->classRefs[refBucket], entry);
+	entry->nextById = ljEnv->classIds[idBucket];
+	LJ_ATOMIC_STORE_PTR(&ljEnv->classIds[idBucket], entry);
+	return entry;
+}
+
+//bind a class by name through Class.forName the first time, and return its registry entry with one more handle.
+// Classes stay registered for the environment lifetime, as the method and field caches share their reference
+static ljClassEntry_t* registerClass(ljJavaEnvironment_t* ljEnv, JNIEnv * javaEnv, const char* className)
+{
+	unsigned int hash = hashSymbol(className);
+	ljClassEntry_t* entry = lookupClass(ljEnv, className, hash);
+	jstring javaClassName;
+	jobject classInstance;
+	jint identityHash;
+
+	if (entry != NULL) {
+		LJ_ATOMIC_INCREMENT_INT(&entry->refCount);
+		return entry;
+	}
+	LJ_MUTEX_LOCK(&ljEnv->classLock);
+	entry = lookupClass(ljEnv, className, hash);
+	if (entry != NULL) {
+		LJ_ATOMIC_INCREMENT_INT(&entry->refCount);
+		LJ_MUTEX_UNLOCK(&ljEnv->classLock);
+		return entry;
+	}
+
+	javaClassName = (*javaEnv)->NewStringUTF(javaEnv, className);
+	classInstance = (*javaEnv)->CallStaticObjectMethod(javaEnv, java_lang_class,
+		java_lang_class_forname, javaClassName, JNI_TRUE, java_class_loader);
+	(*javaEnv)->DeleteLocalRef(javaEnv, javaClassName);
+
+	jobject jstr = checkException(javaEnv);
+	if (jstr) {
+		const char * cStr;
+		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
+		fprintf(stderr, "Error. Couldn't bind java class %s : %s\n", className, cStr);
+		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
+		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
+		LJ_MUTEX_UNLOCK(&ljEnv->classLock);
+		return NULL;
+	}
+	if (classInstance == NULL) {
+		fprintf(stderr, "Error. Couldn't bind java class %s : unknown error\n", className);
+		LJ_MUTEX_UNLOCK(&ljEnv->classLock);
+		return NULL;
+	}
+
+	//the class may already have been met as the class of a receiver
+	identityHash = classIdentityHash(javaEnv, classInstance);
+	entry = lookupClassIdentity(ljEnv, javaEnv, classInstance, identityHash);
+	if (entry == NULL) {
+		entry = addClassEntry(ljEnv, javaEnv, classInstance, identityHash, className);
+	}
+	(*javaEnv)->DeleteLocalRef(javaEnv, classInstance);
+	LJ_ATOMIC_INCREMENT_INT(&entry->refCount);
+	if (!entry->bound) {
+		entry->bound = 1;
+		ljEnv->registeredClasses++;
+		entry->next = ljEnv->classes[entry->hash % LJ_CLASS_REGISTRY_SIZE];
+		LJ_ATOMIC_STORE_PTR(&ljEnv->classes[entry->hash % LJ_CLASS_REGISTRY_SIZE], entry);
+	}
+	LJ_MUTEX_UNLOCK(&ljEnv->classLock);
+	return entry;
+}
+
+//entry of a class, added the first time the class is met. Registry references are found by pointer
+// without any jni call, other references by the identity hash of their class
+static ljClassEntry_t* findClassEntry(ljJavaEnvironment_t* ljEnv, JNIEnv * javaEnv, jclass clazz)
+{
+	ljClassEntry_t* entry = findRegisteredClass(ljEnv, clazz);
+	jint identityHash;
+	jstring name;
+	const char * cStr;
+
+	if (entry != NULL) {
+		return entry;
+	}
+	identityHash = classIdentityHash(javaEnv, clazz);
+	entry = lookupClassIdentity(ljEnv, javaEnv, clazz, identityHash);
+	if (entry != NULL) {
+		return entry;
+	}
+	LJ_MUTEX_LOCK(&ljEnv->classLock);
+	entry = lookupClassIdentity(ljEnv, javaEnv, clazz, identityHash);
+	if (entry == NULL) {
+		name = (jstring)(*javaEnv)->CallObjectMethod(javaEnv, clazz, java_lang_class_get_name);
+		if (name == NULL) {
+			(*javaEnv)->ExceptionClear(javaEnv);
+			entry = addClassEntry(ljEnv, javaEnv, clazz, identityHash, "");
+		} else {
+			cStr = (*javaEnv)->GetStringUTFChars(javaEnv, name, NULL);
+			entry = addClassEntry(ljEnv, javaEnv, clazz, identityHash, cStr);
+			(*javaEnv)->ReleaseStringUTFChars(javaEnv, name, cStr);
+			(*javaEnv)->DeleteLocalRef(javaEnv, name);
+		}
+	}
+	LJ_MUTEX_UNLOCK(&ljEnv->classLock);
+	return entry;
+}
+
+//entry of the class members of a receiver are looked for in.
+// Class objects are looked into as classes, as the java proxy does, classReceiver being set for them
+static ljClassEntry_t* findReceiverClass(ljJavaEnvironment_t* ljEnv, JNIEnv * javaEnv, jobject receiver, int* classReceiver)
+{
+	ljClassEntry_t* entry;
+	jclass clazz;
+
+	if (*classReceiver) {
+		return findClassEntry(ljEnv, javaEnv, receiver);
+	}
+	clazz = (*javaEnv)->GetObjectClass(javaEnv, receiver);
+	entry = findClassEntry(ljEnv, javaEnv, clazz);
+	(*javaEnv)->DeleteLocalRef(javaEnv, clazz);
+	if (entry->isClass) {
+		*classReceiver = 1;
+		return findClassEntry(ljEnv, javaEnv, receiver);
+	}
+	return entry;
+}
+
+//release all classes of an environment, once caches are released
+static void releaseClassRegistry(ljJavaEnvironment_t* ljEnv)
+{
+	JNIEnv * javaEnv = getJavaEnv(ljEnv);
+	ljClassEntry_t* entry;
+	ljClassEntry_t* next;
+
+	for (int bucket = 0; bucket < LJ_CLASS_REGISTRY_SIZE; bucket++) {
+		ljEnv->classes[bucket] = NULL;
+		ljEnv->classIds[bucket] = NULL;
+	}
+	for (int bucket = 0; bucket < LJ_CLASS_REGISTRY_SIZE; bucket++) {
+		for (entry = ljEnv->classRefs[bucket]; entry != NULL; entry = next) {
+			next = entry->nextByRef;
+			(*javaEnv)->DeleteGlobalRef(javaEnv, entry->clazz);
+			free(entry);
+		}
+		ljEnv->classRefs[bucket] = NULL;
+	}
+}
+
+/***************************************************************
+      RESOLVED METHOD CACHE
+****************************************************************/
+
+//hash of a method or field cache key, the receiver class being given by its registry reference
+// so that a same class always hashes and compares as a same pointer
+static unsigned int hashMemberKey(jclass clazz, int classReceiver, const char* methodName, int nArgs, const javaArgType_t* argTypes) {
+	unsigned int hash = hashClassRef(clazz);
+	const char* c;
+
+	for (c = methodName; *c != '\0'; c++) {
+		hash = (hash ^ (unsigned char)*c) * 16777619u;
+	}
+	for (int i = 0; i < nArgs; i++) {
+		hash = (hash ^ (unsigned int)argTypes[i]) * 16777619u;
+	}
+	hash = (hash ^ (unsigned int)nArgs) * 16777619u;
+	return (hash ^ (unsigned int)classReceiver) * 16777619u;
+}
+
+//look for an already resolved method
+static ljMethodCacheEntry_t* lookupMethod(ljJavaEnvironment_t* ljEnv, jclass clazz, int classReceiver,
+	const char* methodName, int nArgs, const javaArgType_t* argTypes, unsigned int hash)
+{
+	ljMethodCacheEntry_t* entry;
+
+	for (entry = LJ_ATOMIC_LOAD_PTR(&ljEnv->methodCache[hash % LJ_METHOD_CACHE_SIZE]); entry != NULL; entry = entry->next) {
+		if (entry->hash != hash || entry->clazz != clazz || entry->classReceiver != classReceiver || entry->nArgs != nArgs) {
+			continue;
+		}
+		if (memcmp(entry->argTypes, argTypes, nArgs * sizeof(javaArgType_t)) == 0 && strcmp(entry->name, methodName) == 0) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+//resolve a method through LuaJitJavaAPI.resolveMethod and store it in the cache
+// unresolved methods are cached as well, so that the resolution is only tried once.
+// Constructors are resolved through LuaJitJavaAPI.resolveConstructor under LJ_CONSTRUCTOR_NAME
+static ljMethodCacheEntry_t* resolveMethod(ljJavaEnvironment_t* ljEnv, jclass clazz, int classReceiver,
+	const char* methodName, int nArgs, const javaArgType_t* argTypes, unsigned int hash)
+{
+	JNIEnv * javaEnv = getJavaEnv(ljEnv);
+	ljMethodCacheEntry_t* entry;
+	size_t nameLength = strlen(methodName) + 1;
+	int isConstructor = strcmp(methodName, LJ_CONSTRUCTOR_NAME) == 0;
+	jint javaArgTypes[LJ_MAX_ARGS];
+	jintArray javaArgTypeArray;
+	jstring str;
+	jobject method;
+	jobjectArray paramTypes;
+	jobject paramType;
+	jint info;
+
+	entry = calloc(1, sizeof(ljMethodCacheEntry_t) + nArgs * (sizeof(javaArgType_t) + sizeof(jclass)) + nameLength);
+	entry->argClasses = (jclass*)(entry + 1);
+	entry->argTypes = (javaArgType_t*)(entry->argClasses + nArgs);
+	entry->name = (char*)(entry->argTypes + nArgs);
+	memcpy(entry->argTypes, argTypes, nArgs * sizeof(javaArgType_t));
+	memcpy(entry->name, methodName, nameLength);
+	entry->hash = hash;
+	entry->classReceiver = classReceiver;
+	entry->nArgs = nArgs;
+
+	for (int i = 0; i < nArgs; i++) {
+		javaArgTypes[i] = argTypes[i];
+	}
+	javaArgTypeArray = (*javaEnv)->NewIntArray(javaEnv, nArgs);
+	(*javaEnv)->SetIntArrayRegion(javaEnv, javaArgTypeArray, 0, nArgs, javaArgTypes);
+	if (isConstructor) {
+		method = (*javaEnv)->CallStaticObjectMethod(javaEnv, luajitjava_binding_class, luajitjava_resolve_constructor,
+			clazz, javaArgTypeArray);
+	} else {
+		str = internSymbol(ljEnv, javaEnv, methodName);
+		method = (*javaEnv)->CallStaticObjectMethod(javaEnv, luajitjava_binding_class, luajitjava_resolve_method,
+			clazz, str, javaArgTypeArray, classReceiver ? JNI_TRUE : JNI_FALSE);
+	}
+	(*javaEnv)->DeleteLocalRef(javaEnv, javaArgTypeArray);
+
+	/* Handles exception */
+	jobject jstr = checkException(javaEnv);
+	if (jstr) {
+		const char * cStr;
+		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
+		fprintf(stderr, "Error. exception while resolving method %s : %s\n", methodName, cStr);
+		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
+		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
+		method = NULL;
+	}
+
+	if (method != NULL && isConstructor) {
+		entry->returnType = JTYPE_OBJECT;
+		entry->methodID = (*javaEnv)->FromReflectedMethod(javaEnv, method);
+		paramTypes = (*javaEnv)->CallObjectMethod(javaEnv, method, java_constructor_get_parameter_types);
+	} else if (method != NULL) {
+		info = (*javaEnv)->CallStaticIntMethod(javaEnv, luajitjava_binding_class, luajitjava_method_info, method);
+		entry->isStatic = (info & LJ_METHOD_STATIC) != 0;
+		entry->returnType = (javaArgType_t)(info & LJ_METHOD_TYPE_MASK);
+		entry->valueReturn = (info & LJ_METHOD_VALUE) != 0;
+		entry->methodID = (*javaEnv)->FromReflectedMethod(javaEnv, method);
+		if (entry->isStatic) {
+			jclass declaringClass = (*javaEnv)->CallObjectMethod(javaEnv, method, java_method_get_declaring_class);
+			entry->declaringClass = (*javaEnv)->NewGlobalRef(javaEnv, declaringClass);
+			(*javaEnv)->DeleteLocalRef(javaEnv, declaringClass);
+		}
+		paramTypes = (*javaEnv)->CallObjectMethod(javaEnv, method, java_method_get_parameter_types);
+	}
+	if (method != NULL) {
+		//keep the classes of object parameters, jni does not check them for us
+		for (int i = 0; i < nArgs; i++) {
+			if (argTypes[i] == JTYPE_OBJECT) {
+				paramType = (*javaEnv)->GetObjectArrayElement(javaEnv, paramTypes, i);
+				entry->argClasses[i] = (*javaEnv)->NewGlobalRef(javaEnv, paramType);
+				(*javaEnv)->DeleteLocalRef(javaEnv, paramType);
+			}
+		}
+		(*javaEnv)->DeleteLocalRef(javaEnv, paramTypes);
+		(*javaEnv)->DeleteLocalRef(javaEnv, method);
+	}
+
+	entry->clazz = clazz;
+	//publish the entry only once complete, readers walk the bucket without locking
+	entry->next = ljEnv->methodCache[hash % LJ_METHOD_CACHE_SIZE];
+	LJ_ATOMIC_STORE_PTR(&ljEnv->methodCache[hash % LJ_METHOD_CACHE_SIZE], entry);
+	return entry;
+}
+
+//release all resolved methods of an environment
+static void releaseMethodCache(ljJavaEnvironment_t* ljEnv)
+{
+	JNIEnv * javaEnv = getJavaEnv(ljEnv);
+	ljMethodCacheEntry_t* entry;
+	ljMethodCacheEntry_t* next;
+
+	for (int bucket = 0; bucket < LJ_METHOD_CACHE_SIZE; bucket++) {
+		for (entry = ljEnv->methodCache[bucket]; entry != NULL; entry = next) {
+			next = entry->next;
+			for (int i = 0; i < entry->nArgs; i++) {
+				if (entry->argClasses[i] != NULL) {
+					(*javaEnv)->DeleteGlobalRef(javaEnv, entry->argClasses[i]);
+				}
+			}
+			if (entry->declaringClass != NULL) {
+				(*javaEnv)->DeleteGlobalRef(javaEnv, entry->declaringClass);
+			}
+			free(entry);
+		}
+		ljEnv->methodCache[bucket] = NULL;
+	}
+}
+
+//check object arguments against the parameter classes of a resolved method
+static int checkMethodArgs(JNIEnv * javaEnv, ljMethodCacheEntry_t* entry, const jvalue* values) {
+	for (int i = 0; i < entry->nArgs; i++) {
+		if (entry->argClasses[i] != NULL && values[i].l != NULL
+			&& !(*javaEnv)->IsInstanceOf(javaEnv, values[i].l, entry->argClasses[i])) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+//box a primitive java value, references are returned as they are
+static jobject boxJavaValue(JNIEnv * javaEnv, javaArgType_t type, jvalue value) {
+	switch (type) {
+	case JTYPE_NONE:
+		return NULL;
+	case JTYPE_BYTE:
+		return (*javaEnv)->NewObject(javaEnv, java_byte_class, java_new_byte, value.b);
+	case JTYPE_SHORT:
+		return (*javaEnv)->NewObject(javaEnv, java_short_class, java_new_short, value.s);
+	case JTYPE_INT:
+		return (*javaEnv)->NewObject(javaEnv, java_int_class, java_new_int, value.i);
+	case JTYPE_LONG:
+		return (*javaEnv)->NewObject(javaEnv, java_long_class, java_new_long, value.j);
+	case JTYPE_FLOAT:
+		return (*javaEnv)->NewObject(javaEnv, java_float_class, java_new_float, value.f);
+	case JTYPE_DOUBLE:
+		return (*javaEnv)->NewObject(javaEnv, java_double_class, java_new_double, value.d);
+	case JTYPE_BOOLEAN:
+		return (*javaEnv)->NewObject(javaEnv, java_boolean_class, java_new_boolean, value.z);
+	case JTYPE_CHAR:
+		return (*javaEnv)->NewObject(javaEnv, java_char_class, java_new_char, value.c);
+	default:
+		return value.l;
+	}
+}
+
+//give the type of a java object, boxed primitives and strings being recognized.
+// Those classes are all final, so that the class of an object is compared to them
+// by identity, most common types first, instead of through subtype checks
+static javaArgType_t classifyJavaObject(JNIEnv * javaEnv, jobject object) {
+	jclass objectClass;
+	javaArgType_t type = JTYPE_OBJECT;
+
+	if (object == NULL) {
+		return JTYPE_NONE;
+	}
+	objectClass = (*javaEnv)->GetObjectClass(javaEnv, object);
+	for (int i = 0; i < LJ_BOXED_TYPE_COUNT; i++) {
+		if ((*javaEnv)->IsSameObject(javaEnv, objectClass, java_boxed_types[i].clazz)) {
+			type = java_boxed_types[i].type;
+			break;
+		}
+	}
+	(*javaEnv)->DeleteLocalRef(javaEnv, objectClass);
+	return type;
+}
+
+//unbox a boxed primitive of a type given by classifyJavaObject
+static jvalue unboxJavaObject(JNIEnv * javaEnv, javaArgType_t type, jobject object) {
+	jvalue value;
+
+	value.j = 0;
+	switch (type) {
+	case JTYPE_BYTE:
+		value.b = (jbyte)(*javaEnv)->CallIntMethod(javaEnv, object, java_byte_value);
+		break;
+	case JTYPE_SHORT:
+		value.s = (jshort)(*javaEnv)->CallIntMethod(javaEnv, object, java_short_value);
+		break;
+	case JTYPE_INT:
+		value.i = (*javaEnv)->CallIntMethod(javaEnv, object, java_int_value);
+		break;
+	case JTYPE_LONG:
+		value.j = (*javaEnv)->CallLongMethod(javaEnv, object, java_long_value);
+		break;
+	case JTYPE_FLOAT:
+		value.f = (*javaEnv)->CallFloatMethod(javaEnv, object, java_float_value);
+		break;
+	case JTYPE_DOUBLE:
+		value.d = (*javaEnv)->CallDoubleMethod(javaEnv, object, java_double_value);
+		break;
+	case JTYPE_BOOLEAN:
+		value.z = (*javaEnv)->CallBooleanMethod(javaEnv, object, java_boolean_value);
+		break;
+	case JTYPE_CHAR:
+		value.c = (*javaEnv)->CallCharMethod(javaEnv, object, java_char_value);
+		break;
+	default:
+		value.l = object;
+		break;
+	}
+	return value;
+}
+
+//call a method id through the jni call function matching its return type
+static jvalue callMethodID(JNIEnv * javaEnv, jclass clazz, jmethodID methodID, int isStatic, javaArgType_t returnType,
+	jobject receiver, const jvalue* values)
+{
+	jvalue result;
+
+	result.j = 0;
+	if (isStatic) {
+		switch (returnType) {
+		case JTYPE_NONE:
+			(*javaEnv)->CallStaticVoidMethodA(javaEnv, clazz, methodID, values);
+			break;
+		case JTYPE_BYTE:
+			result.b = (*javaEnv)->CallStaticByteMethodA(javaEnv, clazz, methodID, values);
+			break;
+		case JTYPE_SHORT:
+			result.s = (*javaEnv)->CallStaticShortMethodA(javaEnv, clazz, methodID, values);
+			break;
+		case JTYPE_INT:
+			result.i = (*javaEnv)->CallStaticIntMethodA(javaEnv, clazz, methodID, values);
+			break;
+		case JTYPE_LONG:
+			result.j = (*javaEnv)->CallStaticLongMethodA(javaEnv, clazz, methodID, values);
+			break;
+		case JTYPE_FLOAT:
+			result.f = (*javaEnv)->CallStaticFloatMethodA(javaEnv, clazz, methodID, values);
+			break;
+		case JTYPE_DOUBLE:
+			result.d = (*javaEnv)->CallStaticDoubleMethodA(javaEnv, clazz, methodID, values);
+			break;
+		case JTYPE_BOOLEAN:
+			result.z = (*javaEnv)->CallStaticBooleanMethodA(javaEnv, clazz, methodID, values);
+			break;
+		case JTYPE_CHAR:
+			result.c = (*javaEnv)->CallStaticCharMethodA(javaEnv, clazz, methodID, values);
+			break;
+		default:
+			result.l = (*javaEnv)->CallStaticObjectMethodA(javaEnv, clazz, methodID, values);
+			break;
+		}
+	} else {
+		switch (returnType) {
+		case JTYPE_NONE:
+			(*javaEnv)->CallVoidMethodA(javaEnv, receiver, methodID, values);
+			break;
+		case JTYPE_BYTE:
+			result.b = (*javaEnv)->CallByteMethodA(javaEnv, receiver, methodID, values);
+			break;
+		case JTYPE_SHORT:
+			result.s = (*javaEnv)->CallShortMethodA(javaEnv, receiver, methodID, values);
+			break;
+		case JTYPE_INT:
+			result.i = (*javaEnv)->CallIntMethodA(javaEnv, receiver, methodID, values);
+			break;
+		case JTYPE_LONG:
+			result.j = (*javaEnv)->CallLongMethodA(javaEnv, receiver, methodID, values);
+			break;
+		case JTYPE_FLOAT:
+			result.f = (*javaEnv)->CallFloatMethodA(javaEnv, receiver, methodID, values);
+			break;
+		case JTYPE_DOUBLE:
+			result.d = (*javaEnv)->CallDoubleMethodA(javaEnv, receiver, methodID, values);
+			break;
+		case JTYPE_BOOLEAN:
+			result.z = (*javaEnv)->CallBooleanMethodA(javaEnv, receiver, methodID, values);
+			break;
+		case JTYPE_CHAR:
+			result.c = (*javaEnv)->CallCharMethodA(javaEnv, receiver, methodID, values);
+			break;
+		default:
+			result.l = (*javaEnv)->CallObjectMethodA(javaEnv, receiver, methodID, values);
+			break;
+		}
+	}
+	return result;
+}
+
+//call a resolved method directly through jni
+static jvalue callResolvedMethod(JNIEnv * javaEnv, ljMethodCacheEntry_t* entry, jobject receiver, const jvalue* values) {
+	return callMethodID(javaEnv, entry->declaringClass, entry->methodID, entry->isStatic, entry->returnType, receiver, values);
+}
+
+/***************************************************************
+      RESOLVED FIELD CACHE
+****************************************************************/
+
+//look for an already resolved field, or a name known not to be a field
+static ljFieldCacheEntry_t* lookupField(ljJavaEnvironment_t* ljEnv, jclass clazz, int classReceiver,
+	const char* key, unsigned int hash)
+{
+	ljFieldCacheEntry_t* entry;
+
+	for (entry = LJ_ATOMIC_LOAD_PTR(&ljEnv->fieldCache[hash % LJ_FIELD_CACHE_SIZE]); entry != NULL; entry = entry->next) {
+		if (entry->hash == hash && entry->clazz == clazz && entry->classReceiver == classReceiver && strcmp(entry->name, key) == 0) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+//resolve a field through LuaJitJavaAPI.resolveField and store it in the cache
+// names that are not fields are cached as well, to skip the lookup on method calls
+static ljFieldCacheEntry_t* resolveField(ljJavaEnvironment_t* ljEnv, jclass clazz, int classReceiver,
+	const char* key, unsigned int hash)
+{
+	JNIEnv * javaEnv = getJavaEnv(ljEnv);
+	ljFieldCacheEntry_t* entry;
+	size_t keyLength = strlen(key) + 1;
+	jstring str;
+	jobject field;
+	jint info;
+
+	entry = calloc(1, sizeof(ljFieldCacheEntry_t) + keyLength);
+	entry->name = (char*)(entry + 1);
+	memcpy(entry->name, key, keyLength);
+	entry->hash = hash;
+	entry->classReceiver = classReceiver;
+
+	str = internSymbol(ljEnv, javaEnv, key);
+	field = (*javaEnv)->CallStaticObjectMethod(javaEnv, luajitjava_binding_class, luajitjava_resolve_field,
+		clazz, str, classReceiver ? JNI_TRUE : JNI_FALSE);
+
+	/* Handles exception */
+	jobject jstr = checkException(javaEnv);
+	if (jstr) {
+		const char * cStr;
+		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
+		fprintf(stderr, "Error. exception while resolving field %s : %s\n", key, cStr);
+		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
+		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
+		field = NULL;
+	}
+
+	if (field != NULL) {
+		info = (*javaEnv)->CallStaticIntMethod(javaEnv, luajitjava_binding_class, luajitjava_field_info, field);
+		entry->isStatic = (info & LJ_FIELD_STATIC) != 0;
+		entry->isFinal = (info & LJ_FIELD_FINAL) != 0;
+		entry->type = (javaArgType_t)(info & LJ_METHOD_TYPE_MASK);
+		entry->fieldID = (*javaEnv)->FromReflectedField(javaEnv, field);
+		if (entry->isStatic) {
+			jclass declaringClass = (*javaEnv)->CallObjectMethod(javaEnv, field, java_field_get_declaring_class);
+			entry->declaringClass = (*javaEnv)->NewGlobalRef(javaEnv, declaringClass);
+			(*javaEnv)->DeleteLocalRef(javaEnv, declaringClass);
+		}
+		(*javaEnv)->DeleteLocalRef(javaEnv, field);
+	}
+
+	entry->clazz = clazz;
+	//publish the entry only once complete, readers walk the bucket without locking
+	entry->next = ljEnv->fieldCache[hash % LJ_FIELD_CACHE_SIZE];
+	LJ_ATOMIC_STORE_PTR(&ljEnv->fieldCache[hash % LJ_FIELD_CACHE_SIZE], entry);
+	return entry;
+}
+
+//release all resolved fields of an environment
+static void releaseFieldCache(ljJavaEnvironment_t* ljEnv)
+{
+	JNIEnv * javaEnv = getJavaEnv(ljEnv);
+	ljFieldCacheEntry_t* entry;
+	ljFieldCacheEntry_t* next;
+
+	for (int bucket = 0; bucket < LJ_FIELD_CACHE_SIZE; bucket++) {
+		for (entry = ljEnv->fieldCache[bucket]; entry != NULL; entry = next) {
+			next = entry->next;
+			if (entry->constant != NULL) {
+				(*javaEnv)->DeleteGlobalRef(javaEnv, entry->constant);
+			}
+			if (entry->declaringClass != NULL) {
+				(*javaEnv)->DeleteGlobalRef(javaEnv, entry->declaringClass);
+			}
+			free(entry);
+		}
+		ljEnv->fieldCache[bucket] = NULL;
+	}
+}
+
+//read a resolved field directly through jni
+static jvalue getResolvedField(JNIEnv * javaEnv, ljFieldCacheEntry_t* entry, jobject receiver) {
+	jclass clazz = entry->declaringClass;
+	jfieldID fieldID = entry->fieldID;
+	jvalue result;
+
+	result.j = 0;
+	if (entry->isStatic) {
+		switch (entry->type) {
+		case JTYPE_BYTE:
+			result.b = (*javaEnv)->GetStaticByteField(javaEnv, clazz, fieldID);
+			break;
+		case JTYPE_SHORT:
+			result.s = (*javaEnv)->GetStaticShortField(javaEnv, clazz, fieldID);
+			break;
+		case JTYPE_INT:
+			result.i = (*javaEnv)->GetStaticIntField(javaEnv, clazz, fieldID);
+			break;
+		case JTYPE_LONG:
+			result.j = (*javaEnv)->GetStaticLongField(javaEnv, clazz, fieldID);
+			break;
+		case JTYPE_FLOAT:
+			result.f = (*javaEnv)->GetStaticFloatField(javaEnv, clazz, fieldID);
+			break;
+		case JTYPE_DOUBLE:
+			result.d = (*javaEnv)->GetStaticDoubleField(javaEnv, clazz, fieldID);
+			break;
+		case JTYPE_BOOLEAN:
+			result.z = (*javaEnv)->GetStaticBooleanField(javaEnv, clazz, fieldID);
+			break;
+		case JTYPE_CHAR:
+			result.c = (*javaEnv)->GetStaticCharField(javaEnv, clazz, fieldID);
+			break;
+		default:
+			result.l = (*javaEnv)->GetStaticObjectField(javaEnv, clazz, fieldID);
+			break;
+		}
+	} else {
+		switch (entry->type) {
+		case JTYPE_BYTE:
+			result.b = (*javaEnv)->GetByteField(javaEnv, receiver, fieldID);
+			break;
+		case JTYPE_SHORT:
+			result.s = (*javaEnv)->GetShortField(javaEnv, receiver, fieldID);
+			break;
+		case JTYPE_INT:
+			result.i = (*javaEnv)->GetIntField(javaEnv, receiver, fieldID);
+			break;
+		case JTYPE_LONG:
+			result.j = (*javaEnv)->GetLongField(javaEnv, receiver, fieldID);
+			break;
+		case JTYPE_FLOAT:
+			result.f = (*javaEnv)->GetFloatField(javaEnv, receiver, fieldID);
+			break;
+		case JTYPE_DOUBLE:
+			result.d = (*javaEnv)->GetDoubleField(javaEnv, receiver, fieldID);
+			break;
+		case JTYPE_BOOLEAN:
+			result.z = (*javaEnv)->GetBooleanField(javaEnv, receiver, fieldID);
+			break;
+		case JTYPE_CHAR:
+			result.c = (*javaEnv)->GetCharField(javaEnv, receiver, fieldID);
+			break;
+		default:
+			result.l = (*javaEnv)->GetObjectField(javaEnv, receiver, fieldID);
+			break;
+		}
+	}
+	return result;
+}
+
+/***************************************************************
+      OBJECT HANDLE POOL
+****************************************************************/
+
+//move free handles from the pool of the environment to the cache of a thread, adding a slab when the pool is empty
+static void refillHandleCache(ljJavaEnvironment_t* ljEnv, ljThreadState_t* state)
+{
+	ljHandleSlot_t* slot;
+	int count;
+
+	LJ_MUTEX_LOCK(&ljEnv->handleLock);
+	if (ljEnv->freeHandles == NULL) {
+		int size = ljEnv->handleSlabs != NULL ? ljEnv->handleSlabs->size * 2 : LJ_HANDLE_SLAB_MIN;
+		if (size > LJ_HANDLE_SLAB_MAX) {
+			size = LJ_HANDLE_SLAB_MAX;
+		}
+		ljHandleSlab_t* slab = malloc(sizeof(ljHandleSlab_t) + size * sizeof(ljHandleSlot_t));
+		slab->size = size;
+		slab->next = ljEnv->handleSlabs;
+		ljEnv->handleSlabs = slab;
+		for (int i = size - 1; i >= 0; i--) {
+			slab->slots[i].handle.pool = NULL;
+			slab->slots[i].nextFree = ljEnv->freeHandles;
+			ljEnv->freeHandles = &slab->slots[i];
+		}
+		ljEnv->handleSlabCount++;
+		ljEnv->handleCapacity += size;
+		ljEnv->freeHandleCount += size;
+	}
+	for (count = 0; count < LJ_HANDLE_CACHE_BATCH && ljEnv->freeHandles != NULL; count++) {
+		slot = ljEnv->freeHandles;
+		ljEnv->freeHandles = slot->nextFree;
+		slot->nextFree = state->handleCache;
+		state->handleCache = slot;
+	}
+	ljEnv->freeHandleCount -= count;
+	LJ_MUTEX_UNLOCK(&ljEnv->handleLock);
+	state->handleCacheCount += count;
+}
+
+//give up to count free handles of the cache of a thread back to the pool of the environment
+static void flushHandleCache(ljJavaEnvironment_t* ljEnv, ljThreadState_t* state, int count)
+{
+	ljHandleSlot_t* slot;
+	int moved;
+
+	LJ_MUTEX_LOCK(&ljEnv->handleLock);
+	for (moved = 0; moved < count && state->handleCache != NULL; moved++) {
+		slot = state->handleCache;
+		state->handleCache = slot->nextFree;
+		slot->nextFree = ljEnv->freeHandles;
+		ljEnv->freeHandles = slot;
+	}
+	ljEnv->freeHandleCount += moved;
+	LJ_MUTEX_UNLOCK(&ljEnv->handleLock);
+	state->handleCacheCount -= moved;
+}
+
+//take an object handle from the cache of the current thread, refilled from the pool when it is empty
+static ljJavaObject_t* allocHandle(ljThreadState_t* state)
+{
+	ljJavaEnvironment_t* ljEnv = state->ljEnv;
+	ljHandleSlot_t* slot;
+
+	if (state->handleCache == NULL) {
+		refillHandleCache(ljEnv, state);
+	}
+	slot = state->handleCache;
+	state->handleCache = slot->nextFree;
+	state->handleCacheCount--;
+	slot->handle.ljEnv = ljEnv;
+	slot->handle.object = NULL;
+	slot->handle.pool = &slot->handle;
+	return &slot->handle;
+}
+
+//give a handle back to the cache of the current thread, handles that are not pooled are left alone
+// the cache goes back to the pool by batches once it holds more than two of them
+static void freeHandle(ljThreadState_t* state, ljJavaObject_t* handle)
+{
+	ljHandleSlot_t* slot = (ljHandleSlot_t*)handle;
+
+	if (handle->pool != handle) {
+		return;
+	}
+	slot->handle.object = NULL;
+	slot->handle.pool = NULL;
+	slot->nextFree = state->handleCache;
+	state->handleCache = slot;
+	if (++state->handleCacheCount > 2 * LJ_HANDLE_CACHE_BATCH) {
+		flushHandleCache(state->ljEnv, state, LJ_HANDLE_CACHE_BATCH);
+	}
+}
+
+//release all slabs of the pool, handles still given out are no longer valid
+static void releaseHandlePool(ljJavaEnvironment_t* ljEnv)
+{
+	ljHandleSlab_t* slab;
+	ljHandleSlab_t* next;
+
+	for (slab = ljEnv->handleSlabs; slab != NULL; slab = next) {
+		next = slab->next;
+		free(slab);
+	}
+	ljEnv->handleSlabs = NULL;
+	ljEnv->freeHandles = NULL;
+	ljEnv->handleSlabCount = 0;
+	ljEnv->handleCapacity = 0;
+	ljEnv->freeHandleCount = 0;
+}
+
+/***************************************************************
+      DEFERRED RELEASES
+****************************************************************/
+
+//delete all global references queued by a thread at once
+static void flushReleases(ljThreadState_t* state)
+{
+	JNIEnv * javaEnv = state->javaEnv;
+
+	for (int i = 0; i < state->releaseQueueCount; i++) {
+		(*javaEnv)->DeleteGlobalRef(javaEnv, state->releaseQueue[i]);
+	}
+	LJ_ATOMIC_ADD_INT(&state->ljEnv->objectRefs, -state->releaseQueueCount);
+	state->releaseQueueCount = 0;
+}
+
+//queue a global reference to be deleted with the next flush
+// the queue is flushed once it reaches the release threshold, or once the last critical pin is released
+static void queueRelease(ljThreadState_t* state, jobject globalRef)
+{
+	if (state->releaseQueueCount == state->releaseQueueCapacity) {
+		state->releaseQueueCapacity = state->releaseQueueCapacity > 0 ? state->releaseQueueCapacity * 2 : LJ_RELEASE_THRESHOLD;
+		state->releaseQueue = realloc(state->releaseQueue, state->releaseQueueCapacity * sizeof(jobject));
+	}
+	state->releaseQueue[state->releaseQueueCount++] = globalRef;
+	if (state->releaseQueueCount >= state->ljEnv->releaseThreshold && state->criticalPins == 0) {
+		flushReleases(state);
+	}
+}
+
+/***************************************************************
+      LOCAL REFERENCE SCOPES
+****************************************************************/
+
+//remember a handle holding a local reference of the current scope
+// so that it can be invalidated when the scope is popped
+static void trackScopedHandle(ljThreadState_t* state, ljJavaObject_t* handle)
+{
+	if (state->scopeHandleCount == state->scopeHandleCapacity) {
+		state->scopeHandleCapacity = state->scopeHandleCapacity > 0 ? state->scopeHandleCapacity * 2 : LJ_SCOPE_CAPACITY;
+		state->scopeHandles = realloc(state->scopeHandles, state->scopeHandleCapacity * sizeof(ljJavaObject_t*));
+	}
+	state->scopeHandles[state->scopeHandleCount++] = handle;
+}
+
+//stop tracking a scoped handle, once released or escaped
+// handles are mostly released in the scope they were created in, so look from the top
+static int forgetScopedHandle(ljThreadState_t* state, ljJavaObject_t* handle)
+{
+	for (int i = state->scopeHandleCount - 1; i >= 0; i--) {
+		if (state->scopeHandles[i] == handle) {
+			state->scopeHandles[i] = NULL;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+//close the innermost scope of a thread
+static void popScope(ljThreadState_t* state)
+{
+	JNIEnv * javaEnv = state->javaEnv;
+	int mark = state->scopeMarks[--state->scopeDepth];
+
+	for (int i = mark; i < state->scopeHandleCount; i++) {
+		if (state->scopeHandles[i] != NULL) {
+			freeHandle(state, state->scopeHandles[i]);
+		}
+	}
+	state->scopeHandleCount = mark;
+	(*javaEnv)->PopLocalFrame(javaEnv, NULL);
+}
+
+// lua called method to open a scope, in which call and field results are kept as local references
+//  capacity is the number of local references expected in the scope, 0 for the default.
+//  Scopes belong to the thread that opened them
+int internal_javaPushScope(void* ljEnv, int capacity) {
+	ljThreadState_t* state = getThreadState((ljJavaEnvironment_t*)ljEnv);
+	JNIEnv * javaEnv = state->javaEnv;
+
+	if ((*javaEnv)->PushLocalFrame(javaEnv, capacity > 0 ? capacity : LJ_SCOPE_CAPACITY) != 0) {
+		(*javaEnv)->ExceptionClear(javaEnv);
+		fprintf(stderr, "Error. Couldn't open a java scope : out of memory\n");
+		return 0;
+	}
+	if (state->scopeDepth == state->scopeCapacity) {
+		state->scopeCapacity = state->scopeCapacity > 0 ? state->scopeCapacity * 2 : 8;
+		state->scopeMarks = realloc(state->scopeMarks, state->scopeCapacity * sizeof(int));
+	}
+	state->scopeMarks[state->scopeDepth++] = state->scopeHandleCount;
+	return 1;
+}
+
+// lua called method to close the current scope, all its local references are freed at once
+//  and the handles still holding one go back to the pool, they must not be used anymore
+void internal_javaPopScope(void* ljEnv) {
+	ljThreadState_t* state = getThreadState((ljJavaEnvironment_t*)ljEnv);
+
+	if (state->scopeDepth == 0) {
+		fprintf(stderr, "Error. No java scope to close\n");
+		return;
+	}
+	popScope(state);
+}
+
+// lua called method to keep an object handle created in a scope beyond it
+//  its reference is promoted to a global one, to be released with javaReleaseObject
+void internal_javaEscapeObject(ljJavaObject_t* objectInterface) {
+	ljThreadState_t* state = getThreadState((ljJavaEnvironment_t*)objectInterface->ljEnv);
+	JNIEnv * javaEnv = state->javaEnv;
+	jobject localObject = (jobject)objectInterface->object;
+
+	if (localObject == NULL || (*javaEnv)->GetObjectRefType(javaEnv, localObject) != JNILocalRefType) {
+		return;
+	}
+	objectInterface->object = (*javaEnv)->NewGlobalRef(javaEnv, localObject);
+	(*javaEnv)->DeleteLocalRef(javaEnv, localObject);
+	LJ_ATOMIC_INCREMENT_INT(&state->ljEnv->objectRefs);
+	forgetScopedHandle(state, objectInterface);
+}
+
+static void releaseThreadState(ljThreadState_t* state, int jvmRunning)
+{
+	if (jvmRunning) {
+		while (state->scopeDepth > 0) {
+			popScope(state);
+		}
+		flushReleases(state);
+		flushHandleCache(state->ljEnv, state, state->handleCacheCount);
+	}
+	free(state->scopeMarks);
+	free(state->scopeHandles);
+	free(state->releaseQueue);
+	free(state->stringBuffer);
+	state->scopeMarks = NULL;
+	state->scopeHandles = NULL;
+	state->releaseQueue = NULL;
+	state->stringBuffer = NULL;
+	state->scopeDepth = 0;
+	state->scopeCapacity = 0;
+	state->scopeHandleCount = 0;
+	state->scopeHandleCapacity = 0;
+	state->releaseQueueCount = 0;
+	state->releaseQueueCapacity = 0;
+	state->stringBufferSize = 0;
+	//without a running environment the cache points into slabs already released
+	state->handleCache = NULL;
+	state->handleCacheCount = 0;
+}
+
+//called when a java application loads the library through System.loadLibrary,
+// the JVM is then reused by javaStart instead of creating one
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* vm, void* reserved)
+{
+	JNIEnv* env;
+
+	loadedJvm = vm;
+	if ((*vm)->GetEnv(vm, (void**)&env, JNI_VERSION_1_8) == JNI_OK) {
+		//the class loader of the application loading the library can see luajitjava.jar,
+		// the system class loader used by native threads may not
+		loadedBindingClass = findGlobalClass(env, "developpeur2000/luajitjava/LuaJitJavaAPI");
+		if (loadedBindingClass == NULL) {
+			(*env)->ExceptionClear(env);
+		}
+	}
+	return JNI_VERSION_1_8;
+}
+
+JNIEXPORT void JNICALL JNI_OnUnload(JavaVM* vm, void* reserved)
+{
+	JNIEnv* env;
+
+	if (loadedBindingClass != NULL && (*vm)->GetEnv(vm, (void**)&env, JNI_VERSION_1_8) == JNI_OK) {
+		(*env)->DeleteGlobalRef(env, loadedBindingClass);
+	}
+	loadedBindingClass = NULL;
+	loadedJvm = NULL;
+}
+
+//JVM already running in the process, the one that loaded the library or one started by another library
+static JavaVM* findRunningJvm(void)
+{
+	JavaVM* jvms[1];
+	jsize nJvms = 0;
+
+	if (loadedJvm != NULL) {
+		return loadedJvm;
+	}
+	if (JNI_GetCreatedJavaVMs(jvms, 1, &nJvms) != JNI_OK || nJvms < 1) {
+		return NULL;
+	}
+	return jvms[0];
+}
+
+//undo a start failing once its environment has been created, dropping the thread state
+// and destroying a JVM created by the start, so that no later start reuses it half bound
+static void abortStart(ljJavaEnvironment_t* ljEnv, ljThreadState_t* state)
+{
+	JavaVM* jvm = ljEnv->jvm;
+
+	if (state != NULL) {
+		unregisterThreadState(state);
+		releaseThreadState(state, 0);
+		if (state->attached) {
+			(*jvm)->DetachCurrentThread(jvm);
+#ifdef _WIN32
+			FlsSetValue(threadExitIndex, NULL);
+#else
+			pthread_setspecific(threadExitKey, NULL);
+#endif
+		}
+		free(state);
+		currentThreadState = NULL;
+	}
+	LJ_MUTEX_DESTROY(&ljEnv->cacheLock);
+	LJ_MUTEX_DESTROY(&ljEnv->symbolLock);
+	LJ_MUTEX_DESTROY(&ljEnv->classLock);
+	LJ_MUTEX_DESTROY(&ljEnv->handleLock);
+	LJ_MUTEX_DESTROY(&ljEnv->threadLock);
+	if (ljEnv->ownsJvm) {
+		runningJvm = NULL;
+		(*jvm)->DestroyJavaVM(jvm);
+	}
+	free(ljEnv);
+}
+
+// init the bindings and get the java environment
+//  the thread starting java is attached to the JVM, other threads are attached on their first call.
+//  A JVM already running in the process is reused, class path and options being ignored then,
+//  and later starts share the same environment until they are all ended.
+//  To be called with startLock held, by the starting thread or the dispatcher thread it waits for
+static void* startJava(const char* classPath, int nOptions, const char** options, const char* sharedArchive)
+{
+	JNIEnv *env = NULL;
+	JavaVM *jvm;
+	ljJavaEnvironment_t* returnStruct;
+	ljThreadState_t* state;
+	int ownsJvm = 0;
+
+	if (sharedEnvironment != NULL) {
+		returnStruct = sharedEnvironment;
+		returnStruct->refCount++;
+		getThreadState(returnStruct);
+		return (void*)returnStruct;
+	}
+
+	jvm = findRunningJvm();
+	if (jvm == NULL) {
+		env = create_vm(&jvm, classPath, nOptions, options, sharedArchive);
+		if (env == NULL)
+		{
+			fprintf(stderr, "\n Unable to create java VM");
+			return NULL;
+		}
+		ownsJvm = 1;
+	}
+
+	returnStruct = calloc(1, sizeof(ljJavaEnvironment_t));
+	returnStruct->jvm = jvm;
+	returnStruct->foldConstants = 1;
+	returnStruct->releaseThreshold = LJ_RELEASE_THRESHOLD;
+	returnStruct->refCount = 1;
+	returnStruct->ownsJvm = ownsJvm;
+	returnStruct->statsEnabled = 1;
+	LJ_MUTEX_INIT(&returnStruct->cacheLock);
+	LJ_MUTEX_INIT(&returnStruct->symbolLock);
+	LJ_MUTEX_INIT(&returnStruct->classLock);
+	LJ_MUTEX_INIT(&returnStruct->handleLock);
+	LJ_MUTEX_INIT(&returnStruct->threadLock);
+
+	runningJvm = jvm;
+	initThreadExit();
+	if (currentThreadState != NULL) {
+		releaseThreadState(currentThreadState, 0);
+		free(currentThreadState);
+		currentThreadState = NULL;
+	}
+	//a reused JVM may need the thread to be attached
+	state = newThreadState(returnStruct, env);
+	if (state == NULL) {
+		abortStart(returnStruct, NULL);
+		return NULL;
+	}
+	env = state->javaEnv;
+
+	//store class loader
+	jclass threadClass = findGlobalClass(env, "java/lang/Thread");
+	jmethodID currentThreadMethod = (*env)->GetStaticMethodID(env, threadClass, "currentThread",
+		"()Ljava/lang/Thread;");
+	jobject currentThread = (*env)->CallStaticObjectMethod(env, threadClass, currentThreadMethod);
+	jmethodID getContextClassLoaderMethod = (*env)->GetMethodID(env, threadClass, "getContextClassLoader",
+		"()Ljava/lang/ClassLoader;");
+	jobject classLoader = (*env)->CallObjectMethod(env, currentThread, getContextClassLoaderMethod);
+	java_class_loader = (*env)->NewGlobalRef(env, classLoader);
+	//cleanup
+	(*env)->DeleteLocalRef(env, classLoader);
+	(*env)->DeleteGlobalRef(env, threadClass);
+	(*env)->DeleteLocalRef(env, currentThread);
+
+	if (bindJavaBaseLinks(env) == 0) {
+		fprintf(stderr, "\n Unable to bind with java\n");
+		(*env)->ExceptionClear(env);
+		(*env)->DeleteGlobalRef(env, java_class_loader);
+		java_class_loader = NULL;
+		abortStart(returnStruct, state);
+		return NULL;
+	}
+
+	sharedEnvironment = returnStruct;
+	return (void*)returnStruct;
+}
+
+void* internal_javaStart(const char* classPath, int nOptions, const char** options, const char* sharedArchive)
+{
+	void* ljEnv;
+
+	LJ_MUTEX_LOCK(&startLock);
+	ljEnv = startJava(classPath, nOptions, options, sharedArchive);
+	LJ_MUTEX_UNLOCK(&startLock);
+	return ljEnv;
+}
+
+// release the bindings and destroy the JVM once every start has been ended, returning 1 then
+//  to be called from the thread that started java, threads attached since then are left to exit.
+//  A JVM the library did not create is left running, only the current thread being detached from it.
+//  To be called with startLock held, by the ending thread or the dispatcher thread it waits for
+static int endJava(void* ljEnv)
+{
+	ljJavaEnvironment_t* infoStruct = (ljJavaEnvironment_t*)ljEnv;
+	JNIEnv * javaEnv = getJavaEnv(infoStruct);
+	JavaVM * jvm = (JavaVM *) infoStruct->jvm;
+	int ownsJvm = infoStruct->ownsJvm;
+
+	if (--infoStruct->refCount > 0) {
+		return 0;
+	}
+	sharedEnvironment = NULL;
+
+	releaseThreadState(currentThreadState, 1);
+	forgetThreadStates(infoStruct, javaEnv, !ownsJvm);
+	releaseHandlePool(infoStruct);
+	releaseMethodCache(infoStruct);
+	releaseFieldCache(infoStruct);
+	releaseSymbols(infoStruct);
+	releaseClassRegistry(infoStruct);
+	LJ_MUTEX_DESTROY(&infoStruct->cacheLock);
+	LJ_MUTEX_DESTROY(&infoStruct->symbolLock);
+	LJ_MUTEX_DESTROY(&infoStruct->classLock);
+	LJ_MUTEX_DESTROY(&infoStruct->handleLock);
+	LJ_MUTEX_DESTROY(&infoStruct->threadLock);
+	free(infoStruct);
+
+	(*javaEnv)->DeleteGlobalRef(javaEnv, java_class_loader);
+
+	unbindJavaBaseLinks(javaEnv);
+
+	if (!ownsJvm) {
+		if (currentThreadState->attached) {
+			(*jvm)->DetachCurrentThread(jvm);
+#ifdef _WIN32
+			FlsSetValue(threadExitIndex, NULL);
+#else
+			pthread_setspecific(threadExitKey, NULL);
+#endif
+		}
+		free(currentThreadState);
+		currentThreadState = NULL;
+		return 1;
+	}
+
+	runningJvm = NULL;
+	if (!currentThreadState->attached) {
+		free(currentThreadState);
+		currentThreadState = NULL;
+	}
+	(*jvm)->DestroyJavaVM(jvm);
+
+	fprintf(stdout, "destroyed jvm\n");
+	return 1;
+}
+
+int internal_javaEnd(void* ljEnv)
+{
+	int ended;
+
+	LJ_MUTEX_LOCK(&startLock);
+	ended = endJava(ljEnv);
+	LJ_MUTEX_UNLOCK(&startLock);
+	return ended;
+}
+
+// get a java class handle
+//  handles of a same class name share the reference of the class registry,
+//  so that only the first binding looks the class up
+int internal_javaBindClass(ljJavaClass_t* classInterface, const char* className)
+{
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)classInterface->ljEnv;
+	ljClassEntry_t* entry;
+	JNIEnv * javaEnv;
+	long long start = statsStart(env);
+
+	javaEnv = getJavaEnv(env);
+	(*javaEnv)->ExceptionClear(javaEnv);
+
+	entry = registerClass(env, javaEnv, className);
+	recordOp(env, JSTATS_BIND_CLASS, statsElapsed(start), entry != NULL);
+	if (entry == NULL) {
+		classInterface->classObject = NULL;
+		return 0;
+	}
+	classInterface->classObject = entry->clazz;
+	return 1;
+}
+
+// release a java class handle
+//  the class stays registered, only the count of its handles goes down
+void internal_javaReleaseClass(ljJavaClass_t* classInterface) {
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)classInterface->ljEnv;
+	ljClassEntry_t* entry;
+
+	if (classInterface->classObject != NULL) {
+		entry = findRegisteredClass(env, (jclass)classInterface->classObject);
+		if (entry != NULL) {
+			LJ_ATOMIC_DECREMENT_INT(&entry->refCount);
+		} else {
+			(*getJavaEnv(env))->DeleteGlobalRef(getJavaEnv(env), classInterface->classObject);
+		}
+		classInterface->classObject = NULL;
+	}
+}
+
+// utility function to read the [type, value] pairs of a vararg list into an array of values
+//  nArgs counts both types and values, as sent by lua
+int readVarArgs(int nArgs, va_list valist, javaArgType_t* argTypes, ljJavaValue_t* args) {
+	int nValues = nArgs / 2;
+
+	if (nValues > LJ_MAX_ARGS) {
+		fprintf(stderr, "java call => too many parameters, %d at most\n", LJ_MAX_ARGS);
+		return -1;
+	}
+
+	for (int i = 0; i < nValues; i++) {
+		argTypes[i] = va_arg(valist, javaArgType_t);
+		switch (argTypes[i]) {
+		case JTYPE_BYTE:
+			args[i].b = (char) va_arg(valist, int);
+			break;
+		case JTYPE_SHORT:
+			args[i].s = (short) va_arg(valist, int);
+			break;
+		case JTYPE_INT:
+			args[i].i = va_arg(valist, int);
+			break;
+		case JTYPE_LONG:
+			args[i].j = va_arg(valist, long);
+			break;
+		case JTYPE_FLOAT:
+			args[i].f = (float) va_arg(valist, double);
+			break;
+		case JTYPE_DOUBLE:
+			args[i].d = va_arg(valist, double);
+			break;
+		case JTYPE_BOOLEAN:
+			args[i].z = (char) va_arg(valist, int);
+			break;
+		case JTYPE_CHAR:
+			args[i].c = (unsigned char) va_arg(valist, int);
+			break;
+		case JTYPE_STRING:
+			args[i].chars.data = va_arg(valist, const char*);
+			args[i].chars.length = -1;
+			break;
+		case JTYPE_OBJECT:
+			args[i].object = va_arg(valist, ljJavaObject_t*);
+			break;
+		default:
+			fprintf(stderr, "java call => unrecognized parameter type\n");
+			return -1;
+		}
+	}
+
+	return nValues;
+}
+
+// utility function to release the java values created by toJavaValues
+void releaseJavaValues(JNIEnv * javaEnv, int nValues, const javaArgType_t* argTypes, const jvalue* values) {
+	for (int i = 0; i < nValues; i++) {
+		if (argTypes[i] == JTYPE_STRING && values[i].l != NULL) {
+			(*javaEnv)->DeleteLocalRef(javaEnv, values[i].l);
+		}
+	}
+}
+
+// utility function to decode one utf-8 sequence into c, returning the number of bytes read.
+//  Truncated sequences, bad continuation bytes, overlong forms, encoded surrogates and code points
+//  over U+10FFFF are invalid, their first byte being read alone as U+FFFD
+static int decodeUtf8(const unsigned char* bytes, int length, unsigned int* c)
+{
+	unsigned int first = bytes[0];
+	unsigned int value;
+	unsigned int min;
+	int size;
+
+	if (first < 0x80) {
+		*c = first;
+		return 1;
+	}
+	if ((first & 0xE0) == 0xC0) {
+		size = 2;
+		value = first & 0x1F;
+		min = 0x80;
+	} else if ((first & 0xF0) == 0xE0) {
+		size = 3;
+		value = first & 0x0F;
+		min = 0x800;
+	} else if ((first & 0xF8) == 0xF0) {
+		size = 4;
+		value = first & 0x07;
+		min = 0x10000;
+	} else {
+		size = 0;
+	}
+	*c = 0xFFFD;
+	if (size == 0 || size > length) {
+		return 1;
+	}
+	for (int i = 1; i < size; i++) {
+		if ((bytes[i] & 0xC0) != 0x80) {
+			return 1;
+		}
+		value = (value << 6) | (bytes[i] & 0x3F);
+	}
+	if (value < min || value > 0x10FFFF || (value >= 0xD800 && value < 0xE000)) {
+		return 1;
+	}
+	*c = value;
+	return size;
+}
+
+// utility function to create a java string from a string argument
+//  NUL terminated strings are given to NewStringUTF, strings of known length are decoded to utf-16
+//  first, on the stack when they are short enough, so that they can hold NUL characters
+static jstring newJavaString(JNIEnv * javaEnv, const ljJavaChars_t* chars)
+{
+	jchar stackUnits[LJ_STRING_STACK_SIZE];
+	jchar* units;
+	const unsigned char* bytes = (const unsigned char*)chars->data;
+	int length = chars->length;
+	int nUnits = 0;
+	jstring str;
+
+	if (bytes == NULL) {
+		return NULL;
+	}
+	if (length < 0) {
+		return (*javaEnv)->NewStringUTF(javaEnv, (const char*)bytes);
+	}
+	if (chars->utf16) {
+		return (*javaEnv)->NewString(javaEnv, (const jchar*)bytes, length);
+	}
+	if (length == 0) {
+		return (*javaEnv)->NewStringUTF(javaEnv, "");
+	}
+	//utf-8 never takes less bytes than utf-16 units, invalid bytes giving a unit each
+	units = length <= LJ_STRING_STACK_SIZE ? stackUnits : malloc(length * sizeof(jchar));
+	for (int i = 0; i < length; ) {
+		unsigned int c;
+		i += decodeUtf8(bytes + i, length - i, &c);
+		if (c >= 0x10000) {
+			c -= 0x10000;
+			units[nUnits++] = (jchar)(0xD800 + (c >> 10));
+			units[nUnits++] = (jchar)(0xDC00 + (c & 0x3FF));
+		} else {
+			units[nUnits++] = (jchar)c;
+		}
+	}
+	str = (*javaEnv)->NewString(javaEnv, units, nUnits);
+	if (units != stackUnits) {
+		free(units);
+	}
+	return str;
+}
+
+// utility function to get the utf-16 units of a java string, in stackUnits when they fit
+//  units given elsewhere are to be freed by the caller
+static jchar* getJavaChars(JNIEnv * javaEnv, jstring str, jchar* stackUnits, int* nUnits)
+{
+	jsize length = (*javaEnv)->GetStringLength(javaEnv, str);
+	jchar* units = length <= LJ_STRING_STACK_SIZE ? stackUnits : malloc(length * sizeof(jchar));
+
+	(*javaEnv)->GetStringRegion(javaEnv, str, 0, length, units);
+	*nUnits = length;
+	return units;
+}
+
+// utility function to encode utf-16 units to standard utf-8, as newJavaString decodes it,
+//  unpaired surrogates being replaced. Returns the number of bytes, only counted when bytes is NULL
+static int encodeUtf8(const jchar* units, int nUnits, char* bytes)
+{
+	unsigned char* out = (unsigned char*)bytes;
+	int length = 0;
+
+	for (int i = 0; i < nUnits; i++) {
+		unsigned int c = units[i];
+		if (c >= 0xD800 && c < 0xDC00 && i + 1 < nUnits && units[i + 1] >= 0xDC00 && units[i + 1] < 0xE000) {
+			c = 0x10000 + ((c - 0xD800) << 10) + (units[i + 1] - 0xDC00);
+			i++;
+		} else if (c >= 0xD800 && c < 0xE000) {
+			c = 0xFFFD;
+		}
+		if (c < 0x80) {
+			if (out != NULL) {
+				out[length] = (unsigned char)c;
+			}
+			length += 1;
+		} else if (c < 0x800) {
+			if (out != NULL) {
+				out[length] = (unsigned char)(0xC0 | (c >> 6));
+				out[length + 1] = (unsigned char)(0x80 | (c & 0x3F));
+			}
+			length += 2;
+		} else if (c < 0x10000) {
+			if (out != NULL) {
+				out[length] = (unsigned char)(0xE0 | (c >> 12));
+				out[length + 1] = (unsigned char)(0x80 | ((c >> 6) & 0x3F));
+				out[length + 2] = (unsigned char)(0x80 | (c & 0x3F));
+			}
+			length += 3;
+		} else {
+			if (out != NULL) {
+				out[length] = (unsigned char)(0xF0 | (c >> 18));
+				out[length + 1] = (unsigned char)(0x80 | ((c >> 12) & 0x3F));
+				out[length + 2] = (unsigned char)(0x80 | ((c >> 6) & 0x3F));
+				out[length + 3] = (unsigned char)(0x80 | (c & 0x3F));
+			}
+			length += 4;
+		}
+	}
+	return length;
+}
+
+// utility function to turn lua provided values into java values, primitives are passed as they are
+//  strings are created as local references, to be released with releaseJavaValues
+int toJavaValues(JNIEnv * javaEnv, int nValues, const javaArgType_t* argTypes, const ljJavaValue_t* args, jvalue* values) {
+	for (int i = 0; i < nValues; i++) {
+		switch (argTypes[i]) {
+		case JTYPE_BYTE:
+			values[i].b = (jbyte) args[i].b;
+			break;
+		case JTYPE_SHORT:
+			values[i].s = (jshort) args[i].s;
+			break;
+		case JTYPE_INT:
+			values[i].i = (jint) args[i].i;
+			break;
+		case JTYPE_LONG:
+			values[i].j = (jlong) args[i].j;
+			break;
+		case JTYPE_FLOAT:
+			values[i].f = (jfloat) args[i].f;
+			break;
+		case JTYPE_DOUBLE:
+			values[i].d = (jdouble) args[i].d;
+			break;
+		case JTYPE_BOOLEAN:
+			values[i].z = args[i].z ? JNI_TRUE : JNI_FALSE;
+			break;
+		case JTYPE_CHAR:
+			values[i].c = (jchar) args[i].c;
+			break;
+		case JTYPE_STRING:
+			values[i].l = newJavaString(javaEnv, &args[i].chars);
+			break;
+		case JTYPE_OBJECT:
+			values[i].l = args[i].object != NULL ? (jobject)args[i].object->object : NULL;
+			break;
+		default:
+			fprintf(stderr, "java call => unrecognized parameter type\n");
+			releaseJavaValues(javaEnv, i, argTypes, values);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// utility function to box java values into an array of java objects
+//  that can be fed to a java method or constructor through the LuaJitJavaAPI proxy
+jobjectArray boxJavaArgs(JNIEnv * javaEnv, int nValues, const javaArgType_t* argTypes, const jvalue* values) {
+	jobject paramJObject;
+	jobjectArray javaArgArray;
+
+	javaArgArray = (*javaEnv)->NewObjectArray(javaEnv, nValues, java_lang_object, NULL);
+
+	for (int i = 0; i < nValues; i++) {
+		switch (argTypes[i]) {
+		case JTYPE_BYTE:
+			paramJObject = (*javaEnv)->NewObject(javaEnv, java_byte_class, java_new_byte, values[i].b);
+			break;
+		case JTYPE_SHORT:
+			paramJObject = (*javaEnv)->NewObject(javaEnv, java_short_class, java_new_short, values[i].s);
+			break;
+		case JTYPE_INT:
+			paramJObject = (*javaEnv)->NewObject(javaEnv, java_int_class, java_new_int, values[i].i);
+			break;
+		case JTYPE_LONG:
+			paramJObject = (*javaEnv)->NewObject(javaEnv, java_long_class, java_new_long, values[i].j);
+			break;
+		case JTYPE_FLOAT:
+			paramJObject = (*javaEnv)->NewObject(javaEnv, java_float_class, java_new_float, values[i].f);
+			break;
+		case JTYPE_DOUBLE:
+			paramJObject = (*javaEnv)->NewObject(javaEnv, java_double_class, java_new_double, values[i].d);
+			break;
+		case JTYPE_BOOLEAN:
+			paramJObject = (*javaEnv)->NewObject(javaEnv, java_boolean_class, java_new_boolean, values[i].z);
+			break;
+		case JTYPE_CHAR:
+			paramJObject = (*javaEnv)->NewObject(javaEnv, java_char_class, java_new_char, values[i].c);
+			break;
+		default:
+			//strings and objects are already references
+			(*javaEnv)->SetObjectArrayElement(javaEnv, javaArgArray, i, values[i].l);
+			continue;
+		}
+		(*javaEnv)->SetObjectArrayElement(javaEnv, javaArgArray, i, paramJObject);
+		(*javaEnv)->DeleteLocalRef(javaEnv, paramJObject);
+	}
+
+	return javaArgArray;
+}
+
+// utility function to release the array of java arguments created in the previous method
+void releasejavaArgs(JNIEnv * javaEnv, jobjectArray javaArgArray) {
+	(*javaEnv)->DeleteLocalRef(javaEnv, javaArgArray);
+}
+
+//look for the constructor of a class matching argument type tags, resolving it on first use
+static ljMethodCacheEntry_t* findConstructor(ljJavaEnvironment_t* env, jclass clazz, int nValues, const javaArgType_t* argTypes)
+{
+	unsigned int hash;
+	ljMethodCacheEntry_t* entry;
+
+	clazz = findClassEntry(env, getJavaEnv(env), clazz)->clazz;
+	hash = hashMemberKey(clazz, 1, LJ_CONSTRUCTOR_NAME, nValues, argTypes);
+	entry = lookupMethod(env, clazz, 1, LJ_CONSTRUCTOR_NAME, nValues, argTypes, hash);
+
+	if (entry == NULL) {
+		//another thread may have resolved the same constructor meanwhile
+		LJ_MUTEX_LOCK(&env->cacheLock);
+		entry = lookupMethod(env, clazz, 1, LJ_CONSTRUCTOR_NAME, nValues, argTypes, hash);
+		if (entry == NULL) {
+			entry = resolveMethod(env, clazz, 1, LJ_CONSTRUCTOR_NAME, nValues, argTypes, hash);
+		}
+		LJ_MUTEX_UNLOCK(&env->cacheLock);
+	}
+	return entry;
+}
+
+// lua called method to instantiate an object from a specified class,
+//  using provided constructor arguments.
+//  The constructor is resolved once per class and argument type tags, then called directly
+//  through jni. Constructors that cannot be resolved unambiguously go through LuaJitJavaAPI.javaNew
+int internal_javaNew(ljJavaObject_t* objectInterface, ljJavaClass_t* classInterface, int nValues, const javaArgType_t* argTypes, const ljJavaValue_t* args)
+{
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)classInterface->ljEnv;
+	jobject newObject;
+	jobject classInstance;
+	JNIEnv * javaEnv;
+	jvalue values[LJ_MAX_ARGS];
+	ljMethodCacheEntry_t* entry;
+	long long start = statsStart(env);
+	long long elapsed;
+
+	javaEnv = getJavaEnv(env);
+	(*javaEnv)->ExceptionClear(javaEnv);
+
+	//check given class interface
+	classInstance = (jobject) classInterface->classObject;
+	if ((*javaEnv)->IsInstanceOf(javaEnv, classInstance, java_lang_class) == JNI_FALSE)
+	{
+		fprintf(stderr, "Class interface does not seem to contain a class instance\n");
+		return 0;
+	}
+
+	//get java params from args
+	if (!toJavaValues(javaEnv, nValues, argTypes, args, values)) {
+		return 0;
+	}
+
+	entry = findConstructor(env, classInstance, nValues, argTypes);
+	if (entry->methodID != NULL && checkMethodArgs(javaEnv, entry, values)) {
+		newObject = (*javaEnv)->NewObjectA(javaEnv, classInstance, entry->methodID, values);
+	} else {
+		//create new object through our binding java class
+		jobjectArray javaArgArray = boxJavaArgs(javaEnv, nValues, argTypes, values);
+		newObject = (*javaEnv)->CallStaticObjectMethod(javaEnv, luajitjava_binding_class, luajitjava_java_new, classInstance, javaArgArray);
+		releasejavaArgs(javaEnv, javaArgArray);
+	}
+	releaseJavaValues(javaEnv, nValues, argTypes, values);
+
+	/* Handles exception */
+	jobject jstr = checkException(javaEnv);
+	elapsed = statsElapsed(start);
+	recordOp(env, JSTATS_NEW, elapsed, jstr == NULL);
+	recordLatency(env, &entry->latency, elapsed, jstr == NULL);
+	if (jstr) {
+		const char * cStr;
+		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
+		fprintf(stderr, "Error. Couldn't create object : %s\n", cStr);
+		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
+		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
+		return 0;
+	}
+
+	if (newObject == NULL)
+	{
+		fprintf(stderr, "Error. Couldn't create object : unknown reason\n");
+	}
+
+	objectInterface->object = (*javaEnv)->NewGlobalRef(javaEnv, newObject);
+	objectInterface->pool = NULL;
+	(*javaEnv)->DeleteLocalRef(javaEnv, newObject);
+	LJ_ATOMIC_INCREMENT_INT(&env->objectRefs);
+	return 1;
+}
+
+// lua called method to instantiate nObjects objects of a class in a single call,
+//  args holding nArgs constructor arguments per object one object after the other, all of the argTypes types.
+//  objects is an array of nObjects handles, filled with global references, their slots being set to NULL
+//  for objects that could not be created. Returns the number of objects created
+int internal_javaNewMany(ljJavaObject_t* objects, ljJavaClass_t* classInterface, int nObjects, int nValues, const javaArgType_t* argTypes, const ljJavaValue_t* args)
+{
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)classInterface->ljEnv;
+	jobject newObject;
+	jobject classInstance;
+	JNIEnv * javaEnv;
+	jvalue values[LJ_MAX_ARGS];
+	ljMethodCacheEntry_t* entry;
+	int nCreated = 0;
+	long long start = statsStart(env);
+
+	javaEnv = getJavaEnv(env);
+	(*javaEnv)->ExceptionClear(javaEnv);
+
+	classInstance = (jobject) classInterface->classObject;
+	if ((*javaEnv)->IsInstanceOf(javaEnv, classInstance, java_lang_class) == JNI_FALSE)
+	{
+		fprintf(stderr, "Class interface does not seem to contain a class instance\n");
+		return 0;
+	}
+	for (int i = 0; i < nObjects; i++) {
+		objects[i].ljEnv = env;
+		objects[i].object = NULL;
+		objects[i].pool = NULL;
+	}
+
+	entry = findConstructor(env, classInstance, nValues, argTypes);
+	if (entry->methodID != NULL) {
+		for (int i = 0; i < nObjects; i++) {
+			if (!toJavaValues(javaEnv, nValues, argTypes, args + i * nValues, values)) {
+				continue;
+			}
+			if (!checkMethodArgs(javaEnv, entry, values)) {
+				fprintf(stderr, "Error. Couldn't create object %d : invalid constructor parameters\n", i);
+				releaseJavaValues(javaEnv, nValues, argTypes, values);
+				continue;
+			}
+			newObject = (*javaEnv)->NewObjectA(javaEnv, classInstance, entry->methodID, values);
+			releaseJavaValues(javaEnv, nValues, argTypes, values);
+			if ((*javaEnv)->ExceptionCheck(javaEnv)) {
+				jobject jstr = checkException(javaEnv);
+				if (jstr) {
+					const char * cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
+					fprintf(stderr, "Error. Couldn't create object %d : %s\n", i, cStr);
+					(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
+					(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
+				}
+				continue;
+			}
+			objects[i].object = (*javaEnv)->NewGlobalRef(javaEnv, newObject);
+			LJ_ATOMIC_INCREMENT_INT(&env->objectRefs);
+			(*javaEnv)->DeleteLocalRef(javaEnv, newObject);
+			nCreated++;
+		}
+		recordOp(env, JSTATS_NEW_MANY, statsElapsed(start), nCreated == nObjects);
+		return nCreated;
+	}
+
+	//unresolved constructors go through LuaJitJavaAPI.javaNewMany, still in a single java call
+	jobjectArray argArrays = (*javaEnv)->NewObjectArray(javaEnv, nObjects, java_object_array_class, NULL);
+	jobjectArray newObjects;
+	for (int i = 0; i < nObjects; i++) {
+		if (!toJavaValues(javaEnv, nValues, argTypes, args + i * nValues, values)) {
+			continue;
+		}
+		jobjectArray javaArgArray = boxJavaArgs(javaEnv, nValues, argTypes, values);
+		(*javaEnv)->SetObjectArrayElement(javaEnv, argArrays, i, javaArgArray);
+		releasejavaArgs(javaEnv, javaArgArray);
+		releaseJavaValues(javaEnv, nValues, argTypes, values);
+	}
+	newObjects = (*javaEnv)->CallStaticObjectMethod(javaEnv, luajitjava_binding_class, luajitjava_java_new_many, classInstance, argArrays);
+	(*javaEnv)->DeleteLocalRef(javaEnv, argArrays);
+
+	/* Handles exception */
+	jobject jstr = checkException(javaEnv);
+	if (jstr) {
+		const char * cStr;
+		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
+		fprintf(stderr, "Error. Couldn't create objects : %s\n", cStr);
+		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
+		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
+		recordOp(env, JSTATS_NEW_MANY, statsElapsed(start), 0);
+		return 0;
+	}
+	for (int i = 0; i < nObjects; i++) {
+		newObject = (*javaEnv)->GetObjectArrayElement(javaEnv, newObjects, i);
+		if (newObject != NULL) {
+			objects[i].object = (*javaEnv)->NewGlobalRef(javaEnv, newObject);
+			LJ_ATOMIC_INCREMENT_INT(&env->objectRefs);
+			(*javaEnv)->DeleteLocalRef(javaEnv, newObject);
+			nCreated++;
+		}
+	}
+	(*javaEnv)->DeleteLocalRef(javaEnv, newObjects);
+	recordOp(env, JSTATS_NEW_MANY, statsElapsed(start), nCreated == nObjects);
+	return nCreated;
+}
+
+// lua called method to release a java object handle
+//  handles created in a scope hold a local reference, released right away as well.
+//  Handles given by calls and field reads go back to the pool and must not be used anymore
+void internal_javaReleaseObject(ljJavaObject_t* objectInterface) {
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)objectInterface->ljEnv;
+	ljThreadState_t* state = getThreadState(env);
+	JNIEnv * javaEnv = state->javaEnv;
+
+	if (objectInterface->object != NULL) {
+		if (state->scopeDepth > 0 && (*javaEnv)->GetObjectRefType(javaEnv, objectInterface->object) == JNILocalRefType) {
+			(*javaEnv)->DeleteLocalRef(javaEnv, objectInterface->object);
+			forgetScopedHandle(state, objectInterface);
+		} else {
+			(*javaEnv)->DeleteGlobalRef(javaEnv, objectInterface->object);
+			LJ_ATOMIC_DECREMENT_INT(&env->objectRefs);
+		}
+		objectInterface->object = NULL;
+	}
+	freeHandle(state, objectInterface);
+}
+
+// lua called method to release a java object handle from a finalizer
+//  its global reference is queued and deleted with others when the queue is flushed,
+//  local references of scoped handles are left to their scope.
+//  Finalizers may run within a critical pin, where scoped handles are told apart without jni
+//  and their local reference is left to the scope pop
+void internal_javaDeferReleaseObject(ljJavaObject_t* objectInterface) {
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)objectInterface->ljEnv;
+	ljThreadState_t* state = getThreadState(env);
+	JNIEnv * javaEnv = state->javaEnv;
+
+	if (objectInterface->object != NULL) {
+		if (state->criticalPins > 0) {
+			if (state->scopeDepth == 0 || !forgetScopedHandle(state, objectInterface)) {
+				queueRelease(state, (jobject)objectInterface->object);
+			}
+		} else if (state->scopeDepth > 0 && (*javaEnv)->GetObjectRefType(javaEnv, objectInterface->object) == JNILocalRefType) {
+			(*javaEnv)->DeleteLocalRef(javaEnv, objectInterface->object);
+			forgetScopedHandle(state, objectInterface);
+		} else {
+			queueRelease(state, (jobject)objectInterface->object);
+		}
+		objectInterface->object = NULL;
+	}
+	freeHandle(state, objectInterface);
+}
+
+// lua called method to release a java class handle from a finalizer
+//  registered classes involve no jni call, so that nothing needs to be queued
+void internal_javaDeferReleaseClass(ljJavaClass_t* classInterface) {
+	internal_javaReleaseClass(classInterface);
+}
+
+// lua called method to delete all queued releases now, unless a critical pin is held
+void internal_javaFlushReleases(void* ljEnv) {
+	ljThreadState_t* state = getThreadState((ljJavaEnvironment_t*)ljEnv);
+
+	if (state->criticalPins == 0) {
+		flushReleases(state);
+	}
+}
+
+// lua called method to set the number of queued releases that triggers a flush
+void internal_javaSetReleaseThreshold(void* ljEnv, int threshold) {
+	((ljJavaEnvironment_t*)ljEnv)->releaseThreshold = threshold > 0 ? threshold : 1;
+}
+
+//wrap a local reference into a new object handle
+// outside of scopes the handle holds a global reference and the local reference is released,
+// inside a scope the local reference is kept and freed with the scope
+ljJavaObject_t* newObjectHandle(void* ljEnv, JNIEnv * javaEnv, jobject localObject)
+{
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)ljEnv;
+	ljThreadState_t* state = getThreadState(env);
+	ljJavaObject_t* returnObject;
+
+	returnObject = allocHandle(state);
+	if (state->scopeDepth > 0) {
+		returnObject->object = localObject;
+		trackScopedHandle(state, returnObject);
+	} else {
+		returnObject->object = (*javaEnv)->NewGlobalRef(javaEnv, localObject);
+		(*javaEnv)->DeleteLocalRef(javaEnv, localObject);
+		LJ_ATOMIC_INCREMENT_INT(&env->objectRefs);
+	}
+	return returnObject;
+}
+
+
+//make the string buffer of the calling thread at least size bytes long
+static char* reserveStringBuffer(ljThreadState_t* state, int size)
+{
+	if (size > state->stringBufferSize) {
+		free(state->stringBuffer);
+		state->stringBufferSize = size > 256 ? size : 256;
+		state->stringBuffer = malloc(state->stringBufferSize);
+	}
+	return state->stringBuffer;
+}
+
+//copy a java string in the string buffer of the calling thread, as standard utf-8 followed by a NUL
+// the copy stays valid until the next string result on this thread
+const char* copyJavaString(ljJavaEnvironment_t* env, JNIEnv * javaEnv, jstring str, int* length)
+{
+	jchar stackUnits[LJ_STRING_STACK_SIZE];
+	int nUnits;
+	jchar* units = getJavaChars(javaEnv, str, stackUnits, &nUnits);
+	int utfLength = encodeUtf8(units, nUnits, NULL);
+	char* buffer = reserveStringBuffer(getThreadState(env), utfLength + 1);
+
+	encodeUtf8(units, nUnits, buffer);
+	buffer[utfLength] = '\0';
+	if (units != stackUnits) {
+		free(units);
+	}
+	*length = utfLength;
+	return buffer;
+}
+
+//fill a call result from a primitive java value of the given type
+static void setPrimitiveResult(javaArgType_t type, jvalue value, ljJavaResult_t* result)
+{
+	result->type = type;
+	switch (type) {
+	case JTYPE_BYTE:
+		result->value.b = (char) value.b;
+		break;
+	case JTYPE_SHORT:
+		result->value.s = (short) value.s;
+		break;
+	case JTYPE_INT:
+		result->value.i = (int) value.i;
+		break;
+	case JTYPE_LONG:
+		result->value.j = (long long) value.j;
+		break;
+	case JTYPE_FLOAT:
+		result->value.f = (float) value.f;
+		break;
+	case JTYPE_DOUBLE:
+		result->value.d = (double) value.d;
+		break;
+	case JTYPE_BOOLEAN:
+		result->value.z = value.z ? 1 : 0;
+		break;
+	case JTYPE_CHAR:
+		result->value.c = (unsigned short) value.c;
+		break;
+	default:
+		result->type = JTYPE_NONE;
+		break;
+	}
+}
+
+//fill a call result from a java reference known not to be a string or boxed primitive
+// the object is returned as a new handle, without being classified
+static void setObjectResult(ljJavaEnvironment_t* env, JNIEnv * javaEnv, jobject object, ljJavaResult_t* result)
+{
+	result->length = 0;
+	result->value.j = 0;
+	if (object == NULL) {
+		result->type = JTYPE_NONE;
+		return;
+	}
+	result->type = JTYPE_OBJECT;
+	result->value.object = newObjectHandle(env, javaEnv, object);
+}
+
+//fill a call result from a java value of the given type
+// boxed primitives and strings are returned as values, other objects as new handles
+// a local reference held by the value is released
+void setJavaResult(ljJavaEnvironment_t* env, JNIEnv * javaEnv, javaArgType_t type, jvalue value, ljJavaResult_t* result)
+{
+	result->length = 0;
+	result->value.j = 0;
+	if (type == JTYPE_STRING || type == JTYPE_OBJECT) {
+		if (value.l == NULL) {
+			result->type = JTYPE_NONE;
+			return;
+		}
+		//references of a declared string type need no classification
+		if (type == JTYPE_OBJECT) {
+			type = classifyJavaObject(javaEnv, value.l);
+		}
+		if (type == JTYPE_OBJECT) {
+			result->type = JTYPE_OBJECT;
+			result->value.object = newObjectHandle(env, javaEnv, value.l);
+			return;
+		}
+		if (type == JTYPE_STRING) {
+			result->type = JTYPE_STRING;
+			result->value.string = copyJavaString(env, javaEnv, value.l, &result->length);
+			(*javaEnv)->DeleteLocalRef(javaEnv, value.l);
+			return;
+		}
+		jobject boxed = value.l;
+		value = unboxJavaObject(javaEnv, type, boxed);
+		(*javaEnv)->DeleteLocalRef(javaEnv, boxed);
+	}
+
+	setPrimitiveResult(type, value, result);
+}
+
+//find the resolved field of a receiver, resolving it on first use
+// names that are not fields give an entry with a NULL fieldID
+static ljFieldCacheEntry_t* findField(ljJavaEnvironment_t* env, JNIEnv * javaEnv, jobject receiver, int classReceiver, const char * key)
+{
+	jclass clazz;
+	ljFieldCacheEntry_t* entry;
+	unsigned int hash;
+
+	clazz = findReceiverClass(env, javaEnv, receiver, &classReceiver)->clazz;
+	hash = hashMemberKey(clazz, classReceiver, key, 0, NULL);
+	entry = lookupField(env, clazz, classReceiver, key, hash);
+	if (entry == NULL) {
+		//another thread may have resolved the same field meanwhile
+		LJ_MUTEX_LOCK(&env->cacheLock);
+		entry = lookupField(env, clazz, classReceiver, key, hash);
+		if (entry == NULL) {
+			entry = resolveField(env, clazz, classReceiver, key, hash);
+		}
+		LJ_MUTEX_UNLOCK(&env->cacheLock);
+	}
+	return entry;
+}
+
+// common implementation of field lookups on classes and objects
+//  fields are resolved once per class and name, then read directly through jni.
+//  Names that are not fields are remembered too, so that method calls
+//  do not pay for a field lookup each time
+ljJavaObject_t* internal_javaCheckField(void* ljEnv, jobject receiver, int classReceiver, const char * key)
+{
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)ljEnv;
+	JNIEnv * javaEnv;
+	jobject eventualField;
+	ljFieldCacheEntry_t* entry;
+	jobject constant;
+	long long start = statsStart(env);
+
+	javaEnv = getJavaEnv(env);
+	(*javaEnv)->ExceptionClear(javaEnv);
+
+	if (receiver == NULL) {
+		fprintf(stderr, "java field => object handle is no longer valid\n");
+		return NULL;
+	}
+
+	entry = findField(env, javaEnv, receiver, classReceiver, key);
+	if (entry->fieldID == NULL) {
+		//not a field, which is a successful lookup
+		recordOp(env, JSTATS_FIELD, statsElapsed(start), 1);
+		return NULL;
+	}
+
+	constant = LJ_ATOMIC_LOAD_PTR(&entry->constant);
+	if (constant != NULL) {
+		eventualField = (*javaEnv)->NewLocalRef(javaEnv, constant);
+	} else {
+		eventualField = boxJavaValue(javaEnv, entry->type, getResolvedField(javaEnv, entry, receiver));
+		//static final primitives and strings cannot change, keep their value
+		if (env->foldConstants && entry->isStatic && entry->isFinal && entry->type != JTYPE_OBJECT && eventualField != NULL) {
+			LJ_MUTEX_LOCK(&env->cacheLock);
+			if (entry->constant == NULL) {
+				LJ_ATOMIC_STORE_PTR(&entry->constant, (*javaEnv)->NewGlobalRef(javaEnv, eventualField));
+			}
+			LJ_MUTEX_UNLOCK(&env->cacheLock);
+		}
+	}
+
+	/* Handles exception */
+	jobject jstr = checkException(javaEnv);
+	recordOp(env, JSTATS_FIELD, statsElapsed(start), jstr == NULL);
+	if (jstr) {
+		const char * cStr;
+		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
+		fprintf(stderr, "Error. excpetion while getting index of object : %s\n", cStr);
+		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
+		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
+		return NULL;
+	}
+
+	if (eventualField != NULL) {
+		return newObjectHandle(ljEnv, javaEnv, eventualField);
+	}
+	return NULL;
+}
+
+// common implementation of typed field reads on classes and objects
+//  primitive fields are read into result without any java object, strings copied
+//  and other objects given as new handles, as method results are.
+//  Returns 1 when key is a field, result being JTYPE_NONE for a null value,
+//  0 when it is not one or cannot be read
+int internal_javaCheckFieldR(void* ljEnv, jobject receiver, int classReceiver, const char * key, ljJavaResult_t* result)
+{
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)ljEnv;
+	JNIEnv * javaEnv;
+	ljFieldCacheEntry_t* entry;
+	jobject constant;
+	jvalue value;
+	int foldable;
+	long long start = statsStart(env);
+
+	javaEnv = getJavaEnv(env);
+	(*javaEnv)->ExceptionClear(javaEnv);
+	result->type = JTYPE_NONE;
+	result->length = 0;
+	result->value.j = 0;
+
+	if (receiver == NULL) {
+		fprintf(stderr, "java field => object handle is no longer valid\n");
+		return 0;
+	}
+
+	entry = findField(env, javaEnv, receiver, classReceiver, key);
+	if (entry->fieldID == NULL) {
+		//not a field, which is a successful lookup
+		recordOp(env, JSTATS_FIELD, statsElapsed(start), 1);
+		return 0;
+	}
+
+	//static final primitives and strings cannot change, their value is kept once read
+	foldable = env->foldConstants && entry->isStatic && entry->isFinal && entry->type != JTYPE_OBJECT;
+	if (foldable && LJ_ATOMIC_LOAD_INT(&entry->hasConstantValue)) {
+		setPrimitiveResult(entry->type, entry->constantValue, result);
+		recordOp(env, JSTATS_FIELD, statsElapsed(start), 1);
+		return 1;
+	}
+	constant = foldable ? LJ_ATOMIC_LOAD_PTR(&entry->constant) : NULL;
+	if (constant != NULL && entry->type == JTYPE_STRING) {
+		result->type = JTYPE_STRING;
+		result->value.string = copyJavaString(env, javaEnv, constant, &result->length);
+		recordOp(env, JSTATS_FIELD, statsElapsed(start), 1);
+		return 1;
+	}
+
+	value = getResolvedField(javaEnv, entry, receiver);
+
+	/* Handles exception */
+	jobject jstr = checkException(javaEnv);
+	recordOp(env, JSTATS_FIELD, statsElapsed(start), jstr == NULL);
+	if (jstr) {
+		const char * cStr;
+		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
+		fprintf(stderr, "Error. exception while reading field %s : %s\n", key, cStr);
+		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
+		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
+		return 0;
+	}
+
+	if (foldable) {
+		LJ_MUTEX_LOCK(&env->cacheLock);
+		if (entry->type == JTYPE_STRING) {
+			if (entry->constant == NULL && value.l != NULL) {
+				LJ_ATOMIC_STORE_PTR(&entry->constant, (*javaEnv)->NewGlobalRef(javaEnv, value.l));
+			}
+		} else if (!entry->hasConstantValue) {
+			entry->constantValue = value;
+			//published once the value is written, readers test the flag first
+			LJ_ATOMIC_STORE_INT(&entry->hasConstantValue, 1);
+		}
+		LJ_MUTEX_UNLOCK(&env->cacheLock);
+	}
+	if (entry->type == JTYPE_STRING || entry->type == JTYPE_OBJECT) {
+		setJavaResult(env, javaEnv, entry->type, value, result);
+	} else {
+		setPrimitiveResult(entry->type, value, result);
+	}
+	return 1;
+}
+
+// method to look for a static field in a class
+ljJavaObject_t* internal_javaCheckClassField(ljJavaClass_t* classInterface, const char * key)
+{
+	return internal_javaCheckField(classInterface->ljEnv, (jobject)classInterface->classObject, 1, key);
+}
+
+// lua called method to read a static field of a class into a typed result
+int internal_javaCheckClassFieldR(ljJavaClass_t* classInterface, const char * key, ljJavaResult_t* result)
+{
+	return internal_javaCheckFieldR(classInterface->ljEnv, (jobject)classInterface->classObject, 1, key, result);
+}
+
+// common implementation of method calls on classes and objects
+//  the method is looked for in the resolved method cache, or resolved on first call,
+//  then called directly through jni. Calls that cannot be resolved unambiguously
+//  go through the LuaJitJavaAPI.runMethod proxy.
+//  The result is given as a java value of type resultType, references being local ones,
+//  valueResult being cleared when an object result cannot be a string or boxed primitive
+int internal_javaInvoke(void* ljEnv, jobject receiver, int classReceiver, const char * methodName,
+	int nValues, const javaArgType_t* argTypes, const ljJavaValue_t* args, jvalue* result, javaArgType_t* resultType,
+	int* valueResult)
+{
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)ljEnv;
+	JNIEnv * javaEnv;
+	jclass clazz;
+	jstring str;
+	jvalue values[LJ_MAX_ARGS];
+	ljMethodCacheEntry_t* entry;
+	unsigned int hash;
+	long long start = statsStart(env);
+	long long elapsed;
+
+	javaEnv = getJavaEnv(env);
+	(*javaEnv)->ExceptionClear(javaEnv);
+
+	if (receiver == NULL) {
+		fprintf(stderr, "java call => object handle is no longer valid\n");
+		entry = NULL;
+	} else if (!toJavaValues(javaEnv, nValues, argTypes, args, values)) {
+		entry = NULL;
+	} else {
+		//class objects are called as classes, as the java proxy does
+		clazz = findReceiverClass(env, javaEnv, receiver, &classReceiver)->clazz;
+		hash = hashMemberKey(clazz, classReceiver, methodName, nValues, argTypes);
+		entry = lookupMethod(env, clazz, classReceiver, methodName, nValues, argTypes, hash);
+		if (entry == NULL) {
+			//another thread may have resolved the same method meanwhile
+			LJ_MUTEX_LOCK(&env->cacheLock);
+			entry = lookupMethod(env, clazz, classReceiver, methodName, nValues, argTypes, hash);
+			if (entry == NULL) {
+				entry = resolveMethod(env, clazz, classReceiver, methodName, nValues, argTypes, hash);
+			}
+			LJ_MUTEX_UNLOCK(&env->cacheLock);
+		}
+
+		if (entry->methodID != NULL && checkMethodArgs(javaEnv, entry, values)) {
+			*result = callResolvedMethod(javaEnv, entry, receiver, values);
+			*resultType = entry->returnType;
+			*valueResult = entry->valueReturn;
+		} else {
+			/* Run method through our java proxy */
+			jobjectArray javaArgArray = boxJavaArgs(javaEnv, nValues, argTypes, values);
+			str = internSymbol(env, javaEnv, methodName);
+			result->l = (*javaEnv)->CallStaticObjectMethod(javaEnv, luajitjava_binding_class, luajitjava_run_method, receiver, str, javaArgArray);
+			*resultType = JTYPE_OBJECT;
+			*valueResult = 1;
+			releasejavaArgs(javaEnv, javaArgArray);
+		}
+		releaseJavaValues(javaEnv, nValues, argTypes, values);
+	}
+
+	/* Handles exception, calls that could not be made counting as failed ones */
+	jobject jstr = checkException(javaEnv);
+	elapsed = statsElapsed(start);
+	recordOp(env, JSTATS_METHOD, elapsed, entry != NULL && jstr == NULL);
+	if (entry != NULL) {
+		recordLatency(env, &entry->latency, elapsed, jstr == NULL);
+	}
+	if (jstr) {
+		const char * cStr;
+		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
+		fprintf(stderr, "Error. exception while getting method of object : %s\n", cStr);
+		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
+		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
+		return 0;
+	}
+	return entry != NULL;
+}
+
+// method call returning its result as an object handle, primitive results being boxed
+ljJavaObject_t* internal_javaRunMethod(void* ljEnv, jobject receiver, int classReceiver, const char * methodName,
+	int nValues, const javaArgType_t* argTypes, const ljJavaValue_t* args)
+{
+	JNIEnv * javaEnv = getJavaEnv((ljJavaEnvironment_t*)ljEnv);
+	jvalue result;
+	javaArgType_t resultType;
+	int valueResult;
+	jobject resultObj;
+
+	if (!internal_javaInvoke(ljEnv, receiver, classReceiver, methodName, nValues, argTypes, args, &result, &resultType,
+		&valueResult)) {
+		return NULL;
+	}
+	resultObj = boxJavaValue(javaEnv, resultType, result);
+
+	if (resultObj != NULL && !(*javaEnv)->IsSameObject(javaEnv, resultObj, NULL)) {
+		return newObjectHandle(ljEnv, javaEnv, resultObj);
+	}
+	return NULL;
+}
+
+// method call filling a typed result, an object handle is only created for references
+//  that are neither strings nor boxed primitives
+int internal_javaRunMethodR(void* ljEnv, jobject receiver, int classReceiver, const char * methodName,
+	int nValues, const javaArgType_t* argTypes, const ljJavaValue_t* args, ljJavaResult_t* result)
+{
+	jvalue value;
+	javaArgType_t valueType;
+	int valueResult;
+
+	if (!internal_javaInvoke(ljEnv, receiver, classReceiver, methodName, nValues, argTypes, args, &value, &valueType,
+		&valueResult)) {
+		result->type = JTYPE_NONE;
+		return 0;
+	}
+	if (valueType == JTYPE_OBJECT && !valueResult) {
+		setObjectResult((ljJavaEnvironment_t*)ljEnv, getJavaEnv((ljJavaEnvironment_t*)ljEnv), value.l, result);
+		return 1;
+	}
+	setJavaResult((ljJavaEnvironment_t*)ljEnv, getJavaEnv((ljJavaEnvironment_t*)ljEnv), valueType, value, result);
+	return 1;
+}
+
+// lua called method to look for a static method in a class corresponding to provided args
+//  then run it and return the object result
+ljJavaObject_t* internal_javaRunClassMethod(ljJavaClass_t* classInterface, const char * methodName,
+	int nValues, const javaArgType_t* argTypes, const ljJavaValue_t* args)
+{
+	return internal_javaRunMethod(classInterface->ljEnv, (jobject)classInterface->classObject, 1, methodName, nValues, argTypes, args);
+}
+
+
+// lua called method to run a static method of a class, filling a typed result
+int internal_javaRunClassMethodR(ljJavaClass_t* classInterface, const char * methodName,
+	int nValues, const javaArgType_t* argTypes, const ljJavaValue_t* args, ljJavaResult_t* result)
+{
+	return internal_javaRunMethodR(classInterface->ljEnv, (jobject)classInterface->classObject, 1, methodName, nValues, argTypes, args, result);
+}
+
+// lua called method to look for a field in an object instance
+ljJavaObject_t* internal_javaCheckObjectField(ljJavaObject_t* objectInterface, const char * key)
+{
+	return internal_javaCheckField(objectInterface->ljEnv, (jobject)objectInterface->object, 0, key);
+}
+
+// lua called method to read a field of an object instance into a typed result
+int internal_javaCheckObjectFieldR(ljJavaObject_t* objectInterface, const char * key, ljJavaResult_t* result)
+{
+	return internal_javaCheckFieldR(objectInterface->ljEnv, (jobject)objectInterface->object, 0, key, result);
+}
+
+// lua called method to look for a method in an object instance corresponding to provided args
+//  then run it and return the object result
+ljJavaObject_t* internal_javaRunObjectMethod(ljJavaObject_t* objectInterface, const char * methodName,
+	int nValues, const javaArgType_t* argTypes, const ljJavaValue_t* args)
+{
+	return internal_javaRunMethod(objectInterface->ljEnv, (jobject)objectInterface->object, 0, methodName, nValues, argTypes, args);
+}
+
+// lua called method to run a method of an object instance, filling a typed result
+int internal_javaRunObjectMethodR(ljJavaObject_t* objectInterface, const char * methodName,
+	int nValues, const javaArgType_t* argTypes, const ljJavaValue_t* args, ljJavaResult_t* result)
+{
+	return internal_javaRunMethodR(objectInterface->ljEnv, (jobject)objectInterface->object, 0, methodName, nValues, argTypes, args, result);
+}
+
+// utility function to read the type tag of one type of a jni signature
+//  returns a pointer past the type, or NULL if the signature is malformed
+const char* parseSignatureType(const char* signature, javaArgType_t* type) {
+	switch (*signature) {
+	case 'B':
+		*type = JTYPE_BYTE;
+		return signature + 1;
+	case 'S':
+		*type = JTYPE_SHORT;
+		return signature + 1;
+	case 'I':
+		*type = JTYPE_INT;
+		return signature + 1;
+	case 'J':
+		*type = JTYPE_LONG;
+		return signature + 1;
+	case 'F':
+		*type = JTYPE_FLOAT;
+		return signature + 1;
+	case 'D':
+		*type = JTYPE_DOUBLE;
+		return signature + 1;
+	case 'Z':
+		*type = JTYPE_BOOLEAN;
+		return signature + 1;
+	case 'C':
+		*type = JTYPE_CHAR;
+		return signature + 1;
+	case 'L': {
+		const char* end = strchr(signature, ';');
+		if (end == NULL) {
+			return NULL;
+		}
+		if (end - signature == 17 && strncmp(signature, "Ljava/lang/String;", 18) == 0) {
+			*type = JTYPE_STRING;
+		} else {
+			*type = JTYPE_OBJECT;
+		}
+		return end + 1;
+	}
+	case '[':
+		//arrays are passed as objects, whatever their element type
+		while (*signature == '[') {
+			signature++;
+		}
+		signature = parseSignatureType(signature, type);
+		*type = JTYPE_OBJECT;
+		return signature;
+	}
+	return NULL;
+}
+
+// utility function to read the argument and return types of a jni method signature
+int parseMethodSignature(const char* signature, int* nArgs, javaArgType_t* argTypes, javaArgType_t* returnType) {
+	const char* c = signature;
+
+	*nArgs = 0;
+	if (*c++ != '(') {
+		return 0;
+	}
+	while (*c != ')') {
+		if (*nArgs >= LJ_MAX_ARGS) {
+			return 0;
+		}
+		c = parseSignatureType(c, &argTypes[*nArgs]);
+		if (c == NULL) {
+			return 0;
+		}
+		(*nArgs)++;
+	}
+	c++;
+	if (*c == 'V') {
+		*returnType = JTYPE_NONE;
+		c++;
+	} else {
+		c = parseSignatureType(c, returnType);
+	}
+	return c != NULL && *c == '\0';
+}
+
+// lua called method to bind a method of a class from its name and jni signature
+//  the method is resolved once, calls then go straight to the jni call function
+//  matching its return type without any overload resolution.
+//  Instance methods are looked for first, then static ones.
+//  The classes of object parameters are kept, jni does not check arguments against them
+int internal_javaBindMethod(ljJavaMethod_t* methodInterface, ljJavaClass_t* classInterface, const char* methodName, const char* signature)
+{
+	JNIEnv * javaEnv;
+	jclass clazz;
+	jmethodID methodID;
+	int isStatic = 0;
+	int nArgs;
+	javaArgType_t argTypes[LJ_MAX_ARGS];
+	javaArgType_t returnType;
+	int hasObjectArgs = 0;
+
+	javaEnv = getJavaEnv((ljJavaEnvironment_t*)classInterface->ljEnv);
+	(*javaEnv)->ExceptionClear(javaEnv);
+
+	if (!parseMethodSignature(signature, &nArgs, argTypes, &returnType)) {
+		fprintf(stderr, "Error. Couldn't bind java method %s : invalid signature %s\n", methodName, signature);
+		return 0;
+	}
+
+	clazz = (jclass)classInterface->classObject;
+	methodID = (*javaEnv)->GetMethodID(javaEnv, clazz, methodName, signature);
+	if (methodID == NULL) {
+		(*javaEnv)->ExceptionClear(javaEnv);
+		methodID = (*javaEnv)->GetStaticMethodID(javaEnv, clazz, methodName, signature);
+		isStatic = 1;
+	}
+
+	jobject jstr = checkException(javaEnv);
+	if (jstr) {
+		const char * cStr;
+		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
+		fprintf(stderr, "Error. Couldn't bind java method %s%s : %s\n", methodName, signature, cStr);
+		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
+		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
+		return 0;
+	}
+	if (methodID == NULL) {
+		fprintf(stderr, "Error. Couldn't bind java method %s%s : unknown error\n", methodName, signature);
+		return 0;
+	}
+
+	methodInterface->ljEnv = classInterface->ljEnv;
+	methodInterface->clazz = (*javaEnv)->NewGlobalRef(javaEnv, clazz);
+	methodInterface->methodID = methodID;
+	methodInterface->isStatic = isStatic;
+	methodInterface->returnType = returnType;
+	methodInterface->nArgs = nArgs;
+	methodInterface->argTypes = malloc((nArgs > 0 ? nArgs : 1) * sizeof(javaArgType_t));
+	memcpy(methodInterface->argTypes, argTypes, nArgs * sizeof(javaArgType_t));
+	methodInterface->argClasses = calloc(nArgs > 0 ? nArgs : 1, sizeof(void*));
+	for (int i = 0; i < nArgs; i++) {
+		hasObjectArgs |= argTypes[i] == JTYPE_OBJECT;
+	}
+	if (hasObjectArgs) {
+		jobject method = (*javaEnv)->ToReflectedMethod(javaEnv, clazz, methodID, isStatic ? JNI_TRUE : JNI_FALSE);
+		jobjectArray paramTypes = (*javaEnv)->CallObjectMethod(javaEnv, method, java_method_get_parameter_types);
+		for (int i = 0; i < nArgs; i++) {
+			if (argTypes[i] == JTYPE_OBJECT) {
+				jobject paramType = (*javaEnv)->GetObjectArrayElement(javaEnv, paramTypes, i);
+				methodInterface->argClasses[i] = (*javaEnv)->NewGlobalRef(javaEnv, paramType);
+				(*javaEnv)->DeleteLocalRef(javaEnv, paramType);
+			}
+		}
+		(*javaEnv)->DeleteLocalRef(javaEnv, paramTypes);
+		(*javaEnv)->DeleteLocalRef(javaEnv, method);
+	}
+	return 1;
+}
+
+// release a bound method handle
+void internal_javaReleaseMethod(ljJavaMethod_t* methodInterface) {
+	JNIEnv * javaEnv = getJavaEnv((ljJavaEnvironment_t*)methodInterface->ljEnv);
+	(*javaEnv)->DeleteGlobalRef(javaEnv, methodInterface->clazz);
+	if (methodInterface->argClasses != NULL) {
+		for (int i = 0; i < methodInterface->nArgs; i++) {
+			if (methodInterface->argClasses[i] != NULL) {
+				(*javaEnv)->DeleteGlobalRef(javaEnv, methodInterface->argClasses[i]);
+			}
+		}
+	}
+	free(methodInterface->argTypes);
+	free(methodInterface->argClasses);
+	methodInterface->clazz = NULL;
+	methodInterface->methodID = NULL;
+	methodInterface->argTypes = NULL;
+	methodInterface->argClasses = NULL;
+}
+
+// common implementation of bound method calls, args are read according to the bound signature
+//  objectInterface is the receiver of instance methods and is ignored for static ones
+int internal_javaCallMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args, jvalue* result)
+{
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)methodInterface->ljEnv;
+	JNIEnv * javaEnv;
+	jobject receiver = NULL;
+	jvalue values[LJ_MAX_ARGS];
+	long long start;
+
+	result->j = 0;
+	if (methodInterface->methodID == NULL) {
+		fprintf(stderr, "java call => method is not bound\n");
+		return 0;
+	}
+	javaEnv = getJavaEnv(env);
+	(*javaEnv)->ExceptionClear(javaEnv);
+	start = statsStart(env);
+
+	if (!methodInterface->isStatic) {
+		if (objectInterface == NULL || objectInterface->object == NULL
+			|| !(*javaEnv)->IsInstanceOf(javaEnv, (jobject)objectInterface->object, (jclass)methodInterface->clazz)) {
+			fprintf(stderr, "java call => bound method called on an object of another class\n");
+			return 0;
+		}
+		receiver = (jobject)objectInterface->object;
+	}
+
+	if (!toJavaValues(javaEnv, methodInterface->nArgs, methodInterface->argTypes, args, values)) {
+		return 0;
+	}
+	//a handle of another class would make the jni call undefined
+	for (int i = 0; i < methodInterface->nArgs; i++) {
+		if (methodInterface->argClasses[i] != NULL && values[i].l != NULL
+			&& !(*javaEnv)->IsInstanceOf(javaEnv, values[i].l, (jclass)methodInterface->argClasses[i])) {
+			fprintf(stderr, "java call => argument %d of bound method is an object of another class\n", i + 1);
+			releaseJavaValues(javaEnv, methodInterface->nArgs, methodInterface->argTypes, values);
+			recordOp(env, JSTATS_BOUND_METHOD, statsElapsed(start), 0);
+			return 0;
+		}
+	}
+	*result = callMethodID(javaEnv, (jclass)methodInterface->clazz, (jmethodID)methodInterface->methodID,
+		methodInterface->isStatic, methodInterface->returnType, receiver, values);
+	releaseJavaValues(javaEnv, methodInterface->nArgs, methodInterface->argTypes, values);
+
+	/* Handles exception */
+	jobject jstr = checkException(javaEnv);
+	recordOp(env, JSTATS_BOUND_METHOD, statsElapsed(start), jstr == NULL);
+	if (jstr) {
+		const char * cStr;
+		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
+		fprintf(stderr, "Error. exception while calling bound method : %s\n", cStr);
+		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
+		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
+		return 0;
+	}
+	return 1;
+}
+
+void internal_javaCallVoidMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args) {
+	jvalue result;
+	internal_javaCallMethod(methodInterface, objectInterface, args, &result);
+}
+int internal_javaCallIntMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args) {
+	jvalue result;
+	if (!internal_javaCallMethod(methodInterface, objectInterface, args, &result)) {
+		return 0;
+	}
+	switch (methodInterface->returnType) {
+	case JTYPE_BYTE:
+		return result.b;
+	case JTYPE_SHORT:
+		return result.s;
+	case JTYPE_INT:
+		return result.i;
+	case JTYPE_BOOLEAN:
+		return result.z;
+	case JTYPE_CHAR:
+		return result.c;
+	default:
+		break;
+	}
+	fprintf(stderr, "Trying to get an int result from a method of another return type\n");
+	return 0;
+}
+long long internal_javaCallLongMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args) {
+	jvalue result;
+	if (!internal_javaCallMethod(methodInterface, objectInterface, args, &result)) {
+		return 0;
+	}
+	if (methodInterface->returnType == JTYPE_LONG) {
+		return result.j;
+	}
+	fprintf(stderr, "Trying to get a long result from a method of another return type\n");
+	return 0;
+}
+double internal_javaCallDoubleMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args) {
+	jvalue result;
+	if (!internal_javaCallMethod(methodInterface, objectInterface, args, &result)) {
+		return 0;
+	}
+	if (methodInterface->returnType == JTYPE_DOUBLE) {
+		return result.d;
+	}
+	if (methodInterface->returnType == JTYPE_FLOAT) {
+		return result.f;
+	}
+	fprintf(stderr, "Trying to get a double result from a method of another return type\n");
+	return 0;
+}
+ljJavaObject_t* internal_javaCallObjectMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args) {
+	JNIEnv * javaEnv = getJavaEnv((ljJavaEnvironment_t*)methodInterface->ljEnv);
+	jvalue result;
+	if (!internal_javaCallMethod(methodInterface, objectInterface, args, &result)) {
+		return NULL;
+	}
+	if (methodInterface->returnType != JTYPE_STRING && methodInterface->returnType != JTYPE_OBJECT) {
+		fprintf(stderr, "Trying to get an object result from a method of another return type\n");
+		return NULL;
+	}
+	if (result.l != NULL) {
+		return newObjectHandle(methodInterface->ljEnv, javaEnv, result.l);
+	}
+	return NULL;
+}
+int internal_javaCallMethodR(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args, ljJavaResult_t* result) {
+	jvalue value;
+	if (!internal_javaCallMethod(methodInterface, objectInterface, args, &value)) {
+		result->type = JTYPE_NONE;
+		return 0;
+	}
+	setJavaResult((ljJavaEnvironment_t*)methodInterface->ljEnv, getJavaEnv((ljJavaEnvironment_t*)methodInterface->ljEnv),
+		methodInterface->returnType, value, result);
+	return 1;
+}
 
-	/* Run method through our java proxy */
-	str = (*javaEnv)->NewStringUTF(javaEnv, methodName);
-	resultObj = (*javaEnv)->CallStaticObjectMethod(javaEnv, luajitjava_binding_class, luajitjava_run_method, containerClass, str, javaArgArray);
-	(*javaEnv)->DeleteLocalRef(javaEnv, str);
-	releasejavaArgs(javaEnv, javaArgArray);
+int internal_javaGetObjectType(ljJavaObject_t* objectInterface) {
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)objectInterface->ljEnv;
+	JNIEnv * javaEnv;
+	int returnValue;
+	long long start;
+
+	javaEnv = getJavaEnv(env);
+	(*javaEnv)->ExceptionClear(javaEnv);
+	start = statsStart(env);
 
+	returnValue = classifyJavaObject(javaEnv, (jobject)objectInterface->object);
 	/* Handles exception */
 	jobject jstr = checkException(javaEnv);
 	if (jstr) {
@@ -539,210 +3738,1088 @@ ljJavaObject_t* internal_javaRunClassMethod(ljJavaClass_t* classInterface, const
 		fprintf(stderr, "Error. exception while getting method of object : %s\n", cStr);
 		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
 		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
-		return NULL;
+		recordOp(env, JSTATS_VALUE, statsElapsed(start), 0);
+		return JTYPE_NONE;
+	}
+	recordOp(env, JSTATS_VALUE, statsElapsed(start), 1);
+	return returnValue;
+}
+
+int internal_javaGetObjectIntValue(ljJavaObject_t* objectInterface) {
+	JNIEnv * javaEnv = getJavaEnv((ljJavaEnvironment_t*)objectInterface->ljEnv);
+	javaArgType_t type = classifyJavaObject(javaEnv, (jobject)objectInterface->object);
+	jvalue value;
+	switch (type) {
+	case JTYPE_BYTE:
+	case JTYPE_SHORT:
+	case JTYPE_INT:
+		value = unboxJavaObject(javaEnv, type, (jobject)objectInterface->object);
+		return type == JTYPE_BYTE ? value.b : type == JTYPE_SHORT ? value.s : value.i;
+	case JTYPE_BOOLEAN:
+		return unboxJavaObject(javaEnv, type, (jobject)objectInterface->object).z;
+	case JTYPE_CHAR:
+		return unboxJavaObject(javaEnv, type, (jobject)objectInterface->object).c;
+	default:
+		break;
+	}
+	fprintf(stderr, "Trying to access int value of a non int type\n");
+	return 0;
+}
+long internal_javaGetObjectLongValue(ljJavaObject_t* objectInterface) {
+	JNIEnv * javaEnv = getJavaEnv((ljJavaEnvironment_t*)objectInterface->ljEnv);
+	if (classifyJavaObject(javaEnv, (jobject)objectInterface->object) == JTYPE_LONG) {
+		return (long) (*javaEnv)->CallLongMethod(javaEnv, objectInterface->object, java_long_value);
+	}
+	fprintf(stderr, "Trying to access int value of a non int type\n");
+	return 0;
+}
+float internal_javaGetObjectFloatValue(ljJavaObject_t* objectInterface) {
+	JNIEnv * javaEnv = getJavaEnv((ljJavaEnvironment_t*)objectInterface->ljEnv);
+	if (classifyJavaObject(javaEnv, (jobject)objectInterface->object) == JTYPE_FLOAT) {
+		return (*javaEnv)->CallFloatMethod(javaEnv, objectInterface->object, java_float_value);
+	}
+	fprintf(stderr, "Trying to access float value of a non float type\n");
+	return 0;
+}
+double internal_javaGetObjectDoubleValue(ljJavaObject_t* objectInterface) {
+	JNIEnv * javaEnv = getJavaEnv((ljJavaEnvironment_t*)objectInterface->ljEnv);
+	if (classifyJavaObject(javaEnv, (jobject)objectInterface->object) == JTYPE_DOUBLE) {
+		return (*javaEnv)->CallDoubleMethod(javaEnv, objectInterface->object, java_double_value);
+	}
+	fprintf(stderr, "Trying to access double value of a non double type\n");
+	return 0;
+}
+// lua called method to get a java string as a new standard utf-8 copy, to be given back to javaReleaseStringValue
+const char* internal_javaGetObjectStringValue(ljJavaObject_t* objectInterface) {
+	JNIEnv * javaEnv = getJavaEnv((ljJavaEnvironment_t*)objectInterface->ljEnv);
+	if (classifyJavaObject(javaEnv, (jobject)objectInterface->object) == JTYPE_STRING) {
+		jchar stackUnits[LJ_STRING_STACK_SIZE];
+		int nUnits;
+		jchar* units = getJavaChars(javaEnv, (jstring)objectInterface->object, stackUnits, &nUnits);
+		int length = encodeUtf8(units, nUnits, NULL);
+		char* copy = malloc(length + 1);
+		encodeUtf8(units, nUnits, copy);
+		copy[length] = '\0';
+		if (units != stackUnits) {
+			free(units);
+		}
+		return copy;
+	}
+	fprintf(stderr, "Trying to access string value of a non string type\n");
+	return NULL;
+}
+
+// lua called method to get the value of a java object in a single call, classifying and unboxing it.
+//  Boxed primitives are returned with their primitive type, strings as a copy valid until the next call
+//  returning a string on this thread, other objects as JTYPE_OBJECT and the given handle itself.
+//  A null object gives JTYPE_NONE
+int internal_javaGetObjectValue(ljJavaObject_t* objectInterface, ljJavaResult_t* result) {
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)objectInterface->ljEnv;
+	JNIEnv * javaEnv = getJavaEnv(env);
+	jobject object = (jobject)objectInterface->object;
+	javaArgType_t type;
+	long long start = statsStart(env);
+
+	(*javaEnv)->ExceptionClear(javaEnv);
+	result->length = 0;
+	result->value.j = 0;
+
+	type = classifyJavaObject(javaEnv, object);
+	if (type == JTYPE_NONE) {
+		result->type = JTYPE_NONE;
+	} else if (type == JTYPE_OBJECT) {
+		result->type = JTYPE_OBJECT;
+		result->value.object = objectInterface;
+	} else if (type == JTYPE_STRING) {
+		result->type = JTYPE_STRING;
+		result->value.string = copyJavaString(env, javaEnv, object, &result->length);
+	} else {
+		setPrimitiveResult(type, unboxJavaObject(javaEnv, type, object), result);
+
+		/* Handles exception */
+		jobject jstr = checkException(javaEnv);
+		if (jstr) {
+			const char * cStr;
+			cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
+			fprintf(stderr, "Error. exception while getting value of object : %s\n", cStr);
+			(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
+			(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
+			result->type = JTYPE_NONE;
+			recordOp(env, JSTATS_VALUE, statsElapsed(start), 0);
+			return 0;
+		}
+	}
+	recordOp(env, JSTATS_VALUE, statsElapsed(start), 1);
+	return 1;
+}
+void internal_javaSetConstantFolding(void* ljEnv, int enabled) {
+	((ljJavaEnvironment_t*)ljEnv)->foldConstants = enabled;
+}
+void internal_javaGetStats(void* ljEnv, ljJavaStats_t* stats) {
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)ljEnv;
+	LJ_MUTEX_LOCK(&env->handleLock);
+	stats->handlesFree = env->freeHandleCount;
+	stats->handlesInUse = env->handleCapacity;
+	stats->handleSlabs = env->handleSlabCount;
+	LJ_MUTEX_UNLOCK(&env->handleLock);
+	//counters of threads are summed while they may still move
+	stats->pendingReleases = 0;
+	LJ_MUTEX_LOCK(&env->threadLock);
+	for (int op = 0; op < JSTATS_OP_COUNT; op++) {
+		copyLatency(&stats->ops[op], &env->ops[op]);
+	}
+	for (ljThreadState_t* state = env->threadStates; state != NULL; state = state->nextState) {
+		stats->handlesFree += LJ_ATOMIC_LOAD_INT(&state->handleCacheCount);
+		stats->pendingReleases += LJ_ATOMIC_LOAD_INT(&state->releaseQueueCount);
+		for (int op = 0; op < JSTATS_OP_COUNT; op++) {
+			addLatency(&stats->ops[op], &state->ops[op]);
+		}
+	}
+	LJ_MUTEX_UNLOCK(&env->threadLock);
+	stats->handlesInUse -= stats->handlesFree;
+	stats->objectRefs = LJ_ATOMIC_LOAD_INT(&env->objectRefs);
+	stats->registeredClasses = LJ_ATOMIC_LOAD_INT(&env->registeredClasses);
+	stats->classHandles = 0;
+	for (int bucket = 0; bucket < LJ_CLASS_REGISTRY_SIZE; bucket++) {
+		for (ljClassEntry_t* entry = LJ_ATOMIC_LOAD_PTR(&env->classes[bucket]); entry != NULL; entry = entry->next) {
+			stats->classHandles += LJ_ATOMIC_LOAD_INT(&entry->refCount);
+		}
+	}
+	stats->cachedMethods = 0;
+	for (int bucket = 0; bucket < LJ_METHOD_CACHE_SIZE; bucket++) {
+		for (ljMethodCacheEntry_t* entry = LJ_ATOMIC_LOAD_PTR(&env->methodCache[bucket]); entry != NULL; entry = entry->next) {
+			stats->cachedMethods++;
+		}
+	}
+	stats->cachedFields = 0;
+	for (int bucket = 0; bucket < LJ_FIELD_CACHE_SIZE; bucket++) {
+		for (ljFieldCacheEntry_t* entry = LJ_ATOMIC_LOAD_PTR(&env->fieldCache[bucket]); entry != NULL; entry = entry->next) {
+			stats->cachedFields++;
+		}
+	}
+	stats->enabled = env->statsEnabled;
+	stats->methodsEnabled = env->methodStatsEnabled;
+}
+
+//copy a name into a fixed size buffer, truncating it when too long
+static void copyStatsName(char* buffer, const char* name)
+{
+	size_t length = strlen(name);
+
+	if (length >= LJ_STATS_NAME_SIZE) {
+		length = LJ_STATS_NAME_SIZE - 1;
+	}
+	memcpy(buffer, name, length);
+	buffer[length] = '\0';
+}
+
+//name of the class a method was resolved on, from the registry when the class is bound, from java otherwise
+static void getStatsClassName(ljJavaEnvironment_t* env, JNIEnv * javaEnv, jclass clazz, char* buffer)
+{
+	ljClassEntry_t* registered = findRegisteredClass(env, clazz);
+	jstring name;
+	const char * cStr;
+
+	if (registered != NULL) {
+		copyStatsName(buffer, registered->name);
+		return;
+	}
+	buffer[0] = '\0';
+	name = (jstring)(*javaEnv)->CallObjectMethod(javaEnv, clazz, java_lang_class_get_name);
+	if (name == NULL) {
+		(*javaEnv)->ExceptionClear(javaEnv);
+		return;
+	}
+	cStr = (*javaEnv)->GetStringUTFChars(javaEnv, name, NULL);
+	copyStatsName(buffer, cStr);
+	(*javaEnv)->ReleaseStringUTFChars(javaEnv, name, cStr);
+	(*javaEnv)->DeleteLocalRef(javaEnv, name);
+}
+
+// lua called method to copy the statistics of up to capacity resolved methods into stats.
+//  Returns the number of resolved methods, which may be more than capacity
+int internal_javaGetMethodStats(void* ljEnv, ljJavaMethodStats_t* stats, int capacity)
+{
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)ljEnv;
+	JNIEnv * javaEnv = getJavaEnv(env);
+	int nMethods = 0;
+
+	for (int bucket = 0; bucket < LJ_METHOD_CACHE_SIZE; bucket++) {
+		for (ljMethodCacheEntry_t* entry = LJ_ATOMIC_LOAD_PTR(&env->methodCache[bucket]); entry != NULL; entry = entry->next) {
+			if (nMethods < capacity) {
+				ljJavaMethodStats_t* methodStats = &stats[nMethods];
+				getStatsClassName(env, javaEnv, entry->clazz, methodStats->className);
+				copyStatsName(methodStats->name, entry->name);
+				methodStats->nArgs = entry->nArgs;
+				methodStats->direct = entry->methodID != NULL;
+				copyLatency(&methodStats->latency, &entry->latency);
+			}
+			nMethods++;
+		}
+	}
+	return nMethods;
+}
+
+void internal_javaSetStatsEnabled(void* ljEnv, int enabled) {
+	((ljJavaEnvironment_t*)ljEnv)->statsEnabled = enabled ? 1 : 0;
+}
+void internal_javaSetMethodStatsEnabled(void* ljEnv, int enabled) {
+	((ljJavaEnvironment_t*)ljEnv)->methodStatsEnabled = enabled ? 1 : 0;
+}
+void internal_javaReleaseStringValue(ljJavaObject_t* objectInterface, const char* stringValue) {
+	free((void*)stringValue);
+}
+
+// lua called method to copy a java string into a caller buffer, as standard utf-8 followed by a NUL,
+//  or as utf-16 when utf16 is set. Returns the length of the string in utf-8 bytes or utf-16 units,
+//  nothing being copied when the buffer is too small, so that the caller can retry with a larger one.
+//  Returns -1 for objects that are not strings
+int internal_javaGetStringValue(ljJavaObject_t* objectInterface, void* buffer, int capacity, int utf16) {
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)objectInterface->ljEnv;
+	JNIEnv * javaEnv = getJavaEnv(env);
+	jstring str = (jstring)objectInterface->object;
+	jsize nUnits;
+	jsize length;
+	long long start = statsStart(env);
+
+	if (str == NULL || !(*javaEnv)->IsInstanceOf(javaEnv, str, java_string_class)) {
+		recordOp(env, JSTATS_VALUE, statsElapsed(start), 0);
+		return -1;
+	}
+	nUnits = (*javaEnv)->GetStringLength(javaEnv, str);
+	if (utf16) {
+		if (nUnits <= capacity) {
+			(*javaEnv)->GetStringRegion(javaEnv, str, 0, nUnits, (jchar*)buffer);
+		}
+		length = nUnits;
+	} else {
+		jchar stackUnits[LJ_STRING_STACK_SIZE];
+		jchar* units = getJavaChars(javaEnv, str, stackUnits, &nUnits);
+		length = encodeUtf8(units, nUnits, NULL);
+		if (length < capacity) {
+			encodeUtf8(units, nUnits, (char*)buffer);
+			((char*)buffer)[length] = '\0';
+		}
+		if (units != stackUnits) {
+			free(units);
+		}
+	}
+	recordOp(env, JSTATS_VALUE, statsElapsed(start), 1);
+	return length;
+}
+
+/***************************************************************
+      PRIMITIVE ARRAYS
+****************************************************************/
+
+//type of the elements of a primitive java array, JTYPE_NONE for any other object
+static javaArgType_t classifyJavaArray(JNIEnv * javaEnv, jobject object)
+{
+	if (object == NULL) {
+		return JTYPE_NONE;
+	}
+	for (int type = JTYPE_BYTE; type <= JTYPE_CHAR; type++) {
+		if ((*javaEnv)->IsInstanceOf(javaEnv, object, java_primitive_array_classes[type])) {
+			return (javaArgType_t)type;
+		}
+	}
+	return JTYPE_NONE;
+}
+
+//print and clear the exception raised by an array or buffer access, returns 1 if there was one
+static int printAccessError(JNIEnv * javaEnv, const char* operation)
+{
+	jobject jstr = checkException(javaEnv);
+	if (jstr) {
+		const char * cStr;
+		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
+		fprintf(stderr, "Error. exception while %s : %s\n", operation, cStr);
+		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
+		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
+		return 1;
+	}
+	return 0;
+}
+
+// lua called method to create a primitive java array of length zeroed elements
+int internal_javaNewArray(ljJavaObject_t* objectInterface, int elementType, int length)
+{
+	JNIEnv * javaEnv = getJavaEnv((ljJavaEnvironment_t*)objectInterface->ljEnv);
+	jarray newArray;
+
+	(*javaEnv)->ExceptionClear(javaEnv);
+	switch (elementType) {
+	case JTYPE_BYTE:
+		newArray = (*javaEnv)->NewByteArray(javaEnv, length);
+		break;
+	case JTYPE_SHORT:
+		newArray = (*javaEnv)->NewShortArray(javaEnv, length);
+		break;
+	case JTYPE_INT:
+		newArray = (*javaEnv)->NewIntArray(javaEnv, length);
+		break;
+	case JTYPE_LONG:
+		newArray = (*javaEnv)->NewLongArray(javaEnv, length);
+		break;
+	case JTYPE_FLOAT:
+		newArray = (*javaEnv)->NewFloatArray(javaEnv, length);
+		break;
+	case JTYPE_DOUBLE:
+		newArray = (*javaEnv)->NewDoubleArray(javaEnv, length);
+		break;
+	case JTYPE_BOOLEAN:
+		newArray = (*javaEnv)->NewBooleanArray(javaEnv, length);
+		break;
+	case JTYPE_CHAR:
+		newArray = (*javaEnv)->NewCharArray(javaEnv, length);
+		break;
+	default:
+		fprintf(stderr, "java new array => arrays can only be created for primitive types\n");
+		return 0;
+	}
+	if (printAccessError(javaEnv, "creating array") || newArray == NULL) {
+		return 0;
+	}
+	objectInterface->object = (*javaEnv)->NewGlobalRef(javaEnv, newArray);
+	objectInterface->pool = NULL;
+	(*javaEnv)->DeleteLocalRef(javaEnv, newArray);
+	LJ_ATOMIC_INCREMENT_INT(&((ljJavaEnvironment_t*)objectInterface->ljEnv)->objectRefs);
+	return 1;
+}
+
+// lua called method to get the element type of a primitive java array, JTYPE_NONE for other objects
+int internal_javaGetArrayType(ljJavaObject_t* objectInterface)
+{
+	JNIEnv * javaEnv = getJavaEnv((ljJavaEnvironment_t*)objectInterface->ljEnv);
+	return classifyJavaArray(javaEnv, (jobject)objectInterface->object);
+}
+
+// lua called method to get the length of a primitive java array, -1 for other objects
+int internal_javaGetArrayLength(ljJavaObject_t* objectInterface)
+{
+	JNIEnv * javaEnv = getJavaEnv((ljJavaEnvironment_t*)objectInterface->ljEnv);
+	if (classifyJavaArray(javaEnv, (jobject)objectInterface->object) == JTYPE_NONE) {
+		return -1;
+	}
+	return (*javaEnv)->GetArrayLength(javaEnv, (jarray)objectInterface->object);
+}
+
+// lua called method to pin the elements of a primitive java array for direct access.
+//  Critical pins give the array memory itself whenever the JVM can, but the thread must not make
+//  any other java call until javaUnpinArray. Other pins may get a copy, written back when unpinned.
+//  The array is referenced by the pin, so that the object handle can be released meanwhile
+int internal_javaPinArray(ljJavaArray_t* arrayInterface, ljJavaObject_t* objectInterface, int critical)
+{
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)objectInterface->ljEnv;
+	ljThreadState_t* state = getThreadState(env);
+	JNIEnv * javaEnv = state->javaEnv;
+	long long start = statsStart(env);
+	javaArgType_t type = classifyJavaArray(javaEnv, (jobject)objectInterface->object);
+	jarray array;
+	jboolean isCopy = JNI_FALSE;
+	jsize length;
+	void* elements;
+
+	if (type == JTYPE_NONE) {
+		fprintf(stderr, "java pin array => object is not a primitive array\n");
+		recordOp(env, JSTATS_ARRAY, statsElapsed(start), 0);
+		return 0;
+	}
+	array = (*javaEnv)->NewGlobalRef(javaEnv, (jobject)objectInterface->object);
+	//the length is read first, as no jni call is allowed within a critical section
+	length = (*javaEnv)->GetArrayLength(javaEnv, array);
+	if (critical) {
+		elements = (*javaEnv)->GetPrimitiveArrayCritical(javaEnv, array, &isCopy);
+	} else {
+		switch (type) {
+		case JTYPE_BYTE:
+			elements = (*javaEnv)->GetByteArrayElements(javaEnv, array, &isCopy);
+			break;
+		case JTYPE_SHORT:
+			elements = (*javaEnv)->GetShortArrayElements(javaEnv, array, &isCopy);
+			break;
+		case JTYPE_INT:
+			elements = (*javaEnv)->GetIntArrayElements(javaEnv, array, &isCopy);
+			break;
+		case JTYPE_LONG:
+			elements = (*javaEnv)->GetLongArrayElements(javaEnv, array, &isCopy);
+			break;
+		case JTYPE_FLOAT:
+			elements = (*javaEnv)->GetFloatArrayElements(javaEnv, array, &isCopy);
+			break;
+		case JTYPE_DOUBLE:
+			elements = (*javaEnv)->GetDoubleArrayElements(javaEnv, array, &isCopy);
+			break;
+		case JTYPE_BOOLEAN:
+			elements = (*javaEnv)->GetBooleanArrayElements(javaEnv, array, &isCopy);
+			break;
+		default:
+			elements = (*javaEnv)->GetCharArrayElements(javaEnv, array, &isCopy);
+			break;
+		}
+	}
+	if (elements == NULL) {
+		(*javaEnv)->ExceptionClear(javaEnv);
+		(*javaEnv)->DeleteGlobalRef(javaEnv, array);
+		fprintf(stderr, "java pin array => could not get the array elements\n");
+		recordOp(env, JSTATS_ARRAY, statsElapsed(start), 0);
+		return 0;
+	}
+	arrayInterface->ljEnv = objectInterface->ljEnv;
+	arrayInterface->array = array;
+	arrayInterface->elementType = type;
+	arrayInterface->length = length;
+	arrayInterface->elements = elements;
+	arrayInterface->critical = critical ? 1 : 0;
+	arrayInterface->isCopy = isCopy ? 1 : 0;
+	if (critical) {
+		state->criticalPins++;
+	}
+	recordOp(env, JSTATS_ARRAY, statsElapsed(start), 1);
+	return 1;
+}
+
+// lua called method to unpin array elements, changes made to a copy are written back when commit is set.
+//  Releases held back by critical pins are flushed once the last one is released
+void internal_javaUnpinArray(ljJavaArray_t* arrayInterface, int commit)
+{
+	ljThreadState_t* state;
+	JNIEnv * javaEnv;
+	jarray array = (jarray)arrayInterface->array;
+	void* elements = arrayInterface->elements;
+	jint mode = commit ? 0 : JNI_ABORT;
+
+	if (elements == NULL) {
+		return;
+	}
+	state = getThreadState((ljJavaEnvironment_t*)arrayInterface->ljEnv);
+	javaEnv = state->javaEnv;
+	if (arrayInterface->critical) {
+		(*javaEnv)->ReleasePrimitiveArrayCritical(javaEnv, array, elements, mode);
+	} else {
+		switch (arrayInterface->elementType) {
+		case JTYPE_BYTE:
+			(*javaEnv)->ReleaseByteArrayElements(javaEnv, array, elements, mode);
+			break;
+		case JTYPE_SHORT:
+			(*javaEnv)->ReleaseShortArrayElements(javaEnv, array, elements, mode);
+			break;
+		case JTYPE_INT:
+			(*javaEnv)->ReleaseIntArrayElements(javaEnv, array, elements, mode);
+			break;
+		case JTYPE_LONG:
+			(*javaEnv)->ReleaseLongArrayElements(javaEnv, array, elements, mode);
+			break;
+		case JTYPE_FLOAT:
+			(*javaEnv)->ReleaseFloatArrayElements(javaEnv, array, elements, mode);
+			break;
+		case JTYPE_DOUBLE:
+			(*javaEnv)->ReleaseDoubleArrayElements(javaEnv, array, elements, mode);
+			break;
+		case JTYPE_BOOLEAN:
+			(*javaEnv)->ReleaseBooleanArrayElements(javaEnv, array, elements, mode);
+			break;
+		default:
+			(*javaEnv)->ReleaseCharArrayElements(javaEnv, array, elements, mode);
+			break;
+		}
+	}
+	arrayInterface->elements = NULL;
+	arrayInterface->array = NULL;
+	if (arrayInterface->critical && --state->criticalPins > 0) {
+		//still within an outer critical pin, the reference counts as an object one until flushed
+		LJ_ATOMIC_ADD_INT(&state->ljEnv->objectRefs, 1);
+		queueRelease(state, array);
+		return;
+	}
+	(*javaEnv)->DeleteGlobalRef(javaEnv, array);
+	//releases queued during critical pins are flushed as they would have been
+	if (state->releaseQueueCount >= state->ljEnv->releaseThreshold) {
+		flushReleases(state);
+	}
+}
+
+// lua called method to copy length elements of a primitive java array from start into buffer,
+//  which holds values of the array element type. Returns 0 when the range is out of the array
+int internal_javaGetArrayRegion(ljJavaObject_t* objectInterface, int start, int length, void* buffer)
+{
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)objectInterface->ljEnv;
+	JNIEnv * javaEnv = getJavaEnv(env);
+	jarray array = (jarray)objectInterface->object;
+	long long began = statsStart(env);
+	int ok;
+
+	(*javaEnv)->ExceptionClear(javaEnv);
+	switch (classifyJavaArray(javaEnv, array)) {
+	case JTYPE_BYTE:
+		(*javaEnv)->GetByteArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	case JTYPE_SHORT:
+		(*javaEnv)->GetShortArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	case JTYPE_INT:
+		(*javaEnv)->GetIntArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	case JTYPE_LONG:
+		(*javaEnv)->GetLongArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	case JTYPE_FLOAT:
+		(*javaEnv)->GetFloatArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	case JTYPE_DOUBLE:
+		(*javaEnv)->GetDoubleArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	case JTYPE_BOOLEAN:
+		(*javaEnv)->GetBooleanArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	case JTYPE_CHAR:
+		(*javaEnv)->GetCharArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	default:
+		fprintf(stderr, "java array region => object is not a primitive array\n");
+		recordOp(env, JSTATS_ARRAY, statsElapsed(began), 0);
+		return 0;
+	}
+	ok = !printAccessError(javaEnv, "reading array region");
+	recordOp(env, JSTATS_ARRAY, statsElapsed(began), ok);
+	return ok;
+}
+
+// lua called method to copy length elements of buffer into a primitive java array from start
+//  buffer holds values of the array element type. Returns 0 when the range is out of the array
+int internal_javaSetArrayRegion(ljJavaObject_t* objectInterface, int start, int length, const void* buffer)
+{
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)objectInterface->ljEnv;
+	JNIEnv * javaEnv = getJavaEnv(env);
+	jarray array = (jarray)objectInterface->object;
+	long long began = statsStart(env);
+	int ok;
+
+	(*javaEnv)->ExceptionClear(javaEnv);
+	switch (classifyJavaArray(javaEnv, array)) {
+	case JTYPE_BYTE:
+		(*javaEnv)->SetByteArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	case JTYPE_SHORT:
+		(*javaEnv)->SetShortArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	case JTYPE_INT:
+		(*javaEnv)->SetIntArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	case JTYPE_LONG:
+		(*javaEnv)->SetLongArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	case JTYPE_FLOAT:
+		(*javaEnv)->SetFloatArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	case JTYPE_DOUBLE:
+		(*javaEnv)->SetDoubleArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	case JTYPE_BOOLEAN:
+		(*javaEnv)->SetBooleanArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	case JTYPE_CHAR:
+		(*javaEnv)->SetCharArrayRegion(javaEnv, array, start, length, buffer);
+		break;
+	default:
+		fprintf(stderr, "java array region => object is not a primitive array\n");
+		recordOp(env, JSTATS_ARRAY, statsElapsed(began), 0);
+		return 0;
+	}
+	ok = !printAccessError(javaEnv, "writing array region");
+	recordOp(env, JSTATS_ARRAY, statsElapsed(began), ok);
+	return ok;
+}
+
+/***************************************************************
+      DIRECT BUFFERS
+****************************************************************/
+
+// lua called method to wrap memory owned by lua into a java.nio.ByteBuffer, without any copy.
+//  The memory must stay allocated as long as java may use the buffer
+int internal_javaNewDirectBuffer(ljJavaObject_t* objectInterface, void* address, long long capacity)
+{
+	JNIEnv * javaEnv = getJavaEnv((ljJavaEnvironment_t*)objectInterface->ljEnv);
+	jobject newBuffer;
+
+	(*javaEnv)->ExceptionClear(javaEnv);
+	newBuffer = (*javaEnv)->NewDirectByteBuffer(javaEnv, address, (jlong)capacity);
+	if (printAccessError(javaEnv, "creating direct buffer")) {
+		return 0;
+	}
+	if (newBuffer == NULL) {
+		fprintf(stderr, "java direct buffer => direct buffers are not supported by the JVM\n");
+		return 0;
+	}
+	objectInterface->object = (*javaEnv)->NewGlobalRef(javaEnv, newBuffer);
+	objectInterface->pool = NULL;
+	(*javaEnv)->DeleteLocalRef(javaEnv, newBuffer);
+	LJ_ATOMIC_INCREMENT_INT(&((ljJavaEnvironment_t*)objectInterface->ljEnv)->objectRefs);
+	return 1;
+}
+
+// lua called method to get the memory of a java direct buffer, NULL for other objects
+void* internal_javaGetDirectBufferAddress(ljJavaObject_t* objectInterface)
+{
+	JNIEnv * javaEnv = getJavaEnv((ljJavaEnvironment_t*)objectInterface->ljEnv);
+	return (*javaEnv)->GetDirectBufferAddress(javaEnv, (jobject)objectInterface->object);
+}
+
+// lua called method to get the capacity in bytes of a java direct buffer, -1 for other objects
+long long internal_javaGetDirectBufferCapacity(ljJavaObject_t* objectInterface)
+{
+	JNIEnv * javaEnv = getJavaEnv((ljJavaEnvironment_t*)objectInterface->ljEnv);
+	return (*javaEnv)->GetDirectBufferCapacity(javaEnv, (jobject)objectInterface->object);
+}
+
+/***************************************************************
+      ASYNCHRONOUS CALLS
+****************************************************************/
+
+//state of an asynchronous call, shared by its future and the executor task
+// each of them holds a reference, the last one released frees it
+typedef struct ljFutureState {
+	int state;
+	int refs;
+	int fd;
+	jobject result;
+	jstring error;
+} ljFutureState_t;
+
+//drop a reference to a future state
+static void releaseFutureState(JNIEnv * javaEnv, ljFutureState_t* futureState)
+{
+	if (LJ_ATOMIC_DECREMENT_INT(&futureState->refs) != 0) {
+		return;
 	}
+	if (futureState->result != NULL) {
+		(*javaEnv)->DeleteGlobalRef(javaEnv, futureState->result);
+	}
+	if (futureState->error != NULL) {
+		(*javaEnv)->DeleteGlobalRef(javaEnv, futureState->error);
+	}
+#ifdef __linux__
+	if (futureState->fd >= 0) {
+		close(futureState->fd);
+	}
+#endif
+	free(futureState);
+}
 
-	if (resultObj != NULL) {
-		returnObject = malloc(sizeof(ljJavaObject_t));
-		returnObject->ljEnv = classInterface->ljEnv;
-		returnObject->object = (*javaEnv)->NewGlobalRef(javaEnv, resultObj);
-		(*javaEnv)->DeleteLocalRef(javaEnv, resultObj);
-		return returnObject;
+//signal the completion fd of a future, if it has one
+static void signalFutureFd(ljFutureState_t* futureState)
+{
+#ifdef __linux__
+	int fd = LJ_ATOMIC_LOAD_INT(&futureState->fd);
+	if (fd >= 0) {
+		eventfd_write(fd, 1);
 	}
-	return NULL;
+#endif
 }
 
+//LuaJitJavaAPI.completeFuture, called on an executor thread once an asynchronous call is over
+static void JNICALL completeFuture(JNIEnv* env, jclass clazz, jlong future, jobject result, jthrowable error)
+{
+	ljFutureState_t* futureState = (ljFutureState_t*)(intptr_t)future;
 
-// lua called method to look for a field in an object instance
-ljJavaObject_t* internal_javaCheckObjectField(ljJavaObject_t* objectInterface, const char * key)
+	if (error != NULL) {
+		jstring message = (*env)->CallObjectMethod(env, error, throwable_tostring);
+		futureState->error = (*env)->NewGlobalRef(env, message);
+		(*env)->DeleteLocalRef(env, message);
+		LJ_ATOMIC_STORE_INT(&futureState->state, JFUTURE_FAILED);
+	} else {
+		if (result != NULL) {
+			futureState->result = (*env)->NewGlobalRef(env, result);
+		}
+		LJ_ATOMIC_STORE_INT(&futureState->state, JFUTURE_DONE);
+	}
+	wakeWord(&futureState->state);
+	signalFutureFd(futureState);
+	releaseFutureState(env, futureState);
+}
+
+//start a method call on the java executor, the future is completed by completeFuture
+int internal_javaRunMethodAsync(ljJavaFuture_t* future, void* ljEnv, jobject receiver, const char * methodName,
+	int nValues, const javaArgType_t* argTypes, const ljJavaValue_t* args)
 {
-	JNIEnv * javaEnv;
-	jobject containerObj;
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)ljEnv;
+	JNIEnv * javaEnv = getJavaEnv(env);
+	ljFutureState_t* futureState;
+	jvalue values[LJ_MAX_ARGS];
+	jobjectArray javaArgArray;
 	jstring str;
-	jobject eventualField;
-	ljJavaObject_t* returnObject;
+	long long start;
 
-	javaEnv = ((ljJavaEnvironment_t*)objectInterface->ljEnv)->javaEnv;
+	future->ljEnv = ljEnv;
+	future->state = NULL;
 	(*javaEnv)->ExceptionClear(javaEnv);
-	containerObj = (jobject)objectInterface->object;
+	start = statsStart(env);
 
-	str = (*javaEnv)->NewStringUTF(javaEnv, key);
-	eventualField = (*javaEnv)->CallStaticObjectMethod(javaEnv, luajitjava_binding_class, luajitjava_check_field, containerObj, str);
-	(*javaEnv)->DeleteLocalRef(javaEnv, str);
-	/* Handles exception */
+	if (receiver == NULL) {
+		fprintf(stderr, "java async call => object handle is no longer valid\n");
+		recordOp(env, JSTATS_ASYNC, statsElapsed(start), 0);
+		return 0;
+	}
+	if (!toJavaValues(javaEnv, nValues, argTypes, args, values)) {
+		recordOp(env, JSTATS_ASYNC, statsElapsed(start), 0);
+		return 0;
+	}
+
+	futureState = calloc(1, sizeof(ljFutureState_t));
+	futureState->state = JFUTURE_PENDING;
+	futureState->refs = 2;
+	futureState->fd = -1;
+
+	javaArgArray = boxJavaArgs(javaEnv, nValues, argTypes, values);
+	str = internSymbol(env, javaEnv, methodName);
+	(*javaEnv)->CallStaticVoidMethod(javaEnv, luajitjava_binding_class, luajitjava_run_method_async,
+		receiver, str, javaArgArray, (jlong)(intptr_t)futureState);
+	releasejavaArgs(javaEnv, javaArgArray);
+	releaseJavaValues(javaEnv, nValues, argTypes, values);
+
+	/* Handles exception, the call has then not been submitted */
 	jobject jstr = checkException(javaEnv);
 	if (jstr) {
 		const char * cStr;
 		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
-		fprintf(stderr, "Error. excpetion while getting index of object : %s\n", cStr);
+		fprintf(stderr, "Error. exception while starting asynchronous call : %s\n", cStr);
 		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
 		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
+		free(futureState);
+		recordOp(env, JSTATS_ASYNC, statsElapsed(start), 0);
 		return 0;
 	}
+	future->state = futureState;
+	recordOp(env, JSTATS_ASYNC, statsElapsed(start), 1);
+	return 1;
+}
 
-	if (eventualField != NULL) {
-		returnObject = malloc(sizeof(ljJavaObject_t));
-		returnObject->ljEnv = objectInterface->ljEnv;
-		returnObject->object = (*javaEnv)->NewGlobalRef(javaEnv, eventualField);
-		(*javaEnv)->DeleteLocalRef(javaEnv, eventualField);
-		return returnObject;
+// lua called method to run a static method of a class on the java executor
+int internal_javaRunClassMethodAsync(ljJavaFuture_t* future, ljJavaClass_t* classInterface, const char * methodName,
+	int nValues, const javaArgType_t* argTypes, const ljJavaValue_t* args)
+{
+	return internal_javaRunMethodAsync(future, classInterface->ljEnv, (jobject)classInterface->classObject, methodName, nValues, argTypes, args);
+}
+
+// lua called method to run a method of an object instance on the java executor
+int internal_javaRunObjectMethodAsync(ljJavaFuture_t* future, ljJavaObject_t* objectInterface, const char * methodName,
+	int nValues, const javaArgType_t* argTypes, const ljJavaValue_t* args)
+{
+	return internal_javaRunMethodAsync(future, objectInterface->ljEnv, (jobject)objectInterface->object, methodName, nValues, argTypes, args);
+}
+
+// lua called method to get the state of a future without blocking
+int internal_javaPollFuture(ljJavaFuture_t* future)
+{
+	ljFutureState_t* futureState = (ljFutureState_t*)future->state;
+
+	if (futureState == NULL) {
+		return JFUTURE_FAILED;
 	}
-	return NULL;
+	return LJ_ATOMIC_LOAD_INT(&futureState->state);
 }
 
-// lua called method to look for a method in an object instance corresponding to provided args
-//  then run it and return the object result
-ljJavaObject_t* internal_javaRunObjectMethod(ljJavaObject_t* objectInterface, const char * methodName, int nArgs, va_list valist)
+// lua called method to wait for a future to complete, at most timeoutMs when it is not negative
+//  returns the state of the future once done or timed out
+int internal_javaWaitFuture(ljJavaFuture_t* future, int timeoutMs)
 {
-	JNIEnv * javaEnv;
-	jobject containerObj;
-	jstring str;
-	jobject resultObj;
-	ljJavaObject_t* returnObject;
+	ljFutureState_t* futureState = (ljFutureState_t*)future->state;
+	long long deadline = timeoutMs >= 0 ? currentTimeMs() + timeoutMs : 0;
+	int state;
 
-	javaEnv = ((ljJavaEnvironment_t*)objectInterface->ljEnv)->javaEnv;
-	(*javaEnv)->ExceptionClear(javaEnv);
-	containerObj = (jobject)objectInterface->object;
+	if (futureState == NULL) {
+		return JFUTURE_FAILED;
+	}
+	while ((state = LJ_ATOMIC_LOAD_INT(&futureState->state)) == JFUTURE_PENDING) {
+		if (timeoutMs < 0) {
+			waitWord(&futureState->state, JFUTURE_PENDING, -1);
+		} else {
+			long long remaining = deadline - currentTimeMs();
+			if (remaining <= 0) {
+				break;
+			}
+			waitWord(&futureState->state, JFUTURE_PENDING, (int)remaining);
+		}
+	}
+	return state;
+}
 
-	//get java params from args
-	jobjectArray javaArgArray = getjavaArgs(javaEnv, nArgs, valist);
+// lua called method to read the monotonic clock future waits are timed with, in milliseconds,
+//  so that coroutines polling a future can keep a deadline of their own
+long long internal_javaCurrentTimeMs(void)
+{
+	return currentTimeMs();
+}
 
-	/* Run method through our java proxy */
-	str = (*javaEnv)->NewStringUTF(javaEnv, methodName);
-	resultObj = (*javaEnv)->CallStaticObjectMethod(javaEnv, luajitjava_binding_class, luajitjava_run_method, containerObj, str, javaArgArray);
-	(*javaEnv)->DeleteLocalRef(javaEnv, str);
-	releasejavaArgs(javaEnv, javaArgArray);
+// lua called method to get an fd that becomes readable once the future completes,
+//  to be watched by an event loop. It is owned by the future, -1 where eventfd is not available
+int internal_javaGetFutureFd(ljJavaFuture_t* future)
+{
+#ifdef __linux__
+	ljFutureState_t* futureState = (ljFutureState_t*)future->state;
+	int fd;
 
-	/* Handles exception */
-	jobject jstr = checkException(javaEnv);
-	if (jstr) {
+	if (futureState == NULL) {
+		return -1;
+	}
+	if (futureState->fd >= 0) {
+		return futureState->fd;
+	}
+	fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (fd < 0) {
+		return -1;
+	}
+	LJ_ATOMIC_STORE_INT(&futureState->fd, fd);
+	//the call may have completed before the fd was there to be signaled
+	if (LJ_ATOMIC_LOAD_INT(&futureState->state) != JFUTURE_PENDING) {
+		eventfd_write(fd, 1);
+	}
+	return fd;
+#else
+	return -1;
+#endif
+}
+
+// lua called method to get the result of a completed future, as a typed result
+//  returns 0 if the future is still pending or has failed
+int internal_javaGetFutureResult(ljJavaFuture_t* future, ljJavaResult_t* result)
+{
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)future->ljEnv;
+	ljFutureState_t* futureState = (ljFutureState_t*)future->state;
+	JNIEnv * javaEnv;
+	jvalue value;
+	int state;
+
+	result->type = JTYPE_NONE;
+	if (futureState == NULL) {
+		return 0;
+	}
+	state = LJ_ATOMIC_LOAD_INT(&futureState->state);
+	if (state == JFUTURE_PENDING) {
+		return 0;
+	}
+	javaEnv = getJavaEnv(env);
+	if (state == JFUTURE_FAILED) {
 		const char * cStr;
-		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
-		fprintf(stderr, "Error. exception while getting method of object : %s\n", cStr);
-		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
-		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
-		return NULL;
+		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, futureState->error, NULL);
+		fprintf(stderr, "Error. exception in asynchronous call : %s\n", cStr);
+		(*javaEnv)->ReleaseStringUTFChars(javaEnv, futureState->error, cStr);
+		return 0;
 	}
+	value.l = futureState->result != NULL ? (*javaEnv)->NewLocalRef(javaEnv, futureState->result) : NULL;
+	setJavaResult(env, javaEnv, JTYPE_OBJECT, value, result);
+	return 1;
+}
 
-	if (resultObj != NULL && !(*javaEnv)->IsSameObject(javaEnv, resultObj, NULL)) {
-		returnObject = malloc(sizeof(ljJavaObject_t));
-		returnObject->ljEnv = objectInterface->ljEnv;
-		returnObject->object = (*javaEnv)->NewGlobalRef(javaEnv, resultObj);
-		(*javaEnv)->DeleteLocalRef(javaEnv, resultObj);
-		return returnObject;
+// lua called method to release a future, a call still running completes without it
+void internal_javaReleaseFuture(ljJavaFuture_t* future)
+{
+	if (future->state != NULL) {
+		releaseFutureState(getJavaEnv((ljJavaEnvironment_t*)future->ljEnv), (ljFutureState_t*)future->state);
+		future->state = NULL;
 	}
-	return NULL;
 }
 
-int internal_javaGetObjectType(ljJavaObject_t* objectInterface) {
-	JNIEnv * javaEnv;
-	jobject object;
-	jclass objectClass;
-	int returnValue = JTYPE_NONE;
+/***************************************************************
+      BATCHED CALLS
+****************************************************************/
+
+//print the message of an exception thrown by one call of a batch
+static void printBatchError(JNIEnv * javaEnv, const char* name, jthrowable error)
+{
+	jstring message = (*javaEnv)->CallObjectMethod(javaEnv, error, throwable_tostring);
+	const char * cStr = (*javaEnv)->GetStringUTFChars(javaEnv, message, NULL);
+	fprintf(stderr, "Error. exception in batched call of %s : %s\n", name, cStr);
+	(*javaEnv)->ReleaseStringUTFChars(javaEnv, message, cStr);
+	(*javaEnv)->DeleteLocalRef(javaEnv, message);
+}
+
+//fill the java arrays given to LuaJitJavaAPI.runBatch, calls that cannot be made are marked as failed
+static void packBatchCalls(ljJavaEnvironment_t* env, JNIEnv * javaEnv, int nCalls, ljJavaBatchCall_t* calls,
+	jobjectArray receivers, jobjectArray names, jobjectArray argArrays)
+{
+	jvalue values[LJ_MAX_ARGS];
+
+	for (int i = 0; i < nCalls; i++) {
+		ljJavaBatchCall_t* call = &calls[i];
+		jobject receiver = call->classReceiver
+			? (jobject)((ljJavaClass_t*)call->receiver)->classObject
+			: (jobject)((ljJavaObject_t*)call->receiver)->object;
+
+		call->ok = 0;
+		call->result.type = JTYPE_NONE;
+		if (receiver == NULL) {
+			fprintf(stderr, "java batch => object handle is no longer valid for %s\n", call->name);
+			continue;
+		}
+		if (!call->isField) {
+			if (call->nArgs > LJ_MAX_ARGS) {
+				fprintf(stderr, "java batch => too many parameters for %s, %d at most\n", call->name, LJ_MAX_ARGS);
+				continue;
+			}
+			if (!toJavaValues(javaEnv, call->nArgs, call->argTypes, call->args, values)) {
+				continue;
+			}
+			jobjectArray javaArgArray = boxJavaArgs(javaEnv, call->nArgs, call->argTypes, values);
+			(*javaEnv)->SetObjectArrayElement(javaEnv, argArrays, i, javaArgArray);
+			releasejavaArgs(javaEnv, javaArgArray);
+			releaseJavaValues(javaEnv, call->nArgs, call->argTypes, values);
+		}
+		(*javaEnv)->SetObjectArrayElement(javaEnv, names, i, internSymbol(env, javaEnv, call->name));
+		(*javaEnv)->SetObjectArrayElement(javaEnv, receivers, i, receiver);
+		call->ok = 1;
+	}
+}
+
+//read the results of a batch, string results are copied one after the other in the thread string buffer
+static int unpackBatchResults(ljJavaEnvironment_t* env, JNIEnv * javaEnv, int nCalls, ljJavaBatchCall_t* calls,
+	jobjectArray results, jobjectArray errors)
+{
+	jstring* strings = NULL;
+	int stringsSize = 0;
+	int nDone = 0;
+	char* buffer;
+
+	for (int i = 0; i < nCalls; i++) {
+		ljJavaBatchCall_t* call = &calls[i];
+		jobject error = NULL;
+		jvalue value;
+		javaArgType_t type;
+
+		if (!call->ok) {
+			continue;
+		}
+		if (errors != NULL) {
+			error = (*javaEnv)->GetObjectArrayElement(javaEnv, errors, i);
+		}
+		if (error != NULL) {
+			printBatchError(javaEnv, call->name, error);
+			(*javaEnv)->DeleteLocalRef(javaEnv, error);
+			call->ok = 0;
+			continue;
+		}
+		nDone++;
+		value.l = (*javaEnv)->GetObjectArrayElement(javaEnv, results, i);
+		if (value.l == NULL) {
+			continue;
+		}
+		type = classifyJavaObject(javaEnv, value.l);
+		if (type == JTYPE_STRING) {
+			//copied once all lengths are known, as the buffer may move while growing
+			if (strings == NULL) {
+				strings = calloc(nCalls, sizeof(jstring));
+			}
+			jchar stackUnits[LJ_STRING_STACK_SIZE];
+			int nUnits;
+			jchar* units = getJavaChars(javaEnv, value.l, stackUnits, &nUnits);
+			strings[i] = value.l;
+			call->result.type = JTYPE_STRING;
+			call->result.length = encodeUtf8(units, nUnits, NULL);
+			stringsSize += call->result.length + 1;
+			if (units != stackUnits) {
+				free(units);
+			}
+		} else if (type == JTYPE_OBJECT) {
+			call->result.type = JTYPE_OBJECT;
+			call->result.length = 0;
+			call->result.value.object = newObjectHandle(env, javaEnv, value.l);
+		} else {
+			jobject boxed = value.l;
+			value = unboxJavaObject(javaEnv, type, boxed);
+			(*javaEnv)->DeleteLocalRef(javaEnv, boxed);
+			setJavaResult(env, javaEnv, type, value, &call->result);
+		}
+	}
+
+	if (strings != NULL) {
+		buffer = reserveStringBuffer(getThreadState(env), stringsSize);
+		for (int i = 0; i < nCalls; i++) {
+			jchar stackUnits[LJ_STRING_STACK_SIZE];
+			jchar* units;
+			int nUnits;
+			if (strings[i] == NULL) {
+				continue;
+			}
+			units = getJavaChars(javaEnv, strings[i], stackUnits, &nUnits);
+			encodeUtf8(units, nUnits, buffer);
+			if (units != stackUnits) {
+				free(units);
+			}
+			buffer[calls[i].result.length] = '\0';
+			calls[i].result.value.string = buffer;
+			buffer += calls[i].result.length + 1;
+			(*javaEnv)->DeleteLocalRef(javaEnv, strings[i]);
+		}
+		free(strings);
+	}
+	return nDone;
+}
+
+// lua called method to run a batch of method calls and field reads through LuaJitJavaAPI.runBatch,
+//  with a single java call and exception check for the whole batch.
+//  Each call gets its own result and ok flag, the number of successful calls is returned
+int internal_javaRunBatch(void* ljEnv, int nCalls, ljJavaBatchCall_t* calls)
+{
+	ljJavaEnvironment_t* env = (ljJavaEnvironment_t*)ljEnv;
+	JNIEnv * javaEnv = getJavaEnv(env);
+	jobjectArray receivers, names, argArrays, results, errors;
+	int nDone;
+	long long start;
 
-	javaEnv = ((ljJavaEnvironment_t*)objectInterface->ljEnv)->javaEnv;
+	if (nCalls <= 0) {
+		return 0;
+	}
 	(*javaEnv)->ExceptionClear(javaEnv);
-	object = (jobject)objectInterface->object;
+	start = statsStart(env);
+	//string results are all held until they are copied
+	if ((*javaEnv)->EnsureLocalCapacity(javaEnv, nCalls + 16) != 0) {
+		(*javaEnv)->ExceptionClear(javaEnv);
+		fprintf(stderr, "java batch => not enough local references for %d calls\n", nCalls);
+		recordOp(env, JSTATS_BATCH, statsElapsed(start), 0);
+		return 0;
+	}
 
-	objectClass = (*javaEnv)->GetObjectClass(javaEnv, object);
-	/* Handles exception */
+	receivers = (*javaEnv)->NewObjectArray(javaEnv, nCalls, java_lang_object, NULL);
+	names = (*javaEnv)->NewObjectArray(javaEnv, nCalls, java_string_class, NULL);
+	argArrays = (*javaEnv)->NewObjectArray(javaEnv, nCalls, java_object_array_class, NULL);
+	results = (*javaEnv)->NewObjectArray(javaEnv, nCalls, java_lang_object, NULL);
+	packBatchCalls(env, javaEnv, nCalls, calls, receivers, names, argArrays);
+
+	errors = (*javaEnv)->CallStaticObjectMethod(javaEnv, luajitjava_binding_class, luajitjava_run_batch,
+		receivers, names, argArrays, results);
+
+	/* Handles exception, no call of the batch has a result then */
 	jobject jstr = checkException(javaEnv);
 	if (jstr) {
 		const char * cStr;
 		cStr = (*javaEnv)->GetStringUTFChars(javaEnv, jstr, NULL);
-		fprintf(stderr, "Error. exception while getting method of object : %s\n", cStr);
+		fprintf(stderr, "Error. exception while running batch : %s\n", cStr);
 		(*javaEnv)->ReleaseStringUTFChars(javaEnv, jstr, cStr);
 		(*javaEnv)->DeleteLocalRef(javaEnv, jstr);
-		return returnValue;
-	}
-	if ((*javaEnv)->IsAssignableFrom(javaEnv, objectClass, java_byte_class)) {
-		returnValue = JTYPE_BYTE;
-	} else if ((*javaEnv)->IsAssignableFrom(javaEnv, objectClass, java_short_class)) {
-		returnValue = JTYPE_SHORT;
-	}
-	if ((*javaEnv)->IsAssignableFrom(javaEnv, objectClass, java_int_class)) {
-		returnValue = JTYPE_INT;
-	} else if ((*javaEnv)->IsAssignableFrom(javaEnv, objectClass, java_long_class)) {
-		returnValue = JTYPE_LONG;
-	} else if ((*javaEnv)->IsAssignableFrom(javaEnv, objectClass, java_float_class)) {
-		returnValue = JTYPE_FLOAT;
-	} else if ((*javaEnv)->IsAssignableFrom(javaEnv, objectClass, java_double_class)) {
-		returnValue = JTYPE_DOUBLE;
-	} else if ((*javaEnv)->IsAssignableFrom(javaEnv, objectClass, java_boolean_class)) {
-		returnValue = JTYPE_BOOLEAN;
-	} else if ((*javaEnv)->IsAssignableFrom(javaEnv, objectClass, java_string_class)) {
-		returnValue = JTYPE_STRING;
+		for (int i = 0; i < nCalls; i++) {
+			calls[i].ok = 0;
+		}
+		nDone = 0;
 	} else {
-		returnValue = JTYPE_OBJECT;
+		nDone = unpackBatchResults(env, javaEnv, nCalls, calls, results, errors);
 	}
-	(*javaEnv)->DeleteLocalRef(javaEnv, objectClass);
-	return returnValue;
-}
 
-int internal_javaGetObjectIntValue(ljJavaObject_t* objectInterface) {
-	JNIEnv * javaEnv = ((ljJavaEnvironment_t*)objectInterface->ljEnv)->javaEnv;
-	switch (internal_javaGetObjectType(objectInterface)) {
-	case JTYPE_BYTE:
-		return (*javaEnv)->CallIntMethod(javaEnv, objectInterface->object, java_byte_value);
-		break;
-	case JTYPE_SHORT:
-		return (*javaEnv)->CallIntMethod(javaEnv, objectInterface->object, java_short_value);
-		break;
-	case JTYPE_INT:
-		return (*javaEnv)->CallIntMethod(javaEnv, objectInterface->object, java_int_value);
-		break;
-	case JTYPE_BOOLEAN:
-		return (*javaEnv)->CallBooleanMethod(javaEnv, objectInterface->object, java_boolean_value);
-	}
-	fprintf(stderr, "Trying to access int value of a non int type\n");
-	return 0;
-}
-long internal_javaGetObjectLongValue(ljJavaObject_t* objectInterface) {
-	JNIEnv * javaEnv = ((ljJavaEnvironment_t*)objectInterface->ljEnv)->javaEnv;
-	if (internal_javaGetObjectType(objectInterface) == JTYPE_LONG) {
-		return (long) (*javaEnv)->CallLongMethod(javaEnv, objectInterface->object, java_long_value);
-	}
-	fprintf(stderr, "Trying to access int value of a non int type\n");
-	return 0;
-}
-float internal_javaGetObjectFloatValue(ljJavaObject_t* objectInterface) {
-	JNIEnv * javaEnv = ((ljJavaEnvironment_t*)objectInterface->ljEnv)->javaEnv;
-	if (internal_javaGetObjectType(objectInterface) == JTYPE_FLOAT) {
-		return (*javaEnv)->CallFloatMethod(javaEnv, objectInterface->object, java_float_value);
-	}
-	fprintf(stderr, "Trying to access float value of a non float type\n");
-	return 0;
-}
-double internal_javaGetObjectDoubleValue(ljJavaObject_t* objectInterface) {
-	JNIEnv * javaEnv = ((ljJavaEnvironment_t*)objectInterface->ljEnv)->javaEnv;
-	if (internal_javaGetObjectType(objectInterface) == JTYPE_DOUBLE) {
-		return (*javaEnv)->CallDoubleMethod(javaEnv, objectInterface->object, java_double_value);
-	}
-	fprintf(stderr, "Trying to access double value of a non double type\n");
-	return 0;
-}
-const char* internal_javaGetObjectStringValue(ljJavaObject_t* objectInterface) {
-	JNIEnv * javaEnv = ((ljJavaEnvironment_t*)objectInterface->ljEnv)->javaEnv;
-	if (internal_javaGetObjectType(objectInterface) == JTYPE_STRING) {
-		return (*javaEnv)->GetStringUTFChars(javaEnv, (jstring)objectInterface->object, NULL);
+	if (errors != NULL) {
+		(*javaEnv)->DeleteLocalRef(javaEnv, errors);
 	}
-	fprintf(stderr, "Trying to access string value of a non string type\n");
-	return NULL;
-}
-void internal_javaReleaseStringValue(ljJavaObject_t* objectInterface, const char* stringValue) {
-	JNIEnv * javaEnv = ((ljJavaEnvironment_t*)objectInterface->ljEnv)->javaEnv;
-	(*javaEnv)->ReleaseStringUTFChars(javaEnv, (jstring)objectInterface->object, stringValue);
+	(*javaEnv)->DeleteLocalRef(javaEnv, results);
+	(*javaEnv)->DeleteLocalRef(javaEnv, argArrays);
+	(*javaEnv)->DeleteLocalRef(javaEnv, names);
+	(*javaEnv)->DeleteLocalRef(javaEnv, receivers);
+	recordOp(env, JSTATS_BATCH, statsElapsed(start), nDone == nCalls);
+	return nDone;
 }
 
 /***************************************************************
       JAVA THREAD MANAGEMENT
 ****************************************************************/
 
-static HANDLE javaThreadHandle;
-static HANDLE javaCallEvent;
-static HANDLE javaCallTreatedEvent;
-static long javaThreadTimeout = 5000L;
-
+//calls treated by the dispatcher thread
 typedef enum javaCallMethod {
 	JAVACALL_METHOD_NONE,
 	JAVACALL_METHOD_ENDJAVA,
@@ -760,494 +4837,1227 @@ typedef enum javaCallMethod {
 	JAVACALL_METHOD_GETOBJECTFLOATVALUE,
 	JAVACALL_METHOD_GETOBJECTDOUBLEVALUE,
 	JAVACALL_METHOD_GETOBJECTSTRINGVALUE,
-	JAVACALL_METHOD_RELEASESTRINGVALUE
+	JAVACALL_METHOD_RELEASESTRINGVALUE,
+	JAVACALL_METHOD_RUNCLASSMETHODR,
+	JAVACALL_METHOD_RUNOBJECTMETHODR,
+	JAVACALL_METHOD_BINDMETHOD,
+	JAVACALL_METHOD_RELEASEMETHOD,
+	JAVACALL_METHOD_CALLVOIDMETHOD,
+	JAVACALL_METHOD_CALLINTMETHOD,
+	JAVACALL_METHOD_CALLLONGMETHOD,
+	JAVACALL_METHOD_CALLDOUBLEMETHOD,
+	JAVACALL_METHOD_CALLOBJECTMETHOD,
+	JAVACALL_METHOD_CALLMETHODR,
+	JAVACALL_METHOD_DEFERRELEASEOBJECT,
+	JAVACALL_METHOD_DEFERRELEASECLASS,
+	JAVACALL_METHOD_FLUSHRELEASES,
+	JAVACALL_METHOD_GETSTATS,
+	JAVACALL_METHOD_GETMETHODSTATS,
+	JAVACALL_METHOD_RUNCLASSMETHODASYNC,
+	JAVACALL_METHOD_RUNOBJECTMETHODASYNC,
+	JAVACALL_METHOD_GETFUTURERESULT,
+	JAVACALL_METHOD_RELEASEFUTURE,
+	JAVACALL_METHOD_RUNBATCH,
+	JAVACALL_METHOD_NEWARRAY,
+	JAVACALL_METHOD_GETARRAYTYPE,
+	JAVACALL_METHOD_GETARRAYLENGTH,
+	JAVACALL_METHOD_PINARRAY,
+	JAVACALL_METHOD_UNPINARRAY,
+	JAVACALL_METHOD_GETARRAYREGION,
+	JAVACALL_METHOD_SETARRAYREGION,
+	JAVACALL_METHOD_NEWDIRECTBUFFER,
+	JAVACALL_METHOD_GETDIRECTBUFFERADDRESS,
+	JAVACALL_METHOD_GETDIRECTBUFFERCAPACITY,
+	JAVACALL_METHOD_GETSTRINGVALUE,
+	JAVACALL_METHOD_NEWMANY,
+	JAVACALL_METHOD_GETOBJECTVALUE,
+	JAVACALL_METHOD_CHECKCLASSFIELDR,
+	JAVACALL_METHOD_CHECKOBJECTFIELDR
 } javaCallMethod_t;
 
-static void* currentCallData;
-static void* currentCallReturnPointer;
-static int currentCallReturnInt;
-static long currentCallReturnLong;
-static float currentCallReturnFloat;
-static double currentCallReturnDouble;
-static javaCallMethod_t currentCallMethod = JAVACALL_METHOD_NONE;
-
-//static params for each call
-typedef struct javaStart_params {
-	const char* classPath;
-} javaStart_params_t;
-typedef struct javaBindClass_params {
-	ljJavaClass_t* classInterface;
-	const char* className;
-} javaBindClass_params_t;
-typedef struct javaNew_params {
-	ljJavaObject_t* objectInterface;
-	ljJavaClass_t* classInterface;
-	int nArgs;
-	va_list valist;
-} javaNew_params_t;
-typedef struct javaCheckClassField_params {
-	ljJavaClass_t* classInterface;
-	const char* key;
-} javaCheckClassField_params_t;
-typedef struct javaRunClassMethod_params {
-	ljJavaClass_t* classInterface;
-	const char* methodName;
-	int nArgs;
-	va_list valist;
-} javaRunClassMethod_params_t;
-typedef struct javaCheckObjectField_params {
-	ljJavaObject_t* objectInterface;
-	const char* key;
-} javaCheckObjectField_params_t;
-typedef struct javaRunObjectMethod_params {
-	ljJavaObject_t* objectInterface;
-	const char* methodName;
+//string results copied for a thread calling through the dispatcher
+typedef struct ljDispatchStrings {
+	char* data;
+	int size;
+} ljDispatchStrings_t;
+
+//call descriptor, living on the stack of the calling thread until the call is done
+// the meaning of target, extra, name, nArgs and length depends on the call method
+typedef struct ljJavaCall {
+	struct ljJavaCall* next;
+	javaCallMethod_t method;
+	void* target;
+	void* extra;
+	const char* name;
+	const char* signature;
 	int nArgs;
-	va_list valist;
-} javaRunObjectMethod_params_t;
-typedef struct javaReleaseStringValue_params {
-	ljJavaObject_t* objectInterface;
-	const char* stringValue;
-} javaReleaseStringValue_params_t;
-
-
-//thread launching the JVM, treating calls and ending the jvm
-DWORD WINAPI javaThread(LPVOID args)
-{
-	void* ljJavaEnv;
-
-	//start java environment
-	ljJavaEnv = internal_javaStart( ((javaStart_params_t*)currentCallData)->classPath);
-	currentCallReturnPointer = ljJavaEnv;
-	SetEvent(javaCallTreatedEvent);//will
-
-	BOOL loop = TRUE;
-	while (loop) {
-		WaitForSingleObject(javaCallEvent, javaThreadTimeout);
-
-		switch (currentCallMethod) {
-		case JAVACALL_METHOD_BINDCLASS:
-			currentCallReturnInt = internal_javaBindClass(
-				((javaBindClass_params_t*)currentCallData)->classInterface,
-				((javaBindClass_params_t*)currentCallData)->className );
-			break;
-		case JAVACALL_METHOD_RELEASECLASS:
-			internal_javaReleaseClass((ljJavaClass_t*)currentCallData);
-			break;
-		case JAVACALL_METHOD_NEW:
-			currentCallReturnInt = internal_javaNew(
-				((javaNew_params_t*)currentCallData)->objectInterface,
-				((javaNew_params_t*)currentCallData)->classInterface,
-				((javaNew_params_t*)currentCallData)->nArgs,
-				((javaNew_params_t*)currentCallData)->valist);
-			break;
-		case JAVACALL_METHOD_RELEASEOBJECT:
-			internal_javaReleaseObject((ljJavaObject_t*)currentCallData);
-			break;
-		case JAVACALL_METHOD_CHECKCLASSFIELD:
-			currentCallReturnPointer = internal_javaCheckClassField(
-				((javaCheckClassField_params_t*)currentCallData)->classInterface,
-				((javaCheckClassField_params_t*)currentCallData)->key);
-			break;
-		case JAVACALL_METHOD_RUNCLASSMETHOD:
-			currentCallReturnPointer = internal_javaRunClassMethod(
-				((javaRunClassMethod_params_t*)currentCallData)->classInterface,
-				((javaRunClassMethod_params_t*)currentCallData)->methodName,
-				((javaRunClassMethod_params_t*)currentCallData)->nArgs,
-				((javaRunClassMethod_params_t*)currentCallData)->valist);
-			break;
-		case JAVACALL_METHOD_CHECKOBJECTFIELD:
-			currentCallReturnPointer = internal_javaCheckObjectField(
-				((javaCheckObjectField_params_t*)currentCallData)->objectInterface,
-				((javaCheckObjectField_params_t*)currentCallData)->key);
-			break;
-		case JAVACALL_METHOD_RUNOBJECTMETHOD:
-			currentCallReturnPointer = internal_javaRunObjectMethod(
-				((javaRunObjectMethod_params_t*)currentCallData)->objectInterface,
-				((javaRunObjectMethod_params_t*)currentCallData)->methodName,
-				((javaRunObjectMethod_params_t*)currentCallData)->nArgs,
-				((javaRunObjectMethod_params_t*)currentCallData)->valist);
-			break;
-			case JAVACALL_METHOD_GETOBJECTTYPE:
-				currentCallReturnInt = internal_javaGetObjectType((ljJavaObject_t*)currentCallData);
-				break;
-			case JAVACALL_METHOD_GETOBJECTINTVALUE:
-				currentCallReturnInt = internal_javaGetObjectIntValue((ljJavaObject_t*)currentCallData);
-				break;
-			case JAVACALL_METHOD_GETOBJECTLONGVALUE:
-				currentCallReturnLong = internal_javaGetObjectLongValue((ljJavaObject_t*)currentCallData);
-				break;
-			case JAVACALL_METHOD_GETOBJECTFLOATVALUE:
-				currentCallReturnFloat = internal_javaGetObjectFloatValue((ljJavaObject_t*)currentCallData);
-				break;
-			case JAVACALL_METHOD_GETOBJECTDOUBLEVALUE:
-				currentCallReturnDouble = internal_javaGetObjectDoubleValue((ljJavaObject_t*)currentCallData);
-				break;
-			case JAVACALL_METHOD_GETOBJECTSTRINGVALUE:
-				currentCallReturnPointer = (void*) internal_javaGetObjectStringValue((ljJavaObject_t*)currentCallData);
-				break;
-			case JAVACALL_METHOD_RELEASESTRINGVALUE:
-				internal_javaReleaseStringValue(
-					((javaReleaseStringValue_params_t*)currentCallData)->objectInterface,
-					((javaReleaseStringValue_params_t*)currentCallData)->stringValue);
-				break;
-
-		}
-		if (currentCallMethod == JAVACALL_METHOD_ENDJAVA) {
-			loop = FALSE;
-		}
-		else {
-			SetEvent(javaCallTreatedEvent);
-		}
-	}
-	fprintf(stdout, "thread exiting\n");
-
-	//stop java
-	internal_javaEnd(ljJavaEnv);
-
-	//cleanup
-	CloseHandle(javaCallEvent);
-	CloseHandle(javaCallTreatedEvent);
-
-	fprintf(stdout, "thread over\n");
-
-	return 1;
-}
-
-
-/***************************************************************
-		LUA CALLED METHODS
-****************************************************************/
-
-/*
-// start the java thread and init bindings
-void* javaStart(const char* classPath) {
-	// create an event for java calls in the jvm thread
-	javaCallEvent = CreateEvent(
-		NULL,               // default security attributes
-		FALSE,               // event will be reset after it unblocks the treatment
-		FALSE,              // initial state is nonsignaled
-		TEXT("JavaCallEvent")  // name
-		);
-	// create an event for java treament over coming from jvm thread
-	javaCallTreatedEvent = CreateEvent(
-		NULL,               // default security attributes
-		FALSE,               // event will be reset after the lua call thread has been unblocked
-		FALSE,              // initial state is nonsignaled
-		TEXT("JavaCallTreatedEvent")  // name
-		);
-
-	javaStart_params_t* java_params = malloc(sizeof(javaStart_params_t));
-	java_params->classPath = classPath;
-	currentCallData = java_params;
-	javaThreadHandle = CreateThread(0, 0,
-		javaThread, 0, 0, 0);
-
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
-	//clean params
-	free(java_params);
-	currentCallData = NULL;
-
-	return currentCallReturnPointer;
-}
-
-void javaEnd(void* ljEnv)
+	int length;
+	const javaArgType_t* argTypes;
+	const ljJavaValue_t* args;
+	ljJavaResult_t* result;
+	ljDispatchStrings_t* strings;
+	union {
+		int i;
+		long long j;
+		float f;
+		double d;
+		void* p;
+	} ret;
+	int done;
+} ljJavaCall_t;
+
+//dispatcher thread owning the JVM, fed through an intrusive multi producer single consumer queue
+// producers swap themselves in at tail, the dispatcher alone walks from head,
+// the stub keeps the queue from ever being empty of nodes,
+// running is read by every exported method and only changes under startLock
+static struct {
+	ljJavaCall_t* head;
+	ljJavaCall_t* tail;
+	ljJavaCall_t stub;
+	int wakeups;
+	int sleeping;
+	int running;
+	int started;
+	const char* classPath;
+	int nOptions;
+	const char** options;
+	const char* sharedArchive;
+	void* ljEnv;
+#ifdef _WIN32
+	HANDLE thread;
+#else
+	pthread_t thread;
+#endif
+} dispatcher;
+
+static LJ_THREAD_LOCAL ljDispatchStrings_t dispatchStrings;
+
+//true while calls are to be queued to the dispatcher thread
+static int isDispatcherRunning(void)
 {
-	currentCallMethod = JAVACALL_METHOD_ENDJAVA;
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
-}
-
-int javaBindClass(ljJavaClass_t* classInterface, const char* className) {
-	currentCallMethod = JAVACALL_METHOD_BINDCLASS;
-	javaBindClass_params_t* java_params = malloc(sizeof(javaBindClass_params_t));
-	java_params->classInterface = classInterface;
-	java_params->className = className;
-	currentCallData = java_params;
-
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
-
-	//clean params
-	free(java_params);
-	currentCallData = NULL;
-
-	return currentCallReturnInt;
-}
-
-void javaReleaseClass(ljJavaClass_t* classInterface) {
-	currentCallMethod = JAVACALL_METHOD_RELEASECLASS;
-	currentCallData = classInterface;
-
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
-
-	//clean params
-	currentCallData = NULL;
-}
-
-int javaNew(ljJavaObject_t* objectInterface, ljJavaClass_t* classInterface, int nArgs, ...) {
-	va_list valist;
-	va_start(valist, nArgs);
-
-	currentCallMethod = JAVACALL_METHOD_NEW;
-	javaNew_params_t* java_params = malloc(sizeof(javaNew_params_t));
-	java_params->objectInterface = objectInterface;
-	java_params->classInterface = classInterface;
-	java_params->nArgs = nArgs;
-	java_params->valist = valist;
-	currentCallData = java_params;
-
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
-
-	//clean params
-	free(java_params);
-	currentCallData = NULL;
-
-	return currentCallReturnInt;
-}
-
-void javaReleaseObject(ljJavaObject_t* objectInterface) {
-	currentCallMethod = JAVACALL_METHOD_RELEASEOBJECT;
-	currentCallData = objectInterface;
-
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
-
-	//clean params
-	currentCallData = NULL;
-}
-
-ljJavaObject_t* javaCheckClassField(ljJavaClass_t* classInterface, const char * key) {
-	currentCallMethod = JAVACALL_METHOD_CHECKCLASSFIELD;
-	javaCheckClassField_params_t* java_params = malloc(sizeof(javaCheckClassField_params_t));
-	java_params->classInterface = classInterface;
-	java_params->key = key;
-	currentCallData = java_params;
-
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
-
-	//clean params
-	free(java_params);
-	currentCallData = NULL;
-
-	return currentCallReturnPointer;
+	return LJ_ATOMIC_ACQUIRE_INT(&dispatcher.running);
 }
-ljJavaObject_t* javaRunClassMethod(ljJavaClass_t* classInterface, const char * methodName, int nArgs, ...) {
-	va_list valist;
-	va_start(valist, nArgs);
-
-	currentCallMethod = JAVACALL_METHOD_RUNCLASSMETHOD;
-	javaRunClassMethod_params_t* java_params = malloc(sizeof(javaRunClassMethod_params_t));
-	java_params->classInterface = classInterface;
-	java_params->methodName = methodName;
-	java_params->nArgs = nArgs;
-	java_params->valist = valist;
-	currentCallData = java_params;
 
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
-
-	//clean params
-	free(java_params);
-	currentCallData = NULL;
+//append a call to the dispatcher queue, from any thread
+static void pushCall(ljJavaCall_t* call)
+{
+	ljJavaCall_t* previous;
 
-	return currentCallReturnPointer;
+	call->next = NULL;
+	previous = LJ_ATOMIC_EXCHANGE_PTR(&dispatcher.tail, call);
+	(void)LJ_ATOMIC_EXCHANGE_PTR(&previous->next, call);
 }
 
-ljJavaObject_t* javaCheckObjectField(ljJavaObject_t* objectInterface, const char * key) {
-	currentCallMethod = JAVACALL_METHOD_CHECKOBJECTFIELD;
-	javaCheckObjectField_params_t* java_params = malloc(sizeof(javaCheckObjectField_params_t));
-	java_params->objectInterface = objectInterface;
-	java_params->key = key;
-	currentCallData = java_params;
-
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
-
-	//clean params
-	free(java_params);
-	currentCallData = NULL;
+//take the oldest call of the queue, from the dispatcher thread only
+// NULL is returned when the queue is empty or a producer has not linked its call yet
+static ljJavaCall_t* popCall(void)
+{
+	ljJavaCall_t* head = dispatcher.head;
+	ljJavaCall_t* next = LJ_ATOMIC_LOAD_PTR(&head->next);
 
-	return currentCallReturnPointer;
+	if (head == &dispatcher.stub) {
+		if (next == NULL) {
+			return NULL;
+		}
+		dispatcher.head = next;
+		head = next;
+		next = LJ_ATOMIC_LOAD_PTR(&next->next);
+	}
+	if (next != NULL) {
+		dispatcher.head = next;
+		return head;
+	}
+	if (head != LJ_ATOMIC_LOAD_PTR(&dispatcher.tail)) {
+		return NULL;
+	}
+	//last call of the queue, put the stub back behind it before taking it
+	pushCall(&dispatcher.stub);
+	next = LJ_ATOMIC_LOAD_PTR(&head->next);
+	if (next != NULL) {
+		dispatcher.head = next;
+		return head;
+	}
+	return NULL;
 }
-ljJavaObject_t* javaRunObjectMethod(ljJavaObject_t* objectInterface, const char * methodName, int nArgs, ...) {
-	va_list valist;
-	va_start(valist, nArgs);
 
-	currentCallMethod = JAVACALL_METHOD_RUNOBJECTMETHOD;
-	javaRunObjectMethod_params_t* java_params = malloc(sizeof(javaRunObjectMethod_params_t));
-	java_params->objectInterface = objectInterface;
-	java_params->methodName = methodName;
-	java_params->nArgs = nArgs;
-	java_params->valist = valist;
-	currentCallData = java_params;
-
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
-
-	//clean params
-	free(java_params);
-	currentCallData = NULL;
-
-	return currentCallReturnPointer;
+//true when no call is queued or being queued
+static int isQueueEmpty(void)
+{
+	return dispatcher.head == &dispatcher.stub && LJ_ATOMIC_LOAD_PTR(&dispatcher.tail) == &dispatcher.stub;
 }
 
-int javaGetObjectType(ljJavaObject_t* objectInterface) {
-	currentCallMethod = JAVACALL_METHOD_GETOBJECTTYPE;
-	currentCallData = objectInterface;
+//copy a string result out of the dispatcher thread buffer into the caller one
+static void copyDispatchedString(ljJavaCall_t* call)
+{
+	ljDispatchStrings_t* strings = call->strings;
+	ljJavaResult_t* result = call->result;
 
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
+	if (result->type != JTYPE_STRING) {
+		return;
+	}
+	if (result->length + 1 > strings->size) {
+		free(strings->data);
+		strings->size = result->length + 1 > 256 ? result->length + 1 : 256;
+		strings->data = malloc(strings->size);
+	}
+	memcpy(strings->data, result->value.string, result->length + 1);
+	result->value.string = strings->data;
+}
 
-	//clean params
-	currentCallData = NULL;
+//copy the string results of a batch out of the dispatcher thread buffer into the caller one
+static void copyDispatchedBatchStrings(ljJavaCall_t* call)
+{
+	ljDispatchStrings_t* strings = call->strings;
+	ljJavaBatchCall_t* calls = (ljJavaBatchCall_t*)call->extra;
+	int size = 0;
+	char* buffer;
+
+	for (int i = 0; i < call->nArgs; i++) {
+		if (calls[i].ok && calls[i].result.type == JTYPE_STRING) {
+			size += calls[i].result.length + 1;
+		}
+	}
+	if (size == 0) {
+		return;
+	}
+	if (size > strings->size) {
+		free(strings->data);
+		strings->size = size > 256 ? size : 256;
+		strings->data = malloc(strings->size);
+	}
+	buffer = strings->data;
+	for (int i = 0; i < call->nArgs; i++) {
+		if (calls[i].ok && calls[i].result.type == JTYPE_STRING) {
+			memcpy(buffer, calls[i].result.value.string, calls[i].result.length + 1);
+			calls[i].result.value.string = buffer;
+			buffer += calls[i].result.length + 1;
+		}
+	}
+}
 
-	return currentCallReturnInt;
+//run a queued call on the dispatcher thread
+static void runCall(ljJavaCall_t* call)
+{
+	switch (call->method) {
+	case JAVACALL_METHOD_BINDCLASS:
+		call->ret.i = internal_javaBindClass((ljJavaClass_t*)call->target, call->name);
+		break;
+	case JAVACALL_METHOD_RELEASECLASS:
+		internal_javaReleaseClass((ljJavaClass_t*)call->target);
+		break;
+	case JAVACALL_METHOD_NEW:
+		call->ret.i = internal_javaNew((ljJavaObject_t*)call->target, (ljJavaClass_t*)call->extra,
+			call->nArgs, call->argTypes, call->args);
+		break;
+	case JAVACALL_METHOD_RELEASEOBJECT:
+		internal_javaReleaseObject((ljJavaObject_t*)call->target);
+		break;
+	case JAVACALL_METHOD_CHECKCLASSFIELD:
+		call->ret.p = internal_javaCheckClassField((ljJavaClass_t*)call->target, call->name);
+		break;
+	case JAVACALL_METHOD_RUNCLASSMETHOD:
+		call->ret.p = internal_javaRunClassMethod((ljJavaClass_t*)call->target, call->name,
+			call->nArgs, call->argTypes, call->args);
+		break;
+	case JAVACALL_METHOD_RUNCLASSMETHODR:
+		call->ret.i = internal_javaRunClassMethodR((ljJavaClass_t*)call->target, call->name,
+			call->nArgs, call->argTypes, call->args, call->result);
+		copyDispatchedString(call);
+		break;
+	case JAVACALL_METHOD_CHECKOBJECTFIELD:
+		call->ret.p = internal_javaCheckObjectField((ljJavaObject_t*)call->target, call->name);
+		break;
+	case JAVACALL_METHOD_CHECKCLASSFIELDR:
+		call->ret.i = internal_javaCheckClassFieldR((ljJavaClass_t*)call->target, call->name, call->result);
+		copyDispatchedString(call);
+		break;
+	case JAVACALL_METHOD_CHECKOBJECTFIELDR:
+		call->ret.i = internal_javaCheckObjectFieldR((ljJavaObject_t*)call->target, call->name, call->result);
+		copyDispatchedString(call);
+		break;
+	case JAVACALL_METHOD_RUNOBJECTMETHOD:
+		call->ret.p = internal_javaRunObjectMethod((ljJavaObject_t*)call->target, call->name,
+			call->nArgs, call->argTypes, call->args);
+		break;
+	case JAVACALL_METHOD_RUNOBJECTMETHODR:
+		call->ret.i = internal_javaRunObjectMethodR((ljJavaObject_t*)call->target, call->name,
+			call->nArgs, call->argTypes, call->args, call->result);
+		copyDispatchedString(call);
+		break;
+	case JAVACALL_METHOD_GETOBJECTTYPE:
+		call->ret.i = internal_javaGetObjectType((ljJavaObject_t*)call->target);
+		break;
+	case JAVACALL_METHOD_GETOBJECTINTVALUE:
+		call->ret.i = internal_javaGetObjectIntValue((ljJavaObject_t*)call->target);
+		break;
+	case JAVACALL_METHOD_GETOBJECTLONGVALUE:
+		call->ret.j = internal_javaGetObjectLongValue((ljJavaObject_t*)call->target);
+		break;
+	case JAVACALL_METHOD_GETOBJECTFLOATVALUE:
+		call->ret.f = internal_javaGetObjectFloatValue((ljJavaObject_t*)call->target);
+		break;
+	case JAVACALL_METHOD_GETOBJECTDOUBLEVALUE:
+		call->ret.d = internal_javaGetObjectDoubleValue((ljJavaObject_t*)call->target);
+		break;
+	case JAVACALL_METHOD_GETOBJECTSTRINGVALUE:
+		call->ret.p = (void*)internal_javaGetObjectStringValue((ljJavaObject_t*)call->target);
+		break;
+	case JAVACALL_METHOD_RELEASESTRINGVALUE:
+		internal_javaReleaseStringValue((ljJavaObject_t*)call->target, call->name);
+		break;
+	case JAVACALL_METHOD_BINDMETHOD:
+		call->ret.i = internal_javaBindMethod((ljJavaMethod_t*)call->target, (ljJavaClass_t*)call->extra,
+			call->name, call->signature);
+		break;
+	case JAVACALL_METHOD_RELEASEMETHOD:
+		internal_javaReleaseMethod((ljJavaMethod_t*)call->target);
+		break;
+	case JAVACALL_METHOD_CALLVOIDMETHOD:
+		internal_javaCallVoidMethod((ljJavaMethod_t*)call->target, (ljJavaObject_t*)call->extra, call->args);
+		break;
+	case JAVACALL_METHOD_CALLINTMETHOD:
+		call->ret.i = internal_javaCallIntMethod((ljJavaMethod_t*)call->target, (ljJavaObject_t*)call->extra, call->args);
+		break;
+	case JAVACALL_METHOD_CALLLONGMETHOD:
+		call->ret.j = internal_javaCallLongMethod((ljJavaMethod_t*)call->target, (ljJavaObject_t*)call->extra, call->args);
+		break;
+	case JAVACALL_METHOD_CALLDOUBLEMETHOD:
+		call->ret.d = internal_javaCallDoubleMethod((ljJavaMethod_t*)call->target, (ljJavaObject_t*)call->extra, call->args);
+		break;
+	case JAVACALL_METHOD_CALLOBJECTMETHOD:
+		call->ret.p = internal_javaCallObjectMethod((ljJavaMethod_t*)call->target, (ljJavaObject_t*)call->extra, call->args);
+		break;
+	case JAVACALL_METHOD_CALLMETHODR:
+		call->ret.i = internal_javaCallMethodR((ljJavaMethod_t*)call->target, (ljJavaObject_t*)call->extra,
+			call->args, call->result);
+		copyDispatchedString(call);
+		break;
+	case JAVACALL_METHOD_DEFERRELEASEOBJECT:
+		internal_javaDeferReleaseObject((ljJavaObject_t*)call->target);
+		break;
+	case JAVACALL_METHOD_DEFERRELEASECLASS:
+		internal_javaDeferReleaseClass((ljJavaClass_t*)call->target);
+		break;
+	case JAVACALL_METHOD_FLUSHRELEASES:
+		internal_javaFlushReleases(call->target);
+		break;
+	case JAVACALL_METHOD_GETSTATS:
+		internal_javaGetStats(call->target, (ljJavaStats_t*)call->extra);
+		break;
+	case JAVACALL_METHOD_GETMETHODSTATS:
+		call->ret.i = internal_javaGetMethodStats(call->target, (ljJavaMethodStats_t*)call->extra, call->length);
+		break;
+	case JAVACALL_METHOD_RUNCLASSMETHODASYNC:
+		call->ret.i = internal_javaRunClassMethodAsync((ljJavaFuture_t*)call->extra, (ljJavaClass_t*)call->target,
+			call->name, call->nArgs, call->argTypes, call->args);
+		break;
+	case JAVACALL_METHOD_RUNOBJECTMETHODASYNC:
+		call->ret.i = internal_javaRunObjectMethodAsync((ljJavaFuture_t*)call->extra, (ljJavaObject_t*)call->target,
+			call->name, call->nArgs, call->argTypes, call->args);
+		break;
+	case JAVACALL_METHOD_GETFUTURERESULT:
+		call->ret.i = internal_javaGetFutureResult((ljJavaFuture_t*)call->target, call->result);
+		copyDispatchedString(call);
+		break;
+	case JAVACALL_METHOD_RELEASEFUTURE:
+		internal_javaReleaseFuture((ljJavaFuture_t*)call->target);
+		break;
+	case JAVACALL_METHOD_RUNBATCH:
+		call->ret.i = internal_javaRunBatch(call->target, call->nArgs, (ljJavaBatchCall_t*)call->extra);
+		copyDispatchedBatchStrings(call);
+		break;
+	case JAVACALL_METHOD_NEWARRAY:
+		call->ret.i = internal_javaNewArray((ljJavaObject_t*)call->target, call->nArgs, call->length);
+		break;
+	case JAVACALL_METHOD_GETARRAYTYPE:
+		call->ret.i = internal_javaGetArrayType((ljJavaObject_t*)call->target);
+		break;
+	case JAVACALL_METHOD_GETARRAYLENGTH:
+		call->ret.i = internal_javaGetArrayLength((ljJavaObject_t*)call->target);
+		break;
+	case JAVACALL_METHOD_PINARRAY:
+		call->ret.i = internal_javaPinArray((ljJavaArray_t*)call->target, (ljJavaObject_t*)call->extra, call->nArgs);
+		break;
+	case JAVACALL_METHOD_UNPINARRAY:
+		internal_javaUnpinArray((ljJavaArray_t*)call->target, call->nArgs);
+		break;
+	case JAVACALL_METHOD_GETARRAYREGION:
+		call->ret.i = internal_javaGetArrayRegion((ljJavaObject_t*)call->target, call->nArgs, call->length, call->extra);
+		break;
+	case JAVACALL_METHOD_SETARRAYREGION:
+		call->ret.i = internal_javaSetArrayRegion((ljJavaObject_t*)call->target, call->nArgs, call->length, call->extra);
+		break;
+	case JAVACALL_METHOD_NEWDIRECTBUFFER:
+		call->ret.i = internal_javaNewDirectBuffer((ljJavaObject_t*)call->target, call->extra, call->ret.j);
+		break;
+	case JAVACALL_METHOD_GETDIRECTBUFFERADDRESS:
+		call->ret.p = internal_javaGetDirectBufferAddress((ljJavaObject_t*)call->target);
+		break;
+	case JAVACALL_METHOD_GETDIRECTBUFFERCAPACITY:
+		call->ret.j = internal_javaGetDirectBufferCapacity((ljJavaObject_t*)call->target);
+		break;
+	case JAVACALL_METHOD_GETSTRINGVALUE:
+		call->ret.i = internal_javaGetStringValue((ljJavaObject_t*)call->target, call->extra, call->nArgs, call->length);
+		break;
+	case JAVACALL_METHOD_NEWMANY:
+		call->ret.i = internal_javaNewMany((ljJavaObject_t*)call->target, (ljJavaClass_t*)call->extra,
+			call->length, call->nArgs, call->argTypes, call->args);
+		break;
+	case JAVACALL_METHOD_GETOBJECTVALUE:
+		call->ret.i = internal_javaGetObjectValue((ljJavaObject_t*)call->target, call->result);
+		copyDispatchedString(call);
+		break;
+	case JAVACALL_METHOD_ENDJAVA:
+		//startLock is held by the thread ending the dispatcher
+		call->ret.i = endJava(call->target);
+		break;
+	case JAVACALL_METHOD_NONE:
+		break;
+	}
 }
-int javaGetObjectIntValue(ljJavaObject_t* objectInterface) {
-	currentCallMethod = JAVACALL_METHOD_GETOBJECTINTVALUE;
-	currentCallData = objectInterface;
 
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
+//fail the calls queued behind the end of the JVM, their callers would wait for them forever
+static void failPendingCalls(void)
+{
+	ljJavaCall_t* call;
 
-	//clean params
-	currentCallData = NULL;
+	while (!isQueueEmpty()) {
+		call = popCall();
+		if (call == NULL) {
+			//a producer is linking its call
+			continue;
+		}
+		fprintf(stderr, "Error. java call => the JVM of the dispatcher has been ended\n");
+		call->ret.j = 0;
+		LJ_ATOMIC_STORE_INT(&call->done, 1);
+		wakeWord(&call->done);
+	}
+}
 
-	return currentCallReturnInt;
+//treat every queued call, then poll a little before sleeping until the next call is pushed
+// returns once the JVM has been ended and the calls queued behind the end have been failed
+static void dispatchCalls(void)
+{
+	ljJavaCall_t* call;
+	int wakeups;
+	int spins = 0;
+
+	while (1) {
+		call = popCall();
+		if (call != NULL) {
+			javaCallMethod_t method = call->method;
+			int ended;
+			runCall(call);
+			ended = method == JAVACALL_METHOD_ENDJAVA && call->ret.i;
+			if (ended) {
+				//no call is queued anymore once running is cleared, but the ones already being queued
+				LJ_ATOMIC_STORE_INT(&dispatcher.running, 0);
+			}
+			//the caller may return as soon as done is set, call must not be used anymore
+			LJ_ATOMIC_STORE_INT(&call->done, 1);
+			wakeWord(&call->done);
+			if (ended) {
+				failPendingCalls();
+				return;
+			}
+			spins = 0;
+			continue;
+		}
+		if (!isQueueEmpty() || ++spins < LJ_DISPATCH_SPIN) {
+			//a producer is linking its call, or more calls may come right away
+			continue;
+		}
+		wakeups = LJ_ATOMIC_LOAD_INT(&dispatcher.wakeups);
+		LJ_ATOMIC_STORE_INT(&dispatcher.sleeping, 1);
+		if (isQueueEmpty()) {
+			waitWord(&dispatcher.wakeups, wakeups, -1);
+		}
+		LJ_ATOMIC_STORE_INT(&dispatcher.sleeping, 0);
+		spins = 0;
+	}
 }
-long javaGetObjectLongValue(ljJavaObject_t* objectInterface) {
-	currentCallMethod = JAVACALL_METHOD_GETOBJECTLONGVALUE;
-	currentCallData = objectInterface;
 
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
+//thread launching the JVM, treating calls and ending the jvm
+#ifdef _WIN32
+static DWORD WINAPI dispatcherThread(LPVOID args)
+#else
+static void* dispatcherThread(void* args)
+#endif
+{
+	//startLock is held by the thread starting the dispatcher
+	dispatcher.ljEnv = startJava(dispatcher.classPath, dispatcher.nOptions, dispatcher.options, dispatcher.sharedArchive);
+	LJ_ATOMIC_STORE_INT(&dispatcher.started, 1);
+	wakeWord(&dispatcher.started);
+	if (dispatcher.ljEnv != NULL) {
+		dispatchCalls();
+	}
+	return 0;
+}
 
-	//clean params
-	currentCallData = NULL;
+//queue a call for the dispatcher thread and wait for it to be treated
+static void dispatchCall(ljJavaCall_t* call)
+{
+	int spins = 0;
 
-	return currentCallReturnLong;
+	call->done = 0;
+	pushCall(call);
+	if (LJ_ATOMIC_LOAD_INT(&dispatcher.sleeping)) {
+		LJ_ATOMIC_INCREMENT_INT(&dispatcher.wakeups);
+		wakeWord(&dispatcher.wakeups);
+	}
+	while (!LJ_ATOMIC_LOAD_INT(&call->done)) {
+		if (++spins >= LJ_DISPATCH_SPIN) {
+			waitWord(&call->done, 0, -1);
+		}
+	}
 }
-float javaGetObjectFloatValue(ljJavaObject_t* objectInterface) {
-	currentCallMethod = JAVACALL_METHOD_GETOBJECTFLOATVALUE;
-	currentCallData = objectInterface;
 
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
-
-	//clean params
-	currentCallData = NULL;
+//start the JVM in a dispatcher thread, all calls made through the exported methods
+// are then queued to that thread instead of being made from the calling one.
+// startLock is held until the dispatcher has started, for concurrent starts and ends to wait for it
+void* internal_javaStartDispatcher(const char* classPath, int nOptions, const char** options, const char* sharedArchive)
+{
+	void* ljEnv;
+
+	LJ_MUTEX_LOCK(&startLock);
+	if (LJ_ATOMIC_LOAD_INT(&dispatcher.running)) {
+		//share the environment of the running dispatcher
+		((ljJavaEnvironment_t*)dispatcher.ljEnv)->refCount++;
+		ljEnv = dispatcher.ljEnv;
+		LJ_MUTEX_UNLOCK(&startLock);
+		return ljEnv;
+	}
+	dispatcher.stub.next = NULL;
+	dispatcher.head = &dispatcher.stub;
+	dispatcher.tail = &dispatcher.stub;
+	dispatcher.wakeups = 0;
+	dispatcher.sleeping = 0;
+	dispatcher.started = 0;
+	dispatcher.classPath = classPath;
+	dispatcher.nOptions = nOptions;
+	dispatcher.options = options;
+	dispatcher.sharedArchive = sharedArchive;
+	dispatcher.ljEnv = NULL;
+
+#ifdef _WIN32
+	dispatcher.thread = CreateThread(NULL, 0, dispatcherThread, NULL, 0, NULL);
+	if (dispatcher.thread == NULL) {
+#else
+	if (pthread_create(&dispatcher.thread, NULL, dispatcherThread, NULL) != 0) {
+#endif
+		fprintf(stderr, "Error. Couldn't create the java dispatcher thread\n");
+		LJ_MUTEX_UNLOCK(&startLock);
+		return NULL;
+	}
+	while (!LJ_ATOMIC_LOAD_INT(&dispatcher.started)) {
+		waitWord(&dispatcher.started, 0, -1);
+	}
 
-	return currentCallReturnFloat;
+	if (dispatcher.ljEnv == NULL) {
+#ifdef _WIN32
+		WaitForSingleObject(dispatcher.thread, INFINITE);
+		CloseHandle(dispatcher.thread);
+#else
+		pthread_join(dispatcher.thread, NULL);
+#endif
+		LJ_MUTEX_UNLOCK(&startLock);
+		return NULL;
+	}
+	ljEnv = dispatcher.ljEnv;
+	LJ_ATOMIC_STORE_INT(&dispatcher.running, 1);
+	LJ_MUTEX_UNLOCK(&startLock);
+	return ljEnv;
 }
-double javaGetObjectDoubleValue(ljJavaObject_t* objectInterface) {
-	currentCallMethod = JAVACALL_METHOD_GETOBJECTDOUBLEVALUE;
-	currentCallData = objectInterface;
 
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
+//end the JVM of the dispatcher thread and wait for the thread to be over
+// startLock is held until then, the dispatcher thread clearing running once the JVM has been ended
+void internal_javaEndDispatcher(void* ljEnv)
+{
+	ljJavaCall_t call;
 
-	//clean params
-	currentCallData = NULL;
+	LJ_MUTEX_LOCK(&startLock);
+	if (!LJ_ATOMIC_LOAD_INT(&dispatcher.running)) {
+		//ended meanwhile by another thread
+		LJ_MUTEX_UNLOCK(&startLock);
+		return;
+	}
+	call.method = JAVACALL_METHOD_ENDJAVA;
+	call.target = ljEnv;
+	dispatchCall(&call);
+	if (!call.ret.i) {
+		//still used by other starts
+		LJ_MUTEX_UNLOCK(&startLock);
+		return;
+	}
+#ifdef _WIN32
+	WaitForSingleObject(dispatcher.thread, INFINITE);
+	CloseHandle(dispatcher.thread);
+#else
+	pthread_join(dispatcher.thread, NULL);
+#endif
+	LJ_MUTEX_UNLOCK(&startLock);
+}
 
-	return currentCallReturnDouble;
+//queue a call without arguments but its target
+static void dispatchTarget(javaCallMethod_t method, void* target, ljJavaCall_t* call)
+{
+	call->method = method;
+	call->target = target;
+	dispatchCall(call);
 }
-const char* javaGetObjectStringValue(ljJavaObject_t* objectInterface) {
-	currentCallMethod = JAVACALL_METHOD_GETOBJECTSTRINGVALUE;
-	currentCallData = objectInterface;
 
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
 
-	//clean params
-	currentCallData = NULL;
+/***************************************************************
+		LUA CALLED METHODS
+****************************************************************/
 
-	return currentCallReturnPointer;
+void* javaStart(const char* classPath) {
+	return internal_javaStart(classPath, 0, NULL, NULL);
 }
-void javaReleaseStringValue(ljJavaObject_t* objectInterface, const char* stringValue) {
-	currentCallMethod = JAVACALL_METHOD_RELEASESTRINGVALUE;
-	javaReleaseStringValue_params_t* java_params = malloc(sizeof(javaReleaseStringValue_params_t));
-	java_params->objectInterface = objectInterface;
-	java_params->stringValue = stringValue;
-	currentCallData = java_params;
 
-	SetEvent(javaCallEvent);
-	WaitForSingleObject(javaCallTreatedEvent, javaThreadTimeout);
-
-	//clean params
-	currentCallData = NULL;
+void* javaStartDispatcher(const char* classPath) {
+	return internal_javaStartDispatcher(classPath, 0, NULL, NULL);
 }
-*/
 
-void* javaStart(const char* classPath) {
-	return internal_javaStart(classPath);
+void* javaStartEx(const char* classPath, int nOptions, const char** options, const char* sharedArchive, int useDispatcher) {
+	if (nOptions < 0 || (nOptions > 0 && options == NULL)) {
+		fprintf(stderr, "java start => invalid JVM options\n");
+		return NULL;
+	}
+	if (useDispatcher) {
+		return internal_javaStartDispatcher(classPath, nOptions, options, sharedArchive);
+	}
+	return internal_javaStart(classPath, nOptions, options, sharedArchive);
 }
 
 void javaEnd(void* ljEnv)
 {
+	if (isDispatcherRunning()) {
+		internal_javaEndDispatcher(ljEnv);
+		return;
+	}
 	internal_javaEnd(ljEnv);
 }
 
 int javaBindClass(ljJavaClass_t* classInterface, const char* className) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.name = className;
+		dispatchTarget(JAVACALL_METHOD_BINDCLASS, classInterface, &call);
+		return call.ret.i;
+	}
 	return internal_javaBindClass(classInterface, className);
 }
 
 void javaReleaseClass(ljJavaClass_t* classInterface) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_RELEASECLASS, classInterface, &call);
+		return;
+	}
 	internal_javaReleaseClass(classInterface);
 }
 
+int javaNewA(ljJavaObject_t* objectInterface, ljJavaClass_t* classInterface, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args) {
+	if (nArgs > LJ_MAX_ARGS) {
+		fprintf(stderr, "java new => too many parameters, %d at most\n", LJ_MAX_ARGS);
+		return 0;
+	}
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = classInterface;
+		call.nArgs = nArgs;
+		call.argTypes = argTypes;
+		call.args = args;
+		dispatchTarget(JAVACALL_METHOD_NEW, objectInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaNew(objectInterface, classInterface, nArgs, argTypes, args);
+}
+
+int javaNewMany(ljJavaObject_t* objects, ljJavaClass_t* classInterface, int nObjects, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args) {
+	if (nArgs > LJ_MAX_ARGS) {
+		fprintf(stderr, "java new many => too many parameters, %d at most\n", LJ_MAX_ARGS);
+		return 0;
+	}
+	if (nObjects <= 0) {
+		return 0;
+	}
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = classInterface;
+		call.nArgs = nArgs;
+		call.length = nObjects;
+		call.argTypes = argTypes;
+		call.args = args;
+		dispatchTarget(JAVACALL_METHOD_NEWMANY, objects, &call);
+		return call.ret.i;
+	}
+	return internal_javaNewMany(objects, classInterface, nObjects, nArgs, argTypes, args);
+}
+
 int javaNew(ljJavaObject_t* objectInterface, ljJavaClass_t* classInterface, int nArgs, ...) {
+	javaArgType_t argTypes[LJ_MAX_ARGS];
+	ljJavaValue_t args[LJ_MAX_ARGS];
 	va_list valist;
 	va_start(valist, nArgs);
+	int nValues = readVarArgs(nArgs, valist, argTypes, args);
+	va_end(valist);
+	if (nValues < 0) {
+		return 0;
+	}
 
-	return internal_javaNew(objectInterface, classInterface, nArgs, valist);
+	return javaNewA(objectInterface, classInterface, nValues, argTypes, args);
 }
 
 void javaReleaseObject(ljJavaObject_t* objectInterface) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_RELEASEOBJECT, objectInterface, &call);
+		return;
+	}
 	internal_javaReleaseObject(objectInterface);
 }
 
 ljJavaObject_t* javaCheckClassField(ljJavaClass_t* classInterface, const char * key) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.name = key;
+		dispatchTarget(JAVACALL_METHOD_CHECKCLASSFIELD, classInterface, &call);
+		return call.ret.p;
+	}
 	return internal_javaCheckClassField(classInterface, key);
 }
+int javaCheckClassFieldR(ljJavaClass_t* classInterface, const char * key, ljJavaResult_t* result) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.name = key;
+		call.result = result;
+		call.strings = &dispatchStrings;
+		dispatchTarget(JAVACALL_METHOD_CHECKCLASSFIELDR, classInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaCheckClassFieldR(classInterface, key, result);
+}
+ljJavaObject_t* javaRunClassMethodA(ljJavaClass_t* classInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args) {
+	if (nArgs > LJ_MAX_ARGS) {
+		fprintf(stderr, "java call => too many parameters, %d at most\n", LJ_MAX_ARGS);
+		return NULL;
+	}
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.name = methodName;
+		call.nArgs = nArgs;
+		call.argTypes = argTypes;
+		call.args = args;
+		dispatchTarget(JAVACALL_METHOD_RUNCLASSMETHOD, classInterface, &call);
+		return call.ret.p;
+	}
+	return internal_javaRunClassMethod(classInterface, methodName, nArgs, argTypes, args);
+}
 ljJavaObject_t* javaRunClassMethod(ljJavaClass_t* classInterface, const char * methodName, int nArgs, ...) {
+	javaArgType_t argTypes[LJ_MAX_ARGS];
+	ljJavaValue_t args[LJ_MAX_ARGS];
 	va_list valist;
 	va_start(valist, nArgs);
+	int nValues = readVarArgs(nArgs, valist, argTypes, args);
+	va_end(valist);
+	if (nValues < 0) {
+		return NULL;
+	}
 
-	return internal_javaRunClassMethod(classInterface, methodName, nArgs, valist);
+	return javaRunClassMethodA(classInterface, methodName, nValues, argTypes, args);
+}
+int javaRunClassMethodR(ljJavaClass_t* classInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args, ljJavaResult_t* result) {
+	if (nArgs > LJ_MAX_ARGS) {
+		fprintf(stderr, "java call => too many parameters, %d at most\n", LJ_MAX_ARGS);
+		result->type = JTYPE_NONE;
+		return 0;
+	}
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.name = methodName;
+		call.nArgs = nArgs;
+		call.argTypes = argTypes;
+		call.args = args;
+		call.result = result;
+		call.strings = &dispatchStrings;
+		dispatchTarget(JAVACALL_METHOD_RUNCLASSMETHODR, classInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaRunClassMethodR(classInterface, methodName, nArgs, argTypes, args, result);
 }
 
 ljJavaObject_t* javaCheckObjectField(ljJavaObject_t* objectInterface, const char * key) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.name = key;
+		dispatchTarget(JAVACALL_METHOD_CHECKOBJECTFIELD, objectInterface, &call);
+		return call.ret.p;
+	}
 	return internal_javaCheckObjectField(objectInterface, key);
 }
+int javaCheckObjectFieldR(ljJavaObject_t* objectInterface, const char * key, ljJavaResult_t* result) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.name = key;
+		call.result = result;
+		call.strings = &dispatchStrings;
+		dispatchTarget(JAVACALL_METHOD_CHECKOBJECTFIELDR, objectInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaCheckObjectFieldR(objectInterface, key, result);
+}
+ljJavaObject_t* javaRunObjectMethodA(ljJavaObject_t* objectInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args) {
+	if (nArgs > LJ_MAX_ARGS) {
+		fprintf(stderr, "java call => too many parameters, %d at most\n", LJ_MAX_ARGS);
+		return NULL;
+	}
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.name = methodName;
+		call.nArgs = nArgs;
+		call.argTypes = argTypes;
+		call.args = args;
+		dispatchTarget(JAVACALL_METHOD_RUNOBJECTMETHOD, objectInterface, &call);
+		return call.ret.p;
+	}
+	return internal_javaRunObjectMethod(objectInterface, methodName, nArgs, argTypes, args);
+}
 ljJavaObject_t* javaRunObjectMethod(ljJavaObject_t* objectInterface, const char * methodName, int nArgs, ...) {
+	javaArgType_t argTypes[LJ_MAX_ARGS];
+	ljJavaValue_t args[LJ_MAX_ARGS];
 	va_list valist;
 	va_start(valist, nArgs);
+	int nValues = readVarArgs(nArgs, valist, argTypes, args);
+	va_end(valist);
+	if (nValues < 0) {
+		return NULL;
+	}
 
-	return internal_javaRunObjectMethod(objectInterface, methodName, nArgs, valist);
+	return javaRunObjectMethodA(objectInterface, methodName, nValues, argTypes, args);
+}
+int javaRunObjectMethodR(ljJavaObject_t* objectInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args, ljJavaResult_t* result) {
+	if (nArgs > LJ_MAX_ARGS) {
+		fprintf(stderr, "java call => too many parameters, %d at most\n", LJ_MAX_ARGS);
+		result->type = JTYPE_NONE;
+		return 0;
+	}
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.name = methodName;
+		call.nArgs = nArgs;
+		call.argTypes = argTypes;
+		call.args = args;
+		call.result = result;
+		call.strings = &dispatchStrings;
+		dispatchTarget(JAVACALL_METHOD_RUNOBJECTMETHODR, objectInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaRunObjectMethodR(objectInterface, methodName, nArgs, argTypes, args, result);
 }
 
 int javaGetObjectType(ljJavaObject_t* objectInterface) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_GETOBJECTTYPE, objectInterface, &call);
+		return call.ret.i;
+	}
 	return internal_javaGetObjectType(objectInterface);
 }
 int javaGetObjectIntValue(ljJavaObject_t* objectInterface) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_GETOBJECTINTVALUE, objectInterface, &call);
+		return call.ret.i;
+	}
 	return internal_javaGetObjectIntValue(objectInterface);
 }
 long javaGetObjectLongValue(ljJavaObject_t* objectInterface) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_GETOBJECTLONGVALUE, objectInterface, &call);
+		return (long)call.ret.j;
+	}
 	return internal_javaGetObjectLongValue(objectInterface);
 }
 float javaGetObjectFloatValue(ljJavaObject_t* objectInterface) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_GETOBJECTFLOATVALUE, objectInterface, &call);
+		return call.ret.f;
+	}
 	return internal_javaGetObjectFloatValue(objectInterface);
 }
 double javaGetObjectDoubleValue(ljJavaObject_t* objectInterface) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_GETOBJECTDOUBLEVALUE, objectInterface, &call);
+		return call.ret.d;
+	}
 	return internal_javaGetObjectDoubleValue(objectInterface);
 }
 const char* javaGetObjectStringValue(ljJavaObject_t* objectInterface) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_GETOBJECTSTRINGVALUE, objectInterface, &call);
+		return call.ret.p;
+	}
 	return internal_javaGetObjectStringValue(objectInterface);
 }
+int javaGetObjectValue(ljJavaObject_t* objectInterface, ljJavaResult_t* result) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.result = result;
+		call.strings = &dispatchStrings;
+		dispatchTarget(JAVACALL_METHOD_GETOBJECTVALUE, objectInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaGetObjectValue(objectInterface, result);
+}
 void javaReleaseStringValue(ljJavaObject_t* objectInterface, const char* stringValue) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.name = stringValue;
+		dispatchTarget(JAVACALL_METHOD_RELEASESTRINGVALUE, objectInterface, &call);
+		return;
+	}
 	internal_javaReleaseStringValue(objectInterface, stringValue);
 }
+int javaGetStringValue(ljJavaObject_t* objectInterface, void* buffer, int capacity, int utf16) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = buffer;
+		call.nArgs = capacity;
+		call.length = utf16;
+		dispatchTarget(JAVACALL_METHOD_GETSTRINGVALUE, objectInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaGetStringValue(objectInterface, buffer, capacity, utf16);
+}
+void javaSetConstantFolding(void* ljEnv, int enabled) {
+	internal_javaSetConstantFolding(ljEnv, enabled);
+}
+int javaBindMethod(ljJavaMethod_t* methodInterface, ljJavaClass_t* classInterface, const char* methodName, const char* signature) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = classInterface;
+		call.name = methodName;
+		call.signature = signature;
+		dispatchTarget(JAVACALL_METHOD_BINDMETHOD, methodInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaBindMethod(methodInterface, classInterface, methodName, signature);
+}
+void javaReleaseMethod(ljJavaMethod_t* methodInterface) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_RELEASEMETHOD, methodInterface, &call);
+		return;
+	}
+	internal_javaReleaseMethod(methodInterface);
+}
+void javaCallVoidMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = objectInterface;
+		call.args = args;
+		dispatchTarget(JAVACALL_METHOD_CALLVOIDMETHOD, methodInterface, &call);
+		return;
+	}
+	internal_javaCallVoidMethod(methodInterface, objectInterface, args);
+}
+int javaCallIntMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = objectInterface;
+		call.args = args;
+		dispatchTarget(JAVACALL_METHOD_CALLINTMETHOD, methodInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaCallIntMethod(methodInterface, objectInterface, args);
+}
+long long javaCallLongMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = objectInterface;
+		call.args = args;
+		dispatchTarget(JAVACALL_METHOD_CALLLONGMETHOD, methodInterface, &call);
+		return call.ret.j;
+	}
+	return internal_javaCallLongMethod(methodInterface, objectInterface, args);
+}
+double javaCallDoubleMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = objectInterface;
+		call.args = args;
+		dispatchTarget(JAVACALL_METHOD_CALLDOUBLEMETHOD, methodInterface, &call);
+		return call.ret.d;
+	}
+	return internal_javaCallDoubleMethod(methodInterface, objectInterface, args);
+}
+ljJavaObject_t* javaCallObjectMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = objectInterface;
+		call.args = args;
+		dispatchTarget(JAVACALL_METHOD_CALLOBJECTMETHOD, methodInterface, &call);
+		return call.ret.p;
+	}
+	return internal_javaCallObjectMethod(methodInterface, objectInterface, args);
+}
+int javaCallMethodR(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args, ljJavaResult_t* result) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = objectInterface;
+		call.args = args;
+		call.result = result;
+		call.strings = &dispatchStrings;
+		dispatchTarget(JAVACALL_METHOD_CALLMETHODR, methodInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaCallMethodR(methodInterface, objectInterface, args, result);
+}
+//scopes hold local references of the calling thread, the dispatcher thread ones cannot be scoped for others
+int javaPushScope(void* ljEnv, int capacity) {
+	if (isDispatcherRunning()) {
+		fprintf(stderr, "java scope => scopes are not available through the dispatcher\n");
+		return 0;
+	}
+	return internal_javaPushScope(ljEnv, capacity);
+}
+void javaPopScope(void* ljEnv) {
+	if (isDispatcherRunning()) {
+		return;
+	}
+	internal_javaPopScope(ljEnv);
+}
+void javaEscapeObject(ljJavaObject_t* objectInterface) {
+	if (isDispatcherRunning()) {
+		return;
+	}
+	internal_javaEscapeObject(objectInterface);
+}
+void javaGetStats(void* ljEnv, ljJavaStats_t* stats) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = stats;
+		dispatchTarget(JAVACALL_METHOD_GETSTATS, ljEnv, &call);
+		return;
+	}
+	internal_javaGetStats(ljEnv, stats);
+}
+int javaGetMethodStats(void* ljEnv, ljJavaMethodStats_t* stats, int capacity) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = stats;
+		call.length = capacity;
+		dispatchTarget(JAVACALL_METHOD_GETMETHODSTATS, ljEnv, &call);
+		return call.ret.i;
+	}
+	return internal_javaGetMethodStats(ljEnv, stats, capacity);
+}
+void javaSetStatsEnabled(void* ljEnv, int enabled) {
+	internal_javaSetStatsEnabled(ljEnv, enabled);
+}
+void javaSetMethodStatsEnabled(void* ljEnv, int enabled) {
+	internal_javaSetMethodStatsEnabled(ljEnv, enabled);
+}
+void javaDeferReleaseObject(ljJavaObject_t* objectInterface) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_DEFERRELEASEOBJECT, objectInterface, &call);
+		return;
+	}
+	internal_javaDeferReleaseObject(objectInterface);
+}
+void javaDeferReleaseClass(ljJavaClass_t* classInterface) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_DEFERRELEASECLASS, classInterface, &call);
+		return;
+	}
+	internal_javaDeferReleaseClass(classInterface);
+}
+void javaFlushReleases(void* ljEnv) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_FLUSHRELEASES, ljEnv, &call);
+		return;
+	}
+	internal_javaFlushReleases(ljEnv);
+}
+void javaSetReleaseThreshold(void* ljEnv, int threshold) {
+	internal_javaSetReleaseThreshold(ljEnv, threshold);
+}
+int javaRunClassMethodAsync(ljJavaFuture_t* future, ljJavaClass_t* classInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args) {
+	if (nArgs > LJ_MAX_ARGS) {
+		fprintf(stderr, "java async call => too many parameters, %d at most\n", LJ_MAX_ARGS);
+		return 0;
+	}
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = future;
+		call.name = methodName;
+		call.nArgs = nArgs;
+		call.argTypes = argTypes;
+		call.args = args;
+		dispatchTarget(JAVACALL_METHOD_RUNCLASSMETHODASYNC, classInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaRunClassMethodAsync(future, classInterface, methodName, nArgs, argTypes, args);
+}
+int javaRunObjectMethodAsync(ljJavaFuture_t* future, ljJavaObject_t* objectInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args) {
+	if (nArgs > LJ_MAX_ARGS) {
+		fprintf(stderr, "java async call => too many parameters, %d at most\n", LJ_MAX_ARGS);
+		return 0;
+	}
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = future;
+		call.name = methodName;
+		call.nArgs = nArgs;
+		call.argTypes = argTypes;
+		call.args = args;
+		dispatchTarget(JAVACALL_METHOD_RUNOBJECTMETHODASYNC, objectInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaRunObjectMethodAsync(future, objectInterface, methodName, nArgs, argTypes, args);
+}
+int javaPollFuture(ljJavaFuture_t* future) {
+	return internal_javaPollFuture(future);
+}
+int javaWaitFuture(ljJavaFuture_t* future, int timeoutMs) {
+	return internal_javaWaitFuture(future, timeoutMs);
+}
+long long javaCurrentTimeMs(void) {
+	return internal_javaCurrentTimeMs();
+}
+int javaGetFutureFd(ljJavaFuture_t* future) {
+	return internal_javaGetFutureFd(future);
+}
+int javaGetFutureResult(ljJavaFuture_t* future, ljJavaResult_t* result) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.result = result;
+		call.strings = &dispatchStrings;
+		dispatchTarget(JAVACALL_METHOD_GETFUTURERESULT, future, &call);
+		return call.ret.i;
+	}
+	return internal_javaGetFutureResult(future, result);
+}
+void javaReleaseFuture(ljJavaFuture_t* future) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_RELEASEFUTURE, future, &call);
+		return;
+	}
+	internal_javaReleaseFuture(future);
+}
+int javaRunBatch(void* ljEnv, int nCalls, ljJavaBatchCall_t* calls) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = calls;
+		call.nArgs = nCalls;
+		call.strings = &dispatchStrings;
+		dispatchTarget(JAVACALL_METHOD_RUNBATCH, ljEnv, &call);
+		return call.ret.i;
+	}
+	return internal_javaRunBatch(ljEnv, nCalls, calls);
+}
+int javaNewArray(ljJavaObject_t* objectInterface, int elementType, int length) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.nArgs = elementType;
+		call.length = length;
+		dispatchTarget(JAVACALL_METHOD_NEWARRAY, objectInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaNewArray(objectInterface, elementType, length);
+}
+int javaGetArrayType(ljJavaObject_t* objectInterface) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_GETARRAYTYPE, objectInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaGetArrayType(objectInterface);
+}
+int javaGetArrayLength(ljJavaObject_t* objectInterface) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_GETARRAYLENGTH, objectInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaGetArrayLength(objectInterface);
+}
+//critical pins would stop the dispatcher thread from serving other calls, pins through it are plain ones
+int javaPinArray(ljJavaArray_t* arrayInterface, ljJavaObject_t* objectInterface, int critical) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = objectInterface;
+		call.nArgs = 0;
+		dispatchTarget(JAVACALL_METHOD_PINARRAY, arrayInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaPinArray(arrayInterface, objectInterface, critical);
+}
+void javaUnpinArray(ljJavaArray_t* arrayInterface, int commit) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.nArgs = commit;
+		dispatchTarget(JAVACALL_METHOD_UNPINARRAY, arrayInterface, &call);
+		return;
+	}
+	internal_javaUnpinArray(arrayInterface, commit);
+}
+int javaGetArrayRegion(ljJavaObject_t* objectInterface, int start, int length, void* buffer) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = buffer;
+		call.nArgs = start;
+		call.length = length;
+		dispatchTarget(JAVACALL_METHOD_GETARRAYREGION, objectInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaGetArrayRegion(objectInterface, start, length, buffer);
+}
+int javaSetArrayRegion(ljJavaObject_t* objectInterface, int start, int length, const void* buffer) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = (void*)buffer;
+		call.nArgs = start;
+		call.length = length;
+		dispatchTarget(JAVACALL_METHOD_SETARRAYREGION, objectInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaSetArrayRegion(objectInterface, start, length, buffer);
+}
+//the capacity is passed in ret, which the call overwrites with its result
+int javaNewDirectBuffer(ljJavaObject_t* objectInterface, void* address, long long capacity) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		call.extra = address;
+		call.ret.j = capacity;
+		dispatchTarget(JAVACALL_METHOD_NEWDIRECTBUFFER, objectInterface, &call);
+		return call.ret.i;
+	}
+	return internal_javaNewDirectBuffer(objectInterface, address, capacity);
+}
+void* javaGetDirectBufferAddress(ljJavaObject_t* objectInterface) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_GETDIRECTBUFFERADDRESS, objectInterface, &call);
+		return call.ret.p;
+	}
+	return internal_javaGetDirectBufferAddress(objectInterface);
+}
+long long javaGetDirectBufferCapacity(ljJavaObject_t* objectInterface) {
+	if (isDispatcherRunning()) {
+		ljJavaCall_t call;
+		dispatchTarget(JAVACALL_METHOD_GETDIRECTBUFFERCAPACITY, objectInterface, &call);
+		return call.ret.j;
+	}
+	return internal_javaGetDirectBufferCapacity(objectInterface);
+}
@@ -1,4 +1,8 @@
+#ifdef _WIN32
 #define DllExport   __declspec( dllexport )
+#else
+#define DllExport   __attribute__((visibility("default")))
+#endif
 
 #ifndef _Included_luajitjava
 #define _Included_luajitjava
@@ -10,9 +14,12 @@ typedef struct ljJavaClass {
 	void* ljEnv;
 	void* classObject;
 } ljJavaClass_t;
+//pool points back to the handle itself for handles given out by luajitjava,
+// and is NULL for handles allocated by the caller
 typedef struct ljJavaObject {
 	void* ljEnv;
 	void* object;
+	void* pool;
 } ljJavaObject_t;
 
 typedef enum javaArgType {
@@ -29,6 +36,159 @@ typedef enum javaArgType {
 	JTYPE_OBJECT
 } javaArgType_t;
 
+//string argument of known length, which may hold NUL characters
+// data is standard utf-8, or utf-16 when utf16 is set, length counting bytes or utf-16 units.
+// A negative length stands for a NUL terminated modified utf-8 string
+typedef struct ljJavaChars {
+	const void* data;
+	int length;
+	int utf16;
+} ljJavaChars_t;
+
+//value of a method or constructor argument, interpreted according to its javaArgType_t tag
+// JTYPE_STRING values are read as chars, string being the same pointer as chars.data
+typedef union ljJavaValue {
+	char b;
+	short s;
+	int i;
+	long long j;
+	float f;
+	double d;
+	char z;
+	unsigned short c;
+	const char* string;
+	ljJavaChars_t chars;
+	ljJavaObject_t* object;
+} ljJavaValue_t;
+
+//typed result of a method call, strings and boxed primitives are returned as values
+// and object handles are only created for other references.
+// String results stay valid until the next string result of the environment
+typedef struct ljJavaResult {
+	javaArgType_t type;
+	int length;
+	ljJavaValue_t value;
+} ljJavaResult_t;
+
+//method bound from its name and jni signature, called without any overload resolution
+// clazz holds a global reference to the class the method was bound on,
+// argClasses global references to the classes of object parameters, NULL for other parameters
+typedef struct ljJavaMethod {
+	void* ljEnv;
+	void* clazz;
+	void* methodID;
+	int isStatic;
+	javaArgType_t returnType;
+	int nArgs;
+	javaArgType_t* argTypes;
+	void** argClasses;
+} ljJavaMethod_t;
+
+//operations counted and timed by the statistics of an environment
+// JSTATS_METHOD covers class and object method calls, JSTATS_FIELD class and object field reads,
+// JSTATS_VALUE the value getters of object handles and JSTATS_ARRAY array pins and region copies
+typedef enum javaStatsOp {
+	JSTATS_BIND_CLASS,
+	JSTATS_NEW,
+	JSTATS_NEW_MANY,
+	JSTATS_FIELD,
+	JSTATS_METHOD,
+	JSTATS_BOUND_METHOD,
+	JSTATS_VALUE,
+	JSTATS_BATCH,
+	JSTATS_ASYNC,
+	JSTATS_ARRAY,
+	JSTATS_OP_COUNT
+} javaStatsOp_t;
+
+//number of buckets of latency histograms: latencies under 8ns have a bucket each,
+// longer ones fall into one of 4 buckets per power of two, the last bucket holding those over 7.5s
+#define LJ_STATS_BUCKETS 128
+
+//call count and latency histogram of an operation or a resolved method, times being in nanoseconds
+typedef struct ljJavaLatency {
+	long long calls;
+	long long errors;
+	long long totalNs;
+	long long maxNs;
+	long long buckets[LJ_STATS_BUCKETS];
+} ljJavaLatency_t;
+
+//usage statistics of an environment
+// objectRefs counts the global references held by object handles, classHandles the class handles bound
+// to the registeredClasses, pendingReleases the releases queued by all threads and not yet flushed.
+// Counters only grow while the environment runs, so that rates can be scraped,
+// methodsEnabled is set when resolved methods also keep their own latencies
+typedef struct ljJavaStats {
+	int handlesInUse;
+	int handlesFree;
+	int handleSlabs;
+	int pendingReleases;
+	int objectRefs;
+	int registeredClasses;
+	int classHandles;
+	int cachedMethods;
+	int cachedFields;
+	int enabled;
+	int methodsEnabled;
+	ljJavaLatency_t ops[JSTATS_OP_COUNT];
+} ljJavaStats_t;
+
+//length of the names of resolved method statistics, longer names are truncated
+#define LJ_STATS_NAME_SIZE 128
+
+//statistics of a resolved method, keyed by class, name and argument types
+// direct is set for methods called through jni, others going through the java proxy
+typedef struct ljJavaMethodStats {
+	char className[LJ_STATS_NAME_SIZE];
+	char name[LJ_STATS_NAME_SIZE];
+	int nArgs;
+	int direct;
+	ljJavaLatency_t latency;
+} ljJavaMethodStats_t;
+
+//one call of a batch run in a single crossing, a method call or a field read when isField is set
+// receiver is an ljJavaClass_t* when classReceiver is set, an ljJavaObject_t* otherwise.
+// String results of a batch stay valid until the next string result of the thread
+typedef struct ljJavaBatchCall {
+	void* receiver;
+	int classReceiver;
+	int isField;
+	const char* name;
+	int nArgs;
+	const javaArgType_t* argTypes;
+	const ljJavaValue_t* args;
+	int ok;
+	ljJavaResult_t result;
+} ljJavaBatchCall_t;
+
+//primitive java array pinned for direct access, elements points to length values of elementType.
+// Critical pins block the garbage collector, no other java call may be made by the thread
+// until they are unpinned. isCopy is set when elements is a copy written back on unpin
+typedef struct ljJavaArray {
+	void* ljEnv;
+	void* array;
+	javaArgType_t elementType;
+	int length;
+	void* elements;
+	int critical;
+	int isCopy;
+} ljJavaArray_t;
+
+//states of an asynchronous call
+typedef enum javaFutureState {
+	JFUTURE_PENDING,
+	JFUTURE_DONE,
+	JFUTURE_FAILED
+} javaFutureState_t;
+
+//future of a method call run by the java executor
+// state is owned by the C library and shared with the executor thread until the call completes
+typedef struct ljJavaFuture {
+	void* ljEnv;
+	void* state;
+} ljJavaFuture_t;
+
 DllExport int isNull(void* ptr) {
 	if (ptr == NULL) {
 		return 1;
@@ -39,22 +199,83 @@ DllExport int isNull(void* ptr) {
 }
 
 DllExport void* javaStart(const char* classPath);
+//start the JVM in a dispatcher thread, calls from any thread are then queued to it
+DllExport void* javaStartDispatcher(const char* classPath);
+//start the JVM with options such as "-Xmx512m", given after the class path,
+// and an AppCDS archive path, created by the first run and mapped by the next ones (NULL for none)
+DllExport void* javaStartEx(const char* classPath, int nOptions, const char** options, const char* sharedArchive, int useDispatcher);
 DllExport void javaEnd(void* ljEnv);
 DllExport int javaBindClass(ljJavaClass_t* classInterface, const char* className);
 DllExport void javaReleaseClass(ljJavaClass_t* classInterface);
 DllExport ljJavaObject_t* javaCheckClassField(ljJavaClass_t* classInterface, const char * key);
+//read a static field into result, returns 0 when key is not a field of the class
+DllExport int javaCheckClassFieldR(ljJavaClass_t* classInterface, const char * key, ljJavaResult_t* result);
 DllExport ljJavaObject_t* javaRunClassMethod(ljJavaClass_t* classInterface, const char * methodName, int nArgs, ...);
+DllExport ljJavaObject_t* javaRunClassMethodA(ljJavaClass_t* classInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args);
+DllExport int javaRunClassMethodR(ljJavaClass_t* classInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args, ljJavaResult_t* result);
 DllExport int javaNew(ljJavaObject_t* objectInterface, ljJavaClass_t* classInterface, int nArgs, ...);
+DllExport int javaNewA(ljJavaObject_t* objectInterface, ljJavaClass_t* classInterface, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args);
+DllExport int javaNewMany(ljJavaObject_t* objects, ljJavaClass_t* classInterface, int nObjects, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args);
 DllExport void javaReleaseObject(ljJavaObject_t* objectInterface);
 DllExport ljJavaObject_t* javaCheckObjectField(ljJavaObject_t* objectInterface, const char * key);
+//read a field into result, returns 0 when key is not a field of the object
+DllExport int javaCheckObjectFieldR(ljJavaObject_t* objectInterface, const char * key, ljJavaResult_t* result);
 DllExport ljJavaObject_t* javaRunObjectMethod(ljJavaObject_t* objectInterface, const char * methodName, int nArgs, ...);
+DllExport ljJavaObject_t* javaRunObjectMethodA(ljJavaObject_t* objectInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args);
+DllExport int javaRunObjectMethodR(ljJavaObject_t* objectInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args, ljJavaResult_t* result);
 DllExport int javaGetObjectType(ljJavaObject_t* objectInterface);
 DllExport int javaGetObjectIntValue(ljJavaObject_t* objectInterface);
 DllExport long javaGetObjectLongValue(ljJavaObject_t* objectInterface);
 DllExport float javaGetObjectFloatValue(ljJavaObject_t* objectInterface);
 DllExport double javaGetObjectDoubleValue(ljJavaObject_t* objectInterface);
 DllExport const char* javaGetObjectStringValue(ljJavaObject_t* objectInterface);
+DllExport int javaGetObjectValue(ljJavaObject_t* objectInterface, ljJavaResult_t* result);
 DllExport void javaReleaseStringValue(ljJavaObject_t* objectInterface, const char* stringValue);
+DllExport int javaGetStringValue(ljJavaObject_t* objectInterface, void* buffer, int capacity, int utf16);
+DllExport void javaSetConstantFolding(void* ljEnv, int enabled);
+DllExport int javaBindMethod(ljJavaMethod_t* methodInterface, ljJavaClass_t* classInterface, const char* methodName, const char* signature);
+DllExport void javaReleaseMethod(ljJavaMethod_t* methodInterface);
+DllExport void javaCallVoidMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args);
+DllExport int javaCallIntMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args);
+DllExport long long javaCallLongMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args);
+DllExport double javaCallDoubleMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args);
+DllExport ljJavaObject_t* javaCallObjectMethod(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args);
+DllExport int javaCallMethodR(ljJavaMethod_t* methodInterface, ljJavaObject_t* objectInterface, const ljJavaValue_t* args, ljJavaResult_t* result);
+DllExport int javaPushScope(void* ljEnv, int capacity);
+DllExport void javaPopScope(void* ljEnv);
+DllExport void javaEscapeObject(ljJavaObject_t* objectInterface);
+DllExport void javaGetStats(void* ljEnv, ljJavaStats_t* stats);
+//fill stats with up to capacity resolved methods, returns the number of resolved methods
+DllExport int javaGetMethodStats(void* ljEnv, ljJavaMethodStats_t* stats, int capacity);
+//turn the call counts and latencies of statistics on or off, they are on by default and gauges are always kept
+DllExport void javaSetStatsEnabled(void* ljEnv, int enabled);
+//turn the latencies of each resolved method on or off, they are off by default as threads calling
+// a same method contend on its record, and only kept while statistics are on
+DllExport void javaSetMethodStatsEnabled(void* ljEnv, int enabled);
+DllExport void javaDeferReleaseObject(ljJavaObject_t* objectInterface);
+DllExport void javaDeferReleaseClass(ljJavaClass_t* classInterface);
+DllExport void javaFlushReleases(void* ljEnv);
+DllExport void javaSetReleaseThreshold(void* ljEnv, int threshold);
+DllExport int javaRunClassMethodAsync(ljJavaFuture_t* future, ljJavaClass_t* classInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args);
+DllExport int javaRunObjectMethodAsync(ljJavaFuture_t* future, ljJavaObject_t* objectInterface, const char * methodName, int nArgs, const javaArgType_t* argTypes, const ljJavaValue_t* args);
+DllExport int javaPollFuture(ljJavaFuture_t* future);
+DllExport int javaWaitFuture(ljJavaFuture_t* future, int timeoutMs);
+//milliseconds of the monotonic clock future waits are timed with
+DllExport long long javaCurrentTimeMs(void);
+DllExport int javaGetFutureFd(ljJavaFuture_t* future);
+DllExport int javaGetFutureResult(ljJavaFuture_t* future, ljJavaResult_t* result);
+DllExport void javaReleaseFuture(ljJavaFuture_t* future);
+DllExport int javaRunBatch(void* ljEnv, int nCalls, ljJavaBatchCall_t* calls);
+DllExport int javaNewArray(ljJavaObject_t* objectInterface, int elementType, int length);
+DllExport int javaGetArrayType(ljJavaObject_t* objectInterface);
+DllExport int javaGetArrayLength(ljJavaObject_t* objectInterface);
+DllExport int javaPinArray(ljJavaArray_t* arrayInterface, ljJavaObject_t* objectInterface, int critical);
+DllExport void javaUnpinArray(ljJavaArray_t* arrayInterface, int commit);
+DllExport int javaGetArrayRegion(ljJavaObject_t* objectInterface, int start, int length, void* buffer);
+DllExport int javaSetArrayRegion(ljJavaObject_t* objectInterface, int start, int length, const void* buffer);
+DllExport int javaNewDirectBuffer(ljJavaObject_t* objectInterface, void* address, long long capacity);
+DllExport void* javaGetDirectBufferAddress(ljJavaObject_t* objectInterface);
+DllExport long long javaGetDirectBufferCapacity(ljJavaObject_t* objectInterface);
 
 #ifdef __cplusplus
 }
@@ -23,11 +23,21 @@
 
 package developpeur2000.luajitjava;
 
+import java.lang.invoke.MethodHandle;
+import java.lang.invoke.MethodHandles;
+import java.lang.invoke.MethodType;
 import java.lang.reflect.Array;
 import java.lang.reflect.Constructor;
 import java.lang.reflect.Field;
 import java.lang.reflect.Method;
 import java.lang.reflect.Modifier;
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.ThreadFactory;
 
 /**
  * Class that contains functions accessed by lua.
@@ -37,6 +47,55 @@ import java.lang.reflect.Modifier;
 public final class LuaJitJavaAPI
 {
 
+  /**
+   * Argument and return type tags, matching javaArgType_t in luajitjava.h
+   */
+  public static final int JTYPE_NONE = 0;
+  public static final int JTYPE_BYTE = 1;
+  public static final int JTYPE_SHORT = 2;
+  public static final int JTYPE_INT = 3;
+  public static final int JTYPE_LONG = 4;
+  public static final int JTYPE_FLOAT = 5;
+  public static final int JTYPE_DOUBLE = 6;
+  public static final int JTYPE_BOOLEAN = 7;
+  public static final int JTYPE_CHAR = 8;
+  public static final int JTYPE_STRING = 9;
+  public static final int JTYPE_OBJECT = 10;
+
+  /**
+   * Flag added by methodInfo to the return type tag of static methods
+   */
+  public static final int METHOD_STATIC = 0x100;
+
+  /**
+   * Flag added by methodInfo when the return type can hold strings or boxed primitives,
+   * the native side only looks for those in results of such methods
+   */
+  public static final int METHOD_VALUE = 0x200;
+
+  /**
+   * Classes of the objects the native side turns into values
+   */
+  private static final Class[] valueClasses = { String.class, Integer.class, Double.class, Long.class,
+      Boolean.class, Float.class, Short.class, Byte.class, Character.class };
+
+  /**
+   * Flags added by fieldInfo to the type tag of static and final fields
+   */
+  public static final int FIELD_STATIC = 0x100;
+  public static final int FIELD_FINAL = 0x200;
+
+  /**
+   * Executor running asynchronous calls, its daemon threads do not keep the JVM from ending
+   */
+  private static final ExecutorService asyncExecutor = Executors.newCachedThreadPool(new ThreadFactory() {
+    public Thread newThread(Runnable runnable) {
+      Thread thread = new Thread(runnable, "luajitjava-async");
+      thread.setDaemon(true);
+      return thread;
+    }
+  });
+
   private LuaJitJavaAPI()
   {
   }
@@ -55,6 +114,11 @@ public final class LuaJitJavaAPI
 		for (int j = 0; j < methodParams.length; j++) {
 			//System.out.println("class method type vs args type");
 			//System.out.println(methodParams[j].toString());
+			if (providedArgs[j] == null) {
+				if (methodParams[j].isPrimitive())
+					return false;
+				continue;
+			}
 			argClass = providedArgs[j].getClass();
 			//System.out.println(argClass.toString());
 			if (!methodParams[j].isAssignableFrom(argClass)) {
@@ -73,8 +137,8 @@ public final class LuaJitJavaAPI
 					providedArgs[j] = ((Double)providedArgs[j]).doubleValue();
 				} else if (methodParams[j] == boolean.class && argClass == Boolean.class) {
 					providedArgs[j] = ((Boolean)providedArgs[j]).booleanValue();
-				} else if (methodParams[j] == char.class && argClass == Byte.class) {
-					providedArgs[j] = ((Byte)providedArgs[j]).byteValue();
+				} else if (methodParams[j] == char.class && argClass == Character.class) {
+					providedArgs[j] = ((Character)providedArgs[j]).charValue();
 				} else {
 					return false;
 				}
@@ -116,27 +180,17 @@ public final class LuaJitJavaAPI
    * @throws LuaException
    */
 	public static Object javaNew(Class clazz, Object[] args) throws LuaException {
-		//System.out.println("look for class constructor");
-		//System.out.println(clazz.toString());
-		Constructor[] constructors = clazz.getConstructors();
-		Constructor constructor = null;
-		// gets method and arguments
-		for (int i = 0; i < constructors.length; i++) {
-			if (areCompatibleArgs(constructors[i].getParameterTypes(), args)) {
-				constructor = constructors[i];
-				break;
-			}
-		}
+		MethodEntry constructor = findConstructor(clazz, args);
 
-		// If method is null means there isn't one receiving the given arguments
+		// If constructor is null means there isn't one receiving the given arguments
 		if (constructor == null) {
 			throw new LuaException("Invalid method call. No such method.");
 		}
 
 		Object ret;
 		try {
-			ret = constructor.newInstance(args);
-		} catch (Exception e) {
+			ret = constructor.invoke(null, args);
+		} catch (Throwable e) {
 			throw new LuaException(e);
 		}
 
@@ -146,7 +200,29 @@ public final class LuaJitJavaAPI
 
 		return ret;
 	}
-	
+
+  /**
+   * javaNewMany returns new instances of a given clazz, one per set of constructor arguments.
+   * Objects that cannot be created are left null and reported on the error stream
+   * 
+   * @param clazz class to be instanciated
+   * @param args constructor parameters of each object, a null set standing for an object not to create
+   * @return newly created objects
+   */
+	public static Object[] javaNewMany(Class clazz, Object[][] args) {
+		Object[] objects = new Object[args.length];
+		for (int i = 0; i < args.length; i++) {
+			if (args[i] == null)
+				continue;
+			try {
+				objects[i] = javaNew(clazz, args[i]);
+			} catch (LuaException e) {
+				System.err.println("Error. Couldn't create object " + i + " : " + e.getMessage());
+			}
+		}
+		return objects;
+	}
+
 	/**
 	 * Checks if there is a field on the obj with the given name
 	 * 
@@ -184,7 +260,44 @@ public final class LuaJitJavaAPI
 		return ret;
 	}
   
-  	 
+
+	/**
+	 * Resolves the public field a native lookup can be bound to, without throwing
+	 * when the name is not a field, as it is usually a method name
+	 * 
+	 * @param clazz class to look the field in
+	 * @param fieldName name of the field
+	 * @param classReceiver true if the field is read on the class itself, only static fields are then returned
+	 * @return the field, or null if there is none with that name
+	 */
+	public static Field resolveField(Class clazz, String fieldName, boolean classReceiver) {
+		Field[] fields = clazz.getFields();
+
+		for (int i = 0; i < fields.length; i++) {
+			if (!fields[i].getName().equals(fieldName))
+				continue;
+			if (classReceiver && !Modifier.isStatic(fields[i].getModifiers()))
+				return null;
+			return fields[i];
+		}
+		return null;
+	}
+
+	/**
+	 * Describes a resolved field for the native side
+	 * 
+	 * @param field field to describe
+	 * @return the type tag of the field, with FIELD_STATIC and FIELD_FINAL set accordingly
+	 */
+	public static int fieldInfo(Field field) {
+		int modifiers = field.getModifiers();
+		int info = typeTag(field.getType());
+		if (Modifier.isStatic(modifiers))
+			info |= FIELD_STATIC;
+		if (Modifier.isFinal(modifiers))
+			info |= FIELD_FINAL;
+		return info;
+	}
   	 
   /**
    * Java implementation of the metamethod __index for running methods
@@ -194,21 +307,17 @@ public final class LuaJitJavaAPI
    * @return a method or null
    */
 	public static Object runMethod(Object obj, String methodName, Object[] objs) throws LuaException {
-		Method method = null;
-		Class clazz;
+		MethodEntry method;
 
 		if (obj instanceof Class) {
-			clazz = (Class) obj;
-			// First try. Static methods of the object
-			method = getMethod(clazz, methodName, objs);
-
-			if (method == null)
-				clazz = Class.class;
-			// Second try. Methods of the java.lang.Class class
-			method = getMethod(clazz, methodName, objs);
+			// First try. Static methods of the class
+			method = findMethod((Class) obj, methodName, objs, true);
+			if (method == null) {
+				// Second try. Methods of the java.lang.Class class
+				method = findMethod(Class.class, methodName, objs, false);
+			}
 		} else {
-			clazz = obj.getClass();
-			method = getMethod(clazz, methodName, objs);
+			method = findMethod(obj.getClass(), methodName, objs, false);
 		}
 
 		// If method is null means there isn't one receiving the given arguments
@@ -216,44 +325,453 @@ public final class LuaJitJavaAPI
 			throw new LuaException("Invalid method call. No such method.");
 		}
 
-		Object ret;
 		try {
-			if (Modifier.isPublic(method.getModifiers())) {
+			return method.invoke(obj, objs);
+		} catch (Exception e) {
+			throw new LuaException(e);
+		} catch (Error e) {
+			throw e;
+		} catch (Throwable e) {
+			throw new LuaException(new RuntimeException(e));
+		}
+	}
+
+	/**
+	 * Public method or constructor of a class ready to be invoked, through a method handle
+	 * taking the receiver and the spread arguments, ignoring the receiver of static methods and constructors
+	 */
+	private static final class MethodEntry {
+		final Method method;
+		final Constructor constructor;
+		final Class[] params;
+		final boolean isStatic;
+		final MethodHandle invoker;
+
+		MethodEntry(Method method) {
+			this.method = method;
+			this.constructor = null;
+			this.params = method.getParameterTypes();
+			this.isStatic = Modifier.isStatic(method.getModifiers());
+			this.invoker = spreadInvoker(method, params.length, isStatic);
+		}
+
+		MethodEntry(Constructor constructor) {
+			this.method = null;
+			this.constructor = constructor;
+			this.params = constructor.getParameterTypes();
+			this.isStatic = true;
+			this.invoker = spreadInvoker(constructor, params.length);
+		}
+
+		Object invoke(Object obj, Object[] args) throws Throwable {
+			if (invoker == null) {
+				if (constructor != null)
+					return constructor.newInstance(args);
+				return method.invoke(isStatic ? null : obj, args);
+			}
+			return invoker.invokeExact(obj, args);
+		}
+	}
+
+	/**
+	 * Method handle of type (Object, Object[])Object calling a method, or null when the method
+	 * is not accessible through method handles and has to be invoked by reflection
+	 */
+	private static MethodHandle spreadInvoker(Method method, int nParams, boolean isStatic) {
+		MethodHandle handle;
+		try {
+			handle = MethodHandles.publicLookup().unreflect(method);
+		} catch (IllegalAccessException e) {
+			// public method of a class that is not public itself
+			try {
 				method.setAccessible(true);
+				handle = MethodHandles.lookup().unreflect(method);
+			} catch (Exception e1) {
+				return null;
 			}
+		}
+		// arguments are always given as an array, varargs methods included
+		handle = handle.asFixedArity();
+		if (isStatic)
+			handle = MethodHandles.dropArguments(handle, 0, Object.class);
+		return handle.asType(MethodType.genericMethodType(nParams + 1)).asSpreader(Object[].class, nParams);
+	}
 
-			// if (obj instanceof Class)
-			if (Modifier.isStatic(method.getModifiers())) {
-				ret = method.invoke(null, objs);
-			} else {
-				ret = method.invoke(obj, objs);
+	/**
+	 * Method handle of type (Object, Object[])Object calling a constructor, the first argument being ignored,
+	 * or null when the constructor has to be invoked by reflection
+	 */
+	private static MethodHandle spreadInvoker(Constructor constructor, int nParams) {
+		MethodHandle handle;
+		try {
+			handle = MethodHandles.publicLookup().unreflectConstructor(constructor);
+		} catch (IllegalAccessException e) {
+			try {
+				constructor.setAccessible(true);
+				handle = MethodHandles.lookup().unreflectConstructor(constructor);
+			} catch (Exception e1) {
+				return null;
 			}
-		} catch (Exception e) {
-			throw new LuaException(e);
 		}
+		handle = MethodHandles.dropArguments(handle.asFixedArity(), 0, Object.class);
+		return handle.asType(MethodType.genericMethodType(nParams + 1)).asSpreader(Object[].class, nParams);
+	}
 
-		return ret;
+	/**
+	 * Public methods of each class by name, overloads being indexed by their number of parameters
+	 * and sorted so that the most specific ones are tried first. Built once per class
+	 */
+	private static final ClassValue<Map<String, MethodEntry[][]>> methodTables = new ClassValue<Map<String, MethodEntry[][]>>() {
+		protected Map<String, MethodEntry[][]> computeValue(Class<?> clazz) {
+			return buildMethodTable(clazz);
+		}
+	};
+
+	private static Map<String, MethodEntry[][]> buildMethodTable(Class clazz) {
+		Map<String, List<Method>> byName = new HashMap<String, List<Method>>();
+		Method[] methods = clazz.getMethods();
+		for (int i = 0; i < methods.length; i++) {
+			if (methods[i].isBridge())
+				continue;
+			List<Method> overloads = byName.get(methods[i].getName());
+			if (overloads == null) {
+				overloads = new ArrayList<Method>();
+				byName.put(methods[i].getName(), overloads);
+			}
+			overloads.add(methods[i]);
+		}
+
+		Map<String, MethodEntry[][]> table = new HashMap<String, MethodEntry[][]>();
+		for (Map.Entry<String, List<Method>> overloads : byName.entrySet()) {
+			int maxParams = 0;
+			for (Method method : overloads.getValue())
+				maxParams = Math.max(maxParams, method.getParameterTypes().length);
+			MethodEntry[][] byArity = new MethodEntry[maxParams + 1][];
+			for (int n = 0; n <= maxParams; n++) {
+				List<MethodEntry> entries = new ArrayList<MethodEntry>();
+				for (Method method : overloads.getValue()) {
+					if (method.getParameterTypes().length == n)
+						entries.add(new MethodEntry(method));
+				}
+				byArity[n] = sortBySpecificity(entries);
+			}
+			table.put(overloads.getKey(), byArity);
+		}
+		return table;
 	}
-	
-	private static Method getMethod(Class clazz, String methodName, Object[] args) {
-		//System.out.println("look for class method");
-		//System.out.println(clazz.toString());
+
+	/**
+	 * Orders overloads of a same arity so that an overload comes before the ones it is more specific than
+	 */
+	private static MethodEntry[] sortBySpecificity(List<MethodEntry> entries) {
+		MethodEntry[] sorted = new MethodEntry[entries.size()];
+		for (int i = 0; i < sorted.length; i++) {
+			int best = 0;
+			for (int j = 1; j < entries.size(); j++) {
+				if (isMoreSpecific(entries.get(j).params, entries.get(best).params))
+					best = j;
+			}
+			sorted[i] = entries.remove(best);
+		}
+		return sorted;
+	}
+
+	private static boolean isMoreSpecific(Class[] params, Class[] otherParams) {
+		boolean strictly = false;
+		for (int i = 0; i < params.length; i++) {
+			if (!otherParams[i].isAssignableFrom(params[i]))
+				return false;
+			if (otherParams[i] != params[i])
+				strictly = true;
+		}
+		return strictly;
+	}
+
+	/**
+	 * Public constructors of each class indexed by their number of parameters,
+	 * sorted so that the most specific ones are tried first. Built once per class
+	 */
+	private static final ClassValue<MethodEntry[][]> constructorTables = new ClassValue<MethodEntry[][]>() {
+		protected MethodEntry[][] computeValue(Class<?> clazz) {
+			return buildConstructorTable(clazz);
+		}
+	};
+
+	private static MethodEntry[][] buildConstructorTable(Class clazz) {
+		// abstract classes and interfaces cannot be instanciated
+		if (Modifier.isAbstract(clazz.getModifiers()))
+			return new MethodEntry[0][];
+
+		Constructor[] constructors = clazz.getConstructors();
+		int maxParams = -1;
+		for (int i = 0; i < constructors.length; i++)
+			maxParams = Math.max(maxParams, constructors[i].getParameterTypes().length);
+		MethodEntry[][] byArity = new MethodEntry[maxParams + 1][];
+		for (int n = 0; n <= maxParams; n++) {
+			List<MethodEntry> entries = new ArrayList<MethodEntry>();
+			for (int i = 0; i < constructors.length; i++) {
+				if (constructors[i].getParameterTypes().length == n)
+					entries.add(new MethodEntry(constructors[i]));
+			}
+			byArity[n] = sortBySpecificity(entries);
+		}
+		return byArity;
+	}
+
+	/**
+	 * Finds the first constructor of a class that accepts the provided arguments, in the constructor table of the class
+	 * 
+	 * @param clazz class to instanciate
+	 * @param args arguments of the constructor, can be modified to fit primitive types
+	 * @return the constructor, or null if there is none accepting the arguments
+	 */
+	private static MethodEntry findConstructor(Class clazz, Object[] args) {
+		MethodEntry[][] byArity = constructorTables.get(clazz);
+		if (args.length >= byArity.length)
+			return null;
+
+		MethodEntry[] overloads = byArity[args.length];
+		for (int i = 0; i < overloads.length; i++) {
+			if (areCompatibleArgs(overloads[i].params, args))
+				return overloads[i];
+		}
+		return null;
+	}
+
+	/**
+	 * Finds the first overload of a method that accepts the provided arguments, in the method table of its class
+	 * 
+	 * @param clazz class to look the method in
+	 * @param methodName name of the method
+	 * @param args arguments of the call, can be modified to fit primitive types
+	 * @param staticOnly true to only consider static methods
+	 * @return the method, or null if there is none accepting the arguments
+	 */
+	private static MethodEntry findMethod(Class clazz, String methodName, Object[] args, boolean staticOnly) {
+		MethodEntry[][] byArity = methodTables.get(clazz).get(methodName);
+		if (byArity == null || args.length >= byArity.length)
+			return null;
+
+		MethodEntry[] overloads = byArity[args.length];
+		for (int i = 0; i < overloads.length; i++) {
+			if (staticOnly && !overloads[i].isStatic)
+				continue;
+			if (areCompatibleArgs(overloads[i].params, args))
+				return overloads[i];
+		}
+		return null;
+	}
+
+
+  /**
+   * Resolves the method a native call can be bound to, from the type tags of its arguments.
+   * Only an unambiguous match is returned, as the native side caches it for all
+   * later calls with the same tags
+   * 
+   * @param clazz class to look the method in
+   * @param methodName name of the method
+   * @param argTypes type tags of the arguments
+   * @param classReceiver true if the method is called on the class itself
+   * @return the only matching method, or null if there is none or several of them
+   */
+	public static Method resolveMethod(Class clazz, String methodName, int[] argTypes, boolean classReceiver) {
+		boolean[] ambiguous = new boolean[1];
+		Method method;
+
+		if (classReceiver) {
+			// First try. Static methods of the class
+			method = findTaggedMethod(clazz, methodName, argTypes, true, ambiguous);
+			if (method != null || ambiguous[0])
+				return method;
+			// Second try. Methods of the java.lang.Class class
+			return findTaggedMethod(Class.class, methodName, argTypes, false, ambiguous);
+		}
+		return findTaggedMethod(clazz, methodName, argTypes, false, ambiguous);
+	}
+
+  /**
+   * Resolves the constructor a native instanciation can be bound to, from the type tags of its arguments.
+   * Only an unambiguous match is returned, as the native side caches it for all
+   * later instanciations with the same tags
+   * 
+   * @param clazz class to instanciate
+   * @param argTypes type tags of the arguments
+   * @return the only matching constructor, or null if there is none or several of them,
+   *  or if the class cannot be instanciated
+   */
+	public static Constructor resolveConstructor(Class clazz, int[] argTypes) {
+		if (clazz.isInterface() || Modifier.isAbstract(clazz.getModifiers()))
+			return null;
+
+		Constructor[] constructors = clazz.getConstructors();
+		Constructor constructor = null;
+		for (int i = 0; i < constructors.length; i++) {
+			if (!areCompatibleTypes(constructors[i].getParameterTypes(), argTypes))
+				continue;
+			if (constructor != null)
+				return null;
+			constructor = constructors[i];
+		}
+		return constructor;
+	}
+
+	private static Method findTaggedMethod(Class clazz, String methodName, int[] argTypes,
+			boolean staticOnly, boolean[] ambiguous) {
 		Method[] methods = clazz.getMethods();
 		Method method = null;
 
-		// gets method and arguments
 		for (int i = 0; i < methods.length; i++) {
-			if (!methods[i].getName().equals(methodName))
+			if (!methods[i].getName().equals(methodName) || methods[i].isBridge())
 				continue;
+			if (staticOnly && !Modifier.isStatic(methods[i].getModifiers()))
+				continue;
+			if (!areCompatibleTypes(methods[i].getParameterTypes(), argTypes))
+				continue;
+			if (method != null) {
+				ambiguous[0] = true;
+				return null;
+			}
+			method = methods[i];
+		}
+		return method;
+	}
 
-			if (areCompatibleArgs(methods[i].getParameterTypes(), args)) {
-				method = methods[i];
-				break;
+  /**
+   * Utility method to compare expected args of a function with provided type tags,
+   * primitive tags only match primitive parameters as they are passed unboxed
+   * 
+   * @param methodParams table of expected classes / types
+   * @param argTypes type tags of the provided args
+   * @return true if method can be called with args of the provided types
+   */
+	private static boolean areCompatibleTypes(Class[] methodParams, int[] argTypes) {
+		if (methodParams.length != argTypes.length)
+			return false;
+		for (int j = 0; j < methodParams.length; j++) {
+			if (argTypes[j] == JTYPE_STRING) {
+				if (!methodParams[j].isAssignableFrom(String.class))
+					return false;
+			} else if (argTypes[j] == JTYPE_OBJECT) {
+				if (methodParams[j].isPrimitive())
+					return false;
+			} else if (typeTag(methodParams[j]) != argTypes[j]) {
+				return false;
 			}
+		}
+		return true;
+	}
+
+	/**
+	 * Gives the type tag of a class, JTYPE_NONE standing for void
+	 */
+	private static int typeTag(Class type) {
+		if (type == void.class)
+			return JTYPE_NONE;
+		if (type == byte.class)
+			return JTYPE_BYTE;
+		if (type == short.class)
+			return JTYPE_SHORT;
+		if (type == int.class)
+			return JTYPE_INT;
+		if (type == long.class)
+			return JTYPE_LONG;
+		if (type == float.class)
+			return JTYPE_FLOAT;
+		if (type == double.class)
+			return JTYPE_DOUBLE;
+		if (type == boolean.class)
+			return JTYPE_BOOLEAN;
+		if (type == char.class)
+			return JTYPE_CHAR;
+		if (type == String.class)
+			return JTYPE_STRING;
+		return JTYPE_OBJECT;
+	}
 
+	/**
+	 * Describes a resolved method for the native side
+	 * 
+	 * @param method method to describe
+	 * @return the type tag of the method return type, with METHOD_STATIC set for static methods
+	 *         and METHOD_VALUE for object return types a string or boxed primitive is assignable to,
+	 *         as Object, Number, Comparable, Serializable or CharSequence
+	 */
+	public static int methodInfo(Method method) {
+		Class returnType = method.getReturnType();
+		int info = typeTag(returnType);
+		if (info == JTYPE_OBJECT) {
+			for (Class valueClass : valueClasses) {
+				if (returnType.isAssignableFrom(valueClass)) {
+					info |= METHOD_VALUE;
+					break;
+				}
+			}
 		}
+		if (Modifier.isStatic(method.getModifiers()))
+			info |= METHOD_STATIC;
+		return info;
+	}
 
-		return method;
+	/**
+	 * Runs a batch of method calls and field reads, so that the native side crosses
+	 * into java only once for all of them
+	 * 
+	 * @param receivers objects or classes of the calls, null for calls to skip
+	 * @param names names of the methods or fields
+	 * @param args arguments of the method calls, null for field reads
+	 * @param results filled with the result of each call
+	 * @return the exceptions thrown by the calls at their index, or null if no call failed
+	 */
+	public static Throwable[] runBatch(Object[] receivers, String[] names, Object[][] args, Object[] results) {
+		Throwable[] errors = null;
+		for (int i = 0; i < receivers.length; i++) {
+			if (receivers[i] == null)
+				continue;
+			try {
+				if (args[i] == null) {
+					results[i] = checkField(receivers[i], names[i]);
+				} else {
+					results[i] = runMethod(receivers[i], names[i], args[i]);
+				}
+			} catch (Throwable e) {
+				if (errors == null)
+					errors = new Throwable[receivers.length];
+				errors[i] = e;
+			}
+		}
+		return errors;
+	}
+
+	/**
+	 * Completes the native future of an asynchronous call, registered by the native library
+	 * 
+	 * @param future native future state
+	 * @param result result of the call, primitives being boxed
+	 * @param error exception thrown by the call, or null
+	 */
+	private static native void completeFuture(long future, Object result, Throwable error);
+
+	/**
+	 * Runs a method on the executor, the native future being completed once it returns
+	 * 
+	 * @param obj Object or Class that should provide the method
+	 * @param methodName the name of the method
+	 * @param objs arguments of the call
+	 * @param future native future state
+	 */
+	public static void runMethodAsync(final Object obj, final String methodName, final Object[] objs, final long future) {
+		asyncExecutor.execute(new Runnable() {
+			public void run() {
+				Object result = null;
+				Throwable error = null;
+				try {
+					result = runMethod(obj, methodName, objs);
+				} catch (Throwable e) {
+					error = e;
+				}
+				completeFuture(future, result, error);
+			}
+		});
 	}
 
   